@@ -0,0 +1,415 @@
+/*
+
+CspSetpointGenerator.h
+
+The CspSetpointGenerator class works out the position setpoints of a
+cyclic synchronous position (CSP) program, one cycle at a time, for up
+to 32 axes.
+
+Each axis is given a target position (MoveTo()) or a target velocity
+(MoveVel()) and limits on velocity, acceleration and jerk. Every cycle
+Update() moves every axis one cycle period along a jerk-limited path
+towards its target, and GetPosition() gives the setpoint to write to
+the drive's target position (0x607A). A new target can be given at
+any time, even in the middle of a move; the axis carries on from the
+position, velocity and acceleration it has and heads for the new
+target without a jump in any of them.
+
+The jerk of each cycle is chosen so that, if the axis braked as hard
+as the limits allow right after it, it would come to rest exactly on
+the target (or reach the target velocity exactly). The jerk is the
+largest the limits allow while that rest point is short of the
+target, and is found by a bounded root search once the axis has to
+start slowing down. Every Update() therefore takes a bounded,
+constant time per axis and allocates nothing, so it can be called
+from an EcatCyclicTask (EcatCyclicExecutor.h).
+
+Units are whatever the positions are in (encoder counts in the
+examples), per second, per second squared and per second cubed, the
+same as Linkage::SetMoveLimits().
+
+Usage:
+
+	CspSetpointGenerator gen;
+	err = gen.Init(2, 0.003);                 // 2 axes, 3 ms cycle
+	gen.SetLimits(100000, 500000, 5000000);   // vel, acc, jerk for all axes
+	gen.SetPosition(0, actualPosA);
+	gen.SetPosition(1, actualPosB);
+	gen.MoveTo(0, 250000);
+	gen.MoveVel(1, -20000);
+
+	// every cycle
+	gen.Update();
+	ctrlPDO[0].pos.Write((int32)gen.GetPosition(0));
+
+*/
+
+#ifndef CSP_SETPOINT_GENERATOR_H
+#define CSP_SETPOINT_GENERATOR_H
+
+#include <cmath>
+#include "CML.h"
+
+CML_NAMESPACE_START()
+
+// The most axes one generator handles.
+#define CSP_MAX_AXES 32
+
+class CspSetpointError : public Error
+{
+public:
+	static const CspSetpointError BadAxisCount;
+	static const CspSetpointError BadPeriod;
+	static const CspSetpointError BadLimits;
+
+protected:
+	CspSetpointError(uint16 id, const char* desc) : Error(id, desc) {}
+};
+
+inline const CspSetpointError CspSetpointError::BadAxisCount(0x9300, "The number of axes passed is out of range");
+inline const CspSetpointError CspSetpointError::BadPeriod(0x9301, "The cycle period must be greater than zero");
+inline const CspSetpointError CspSetpointError::BadLimits(0x9302, "The velocity, acceleration and jerk limits must be greater than zero");
+
+class CspSetpointGenerator
+{
+public:
+
+	// Root search iterations allowed per axis per cycle.
+	enum { MAX_ITERATIONS = 24 };
+
+	CspSetpointGenerator() : axisCt(0), period(0.001) {}
+
+	virtual ~CspSetpointGenerator() {}
+
+	/**
+	 * Set the number of axes and the cycle period. Every axis starts at
+	 * rest at position zero, with no target.
+	 *
+	 * @param axisNum       Number of axes, 1 to 32.
+	 * @param periodSeconds The time between Update() calls (the EtherCAT
+	 *                      cycle period), in seconds.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Init(int axisNum, double periodSeconds)
+	{
+		if (axisNum < 1 || axisNum > CSP_MAX_AXES) return &CspSetpointError::BadAxisCount;
+		if (!(periodSeconds > 0.0)) return &CspSetpointError::BadPeriod;
+
+		axisCt = axisNum;
+		period = periodSeconds;
+		for (int i = 0; i < axisCt; i++) {
+			AxisState& ax = axes[i];
+			ax.pos = ax.vel = ax.acc = 0.0;
+			ax.target = 0.0;
+			ax.velocityMode = false;
+			ax.done = true;
+			ax.maxVel = ax.maxAcc = ax.maxJrk = 1.0;
+		}
+		return 0;
+	}
+
+	int GetAxisCount(void) const { return axisCt; }
+
+	// Set the same limits on every axis.
+	const Error* SetLimits(double vel, double acc, double jrk)
+	{
+		for (int i = 0; i < axisCt; i++) {
+			const Error* err = SetLimits(i, vel, acc, jrk);
+			if (err) return err;
+		}
+		return 0;
+	}
+
+	/**
+	 * Set the limits of one axis. They apply from the next Update().
+	 *
+	 * @param axis Axis number.
+	 * @param vel  Largest velocity.
+	 * @param acc  Largest acceleration and deceleration.
+	 * @param jrk  Largest jerk.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* SetLimits(int axis, double vel, double acc, double jrk)
+	{
+		if (axis < 0 || axis >= axisCt) return &CspSetpointError::BadAxisCount;
+		if (!(vel > 0.0) || !(acc > 0.0) || !(jrk > 0.0)) return &CspSetpointError::BadLimits;
+
+		AxisState& ax = axes[axis];
+		ax.maxVel = vel;
+		ax.maxAcc = acc;
+		ax.maxJrk = jrk;
+		ax.done = false;
+		return 0;
+	}
+
+	// Place an axis at rest at the passed position, normally the actual
+	// position read from the drive before the first cycle.
+	void SetPosition(int axis, double position)
+	{
+		AxisState& ax = axes[axis];
+		ax.pos = position;
+		ax.vel = ax.acc = 0.0;
+		ax.target = position;
+		ax.velocityMode = false;
+		ax.done = true;
+	}
+
+	// Head for a target position, from wherever the axis is now.
+	void MoveTo(int axis, double position)
+	{
+		AxisState& ax = axes[axis];
+		ax.target = position;
+		ax.velocityMode = false;
+		ax.done = false;
+	}
+
+	// Head for a target velocity, from wherever the axis is now. The
+	// velocity is kept within the axis' velocity limit.
+	void MoveVel(int axis, double velocity)
+	{
+		AxisState& ax = axes[axis];
+		ax.target = velocity;
+		ax.velocityMode = true;
+		ax.done = false;
+	}
+
+	// Bring an axis to rest as quickly as the limits allow.
+	void Stop(int axis) { MoveVel(axis, 0.0); }
+
+	// Move every axis on by one cycle period.
+	void Update(void)
+	{
+		for (int i = 0; i < axisCt; i++)
+			UpdateAxis(axes[i]);
+	}
+
+	double GetPosition(int axis) const { return axes[axis].pos; }
+	double GetVelocity(int axis) const { return axes[axis].vel; }
+	double GetAcceleration(int axis) const { return axes[axis].acc; }
+
+	// True once an axis is at rest on its target position, or holding
+	// its target velocity.
+	bool IsDone(int axis) const { return axes[axis].done; }
+
+	// True once every axis is done.
+	bool IsDone(void) const
+	{
+		for (int i = 0; i < axisCt; i++)
+			if (!axes[i].done) return false;
+		return true;
+	}
+
+protected:
+
+	struct AxisState
+	{
+		double pos, vel, acc;
+		double target;            // position, or velocity in velocity mode
+		bool velocityMode;
+		bool done;
+		double maxVel, maxAcc, maxJrk;
+	};
+
+	// What the state of an axis would be after one period at jerk j.
+	struct Step
+	{
+		double pos, vel, acc;
+	};
+
+	Step StepBy(const AxisState& ax, double j) const
+	{
+		double t = period;
+		Step s;
+		s.acc = ax.acc + j * t;
+		s.vel = ax.vel + (ax.acc + 0.5 * j * t) * t;
+		s.pos = ax.pos + (ax.vel + (0.5 * ax.acc + j * t / 6.0) * t) * t;
+		return s;
+	}
+
+	/**
+	 * The velocity reached if the acceleration is brought to zero as
+	 * quickly as the jerk limit allows, one cycle at a time: full jerk
+	 * cycles and then one cycle that takes what is left to zero. Using
+	 * the cycles rather than the continuous ramp lets an axis settle on
+	 * a velocity without the acceleration chattering around zero.
+	 */
+	double RestVelocity(double vel, double acc, double jrk) const
+	{
+		double mag = fabs(acc), step = jrk * period;
+		double k = ceil(mag / step) - 1.0;
+		if (k < 0.0) k = 0.0;
+
+		double gain = period * (mag * (0.5 + k) - step * k * (k + 1.0) * 0.5);
+		return (acc >= 0.0) ? vel + gain : vel - gain;
+	}
+
+	static void Advance(double& p, double& v, double& a, double j, double t)
+	{
+		p += (v + (0.5 * a + j * t / 6.0) * t) * t;
+		v += (a + 0.5 * j * t) * t;
+		a += j * t;
+	}
+
+	/**
+	 * The distance travelled while braking to rest as quickly as the
+	 * limits allow: jerk down to a peak deceleration, hold it, and jerk
+	 * back to zero acceleration as the velocity reaches zero.
+	 */
+	static double StopDistance(double vel, double acc, double maxAcc, double jrk)
+	{
+		double dir = (vel + acc * fabs(acc) / (2.0 * jrk) >= 0.0) ? 1.0 : -1.0;
+		double v = vel * dir, a = acc * dir;
+
+		double peak = sqrt(jrk * v + 0.5 * a * a);
+		double hold = 0.0;
+		if (peak > maxAcc) {
+			peak = maxAcc;
+			hold = (v + 0.5 * a * a / jrk - maxAcc * maxAcc / jrk) / maxAcc;
+		}
+
+		double p = 0.0;
+		Advance(p, v, a, -jrk, (a + peak) / jrk);
+		Advance(p, v, a, 0.0, hold);
+		Advance(p, v, a, jrk, peak / jrk);
+		return p * dir;
+	}
+
+	// Where the axis comes to rest if it brakes after a period at jerk j,
+	// less the target.
+	double RestError(const AxisState& ax, double j) const
+	{
+		Step s = StepBy(ax, j);
+		return s.pos + StopDistance(s.vel, s.acc, ax.maxAcc, ax.maxJrk) - ax.target;
+	}
+
+	// The rest velocity after a period at jerk j, less the velocity passed.
+	double RestVelocityError(const AxisState& ax, double j, double velocity) const
+	{
+		Step s = StepBy(ax, j);
+		return RestVelocity(s.vel, s.acc, ax.maxJrk) - velocity;
+	}
+
+	/**
+	 * Find the jerk in [lo, hi] that makes f zero, where f rises with the
+	 * jerk, f(lo) < 0 and f(hi) > 0. Regula falsi with the Illinois
+	 * correction, limited to MAX_ITERATIONS.
+	 */
+	template <class F>
+	static double SolveJerk(double lo, double hi, double fLo, double fHi, double tol, F f)
+	{
+		double j = lo;
+		int side = 0;
+		for (int i = 0; i < MAX_ITERATIONS; i++) {
+			j = (lo * fHi - hi * fLo) / (fHi - fLo);
+			double fj = f(j);
+			if (fabs(fj) <= tol) break;
+
+			if (fj < 0.0) {
+				lo = j;
+				fLo = fj;
+				if (side == -1) fHi *= 0.5;
+				side = -1;
+			}
+			else {
+				hi = j;
+				fHi = fj;
+				if (side == 1) fLo *= 0.5;
+				side = 1;
+			}
+		}
+		return j;
+	}
+
+	void UpdateAxis(AxisState& ax)
+	{
+		if (ax.done) {
+			// holding a target velocity.
+			if (ax.velocityMode) ax.pos += ax.vel * period;
+			return;
+		}
+
+		const double t = period;
+		const double jrk = ax.maxJrk, acc = ax.maxAcc, vel = ax.maxVel;
+
+		// the jerk range that keeps the acceleration within its limit.
+		double lo = (-acc - ax.acc) / t, hi = (acc - ax.acc) / t;
+		if (lo < -jrk) lo = -jrk;
+		if (hi > jrk) hi = jrk;
+		if (lo > hi) lo = hi = (ax.acc > 0.0) ? -jrk : jrk;
+
+		// keep the velocity within its limit: the rest velocity after the
+		// step must not pass it.
+		double velTol = vel * 1e-12;
+		double fHi = RestVelocityError(ax, hi, vel);
+		if (fHi > 0.0) {
+			double fLo = RestVelocityError(ax, lo, vel);
+			if (fLo >= 0.0) hi = lo;
+			else hi = SolveJerk(lo, hi, fLo, fHi, velTol, [&](double j) { return RestVelocityError(ax, j, vel); });
+		}
+		double fLo = RestVelocityError(ax, lo, -vel);
+		if (fLo < 0.0) {
+			fHi = RestVelocityError(ax, hi, -vel);
+			if (fHi <= 0.0) lo = hi;
+			else lo = SolveJerk(lo, hi, fLo, fHi, velTol, [&](double j) { return RestVelocityError(ax, j, -vel); });
+		}
+
+		double j;
+		if (ax.velocityMode) {
+			double target = ax.target;
+			if (target > vel) target = vel;
+			if (target < -vel) target = -vel;
+
+			fLo = RestVelocityError(ax, lo, target);
+			fHi = RestVelocityError(ax, hi, target);
+			if (fHi <= 0.0) j = hi;
+			else if (fLo >= 0.0) j = lo;
+			else j = SolveJerk(lo, hi, fLo, fHi, velTol, [&](double jj) { return RestVelocityError(ax, jj, target); });
+		}
+		else {
+			double posTol = 1e-9 * (1.0 + fabs(ax.target));
+			fLo = RestError(ax, lo);
+			fHi = RestError(ax, hi);
+			if (fHi <= 0.0) j = hi;
+			else if (fLo >= 0.0) j = lo;
+			else j = SolveJerk(lo, hi, fLo, fHi, posTol, [&](double jj) { return RestError(ax, jj); });
+		}
+
+		double lastAcc = ax.acc;
+		Step s = StepBy(ax, j);
+		ax.pos = s.pos;
+		ax.vel = s.vel;
+		ax.acc = s.acc;
+
+		// finish once what is left is less than one cycle at the jerk limit.
+		// The acceleration goes from lastAcc to zero in this cycle, so that
+		// must be within the jerk limit too.
+		double settleAcc = jrk * t;
+		double settleVel = settleAcc * t;
+		if (fabs(lastAcc) > settleAcc || fabs(ax.acc) > settleAcc) return;
+
+		if (ax.velocityMode) {
+			double target = ax.target;
+			if (target > vel) target = vel;
+			if (target < -vel) target = -vel;
+			if (fabs(ax.vel - target) <= 0.5 * settleVel) {
+				ax.vel = target;
+				ax.acc = 0.0;
+				ax.done = true;
+			}
+		}
+		else if (fabs(ax.pos - ax.target) <= settleVel * t && fabs(ax.vel) <= settleVel) {
+			ax.pos = ax.target;
+			ax.vel = 0.0;
+			ax.acc = 0.0;
+			ax.done = true;
+		}
+	}
+
+	int axisCt;
+	double period;
+	AxisState axes[CSP_MAX_AXES];
+};
+
+CML_NAMESPACE_END()
+
+#endif
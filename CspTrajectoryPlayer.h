@@ -0,0 +1,427 @@
+/*
+
+CspTrajectoryPlayer.h
+
+The CspTrajectoryPlayer class plays a PVT trajectory (a
+PvtConstAccelTrj or another complete LinkTrajectory) or a CML Path in
+cyclic synchronous position (CSP) mode, working out the setpoints on
+the host one cycle at a time.
+
+Linkage::SendTrajectory() runs these trajectories in the drive's PVT
+mode: the segments are sent ahead into the drive's PVT buffer, the
+buffer is refilled as it empties, and every segment time must fit the
+drive's millisecond time base. A CspTrajectoryPlayer instead samples
+the trajectory at the EtherCAT cycle rate and gives the position,
+velocity and acceleration of every axis for the cycle, to be written
+to the fixed CSP RxPDO (0x1700). Nothing is buffered in the drive, so
+there is no refill traffic to keep up with, and a segment does not have
+to line up with the cycle: segments shorter than a cycle are skipped
+over, and longer ones are sampled wherever the cycles fall.
+
+- A PVT trajectory is read with NextSegment(), the same way the linkage
+  reads it, and each segment is evaluated as the cubic Hermite curve
+  through the positions and velocities at its ends, which is the cubic
+  the drive itself runs in PVT mode.
+- A Path is sampled with Path::PlayPath(), and its acceleration is the
+  change in velocity over the last cycle.
+
+Start() reads the whole trajectory into buffers of the player: every
+point of a PVT trajectory, or a sample of a path for every cycle. The
+trajectory's own code (which may lock, wait or allocate) only runs in
+Start(), and Update() only reads the buffers. So the trajectory must be
+complete when Start() is called. A PvtConstAccelTrj, PvtSoaTrj or Path
+is; a PvtStreamTrj, which waits for points that have not been appended
+yet, is meant for the drive's PVT mode and cannot be played here.
+SetMaxPoints() limits how many points or samples are held.
+
+The velocity and acceleration are also given scaled into the drive's
+velocity offset (0x60B1) and torque offset (0x60B2) units, to be sent
+as feedforward with the target position. The velocity scale is the
+drive's velocity offset units per position unit per second, and the
+torque scale is its torque offset units per position unit per second
+squared, which depends on the load's inertia; it is zero (no torque
+feedforward) until set.
+
+Start() prepares the trajectory (PvtConstAccelTrj works out its
+velocities here), reads it and hands it back, and should be called
+before the cyclic thread starts. Update() does not allocate, lock or
+call into the trajectory, and may be called from an EcatCyclicTask
+(EcatCyclicExecutor.h). Finish() drops the buffered trajectory.
+
+Usage:
+
+	CspTrajectoryPlayer player;
+	err = player.Init(2, 0.003);        // 2 axes, 3 ms cycle
+	player.SetFeedforward(10.0, 0.0);   // velocity offset in 0.1 counts/s
+	err = player.Start(trj);            // a PvtConstAccelTrj, or a Path
+
+	// every cycle
+	player.Update();
+	ctrlPDO[0].Write(0x000F, (int32)player.GetPosition(0),
+		player.GetVelocityOffset(0), player.GetTorqueOffset(0));
+
+*/
+
+#ifndef CSP_TRAJECTORY_PLAYER_H
+#define CSP_TRAJECTORY_PLAYER_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "CML.h"
+#include "CspSetpointGenerator.h"
+
+CML_NAMESPACE_START()
+
+// The most PVT points or path samples a player holds unless told otherwise.
+#define CSP_PLAYER_MAX_POINTS 1000000
+
+class CspPlayerError : public Error
+{
+public:
+	static const CspPlayerError BadAxisCount;
+	static const CspPlayerError BadPeriod;
+	static const CspPlayerError TooLong;
+
+protected:
+	CspPlayerError(uint16 id, const char* desc) : Error(id, desc) {}
+};
+
+inline const CspPlayerError CspPlayerError::BadAxisCount(0x9600, "The number of axes is out of range or does not match the player");
+inline const CspPlayerError CspPlayerError::BadPeriod(0x9601, "The cycle period must be greater than zero");
+inline const CspPlayerError CspPlayerError::TooLong(0x9602, "The trajectory has more points than the player is set to hold");
+
+class CspTrajectoryPlayer
+{
+public:
+
+	CspTrajectoryPlayer() : axisCt(0), period(0.001), maxPoints(CSP_PLAYER_MAX_POINTS), playing(PLAY_NONE),
+		done(true), elapsed(0), pointCt(0), nextPoint(0), segTime(0), segLength(0)
+	{
+	}
+
+	virtual ~CspTrajectoryPlayer() {}
+
+	/**
+	 * Set the number of axes and the cycle period.
+	 *
+	 * @param axisNum       Number of axes, 1 to 32.
+	 * @param periodSeconds The time between Update() calls (the EtherCAT
+	 *                      cycle period), in seconds.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Init(int axisNum, double periodSeconds)
+	{
+		if (axisNum < 1 || axisNum > CSP_MAX_AXES) return &CspPlayerError::BadAxisCount;
+		if (!(periodSeconds > 0.0)) return &CspPlayerError::BadPeriod;
+
+		axisCt = axisNum;
+		period = periodSeconds;
+		Finish();
+		for (int i = 0; i < axisCt; i++) {
+			AxisState& ax = axes[i];
+			ax.pos = ax.vel = ax.acc = 0.0;
+			ax.c0 = ax.c1 = ax.c2 = ax.c3 = 0.0;
+			ax.velScale = 1.0;
+			ax.torqueScale = 0.0;
+		}
+		return 0;
+	}
+
+	int GetAxisCount(void) const { return axisCt; }
+
+	// Limit the number of PVT points or path samples Start() reads.
+	void SetMaxPoints(size_t points) { maxPoints = points ? points : 1; }
+
+	// Set the feedforward scales of every axis.
+	void SetFeedforward(double velScale, double torqueScale)
+	{
+		for (int i = 0; i < axisCt; i++)
+			SetFeedforward(i, velScale, torqueScale);
+	}
+
+	/**
+	 * Set the feedforward scales of one axis.
+	 *
+	 * @param axis        The axis.
+	 * @param velScale    Velocity offset units per position unit per second.
+	 * @param torqueScale Torque offset units per position unit per second
+	 *                    squared, or zero for no torque feedforward.
+	 */
+	void SetFeedforward(int axis, double velScale, double torqueScale)
+	{
+		axes[axis].velScale = velScale;
+		axes[axis].torqueScale = torqueScale;
+	}
+
+	/**
+	 * Read a complete PVT trajectory and start playing it from its first
+	 * point. The axes are placed on the first point, at its velocity.
+	 * The trajectory is handed back (Finish() is called on it) before
+	 * this returns.
+	 *
+	 * @param pvt The trajectory.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Start(LinkTrajectory& pvt)
+	{
+		if (pvt.GetDim() != axisCt) return &CspPlayerError::BadAxisCount;
+
+		Finish();
+
+		const Error* err = pvt.StartNew();
+		if (err) return err;
+
+		// read up to and including the point with no time after it.
+		uunit p[CSP_MAX_AXES], v[CSP_MAX_AXES];
+		uint8 time = 1;
+		while (!err && time) {
+			if (pointCt >= maxPoints) {
+				err = &CspPlayerError::TooLong;
+				break;
+			}
+
+			time = 0;
+			err = pvt.NextSegment(p, v, time);
+			if (err) break;
+
+			for (int i = 0; i < axisCt; i++) {
+				pointPos.push_back((double)p[i]);
+				pointVel.push_back((double)v[i]);
+			}
+			pointTimes.push_back(time);
+			pointCt++;
+		}
+		pvt.Finish();
+
+		if (err) {
+			Finish();
+			return err;
+		}
+
+		playing = PLAY_PVT;
+		elapsed = 0.0;
+		segTime = 0.0;
+		nextPoint = 0;
+		for (int i = 0; i < axisCt; i++) {
+			axes[i].pos = pointPos[i];
+			axes[i].vel = pointVel[i];
+			axes[i].acc = 0.0;
+		}
+
+		if (pointCt < 2) {
+			// a single point; stay on it.
+			Hold();
+			return 0;
+		}
+
+		done = false;
+		NextPvtSegment();
+		return 0;
+	}
+
+	/**
+	 * Sample a path once per cycle and start playing it from its start
+	 * position, where the axes are placed.
+	 *
+	 * @param p The path. It is reset, and is not used once this returns.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Start(Path& p)
+	{
+		if (p.GetDim() != axisCt) return &CspPlayerError::BadAxisCount;
+
+		Finish();
+
+		uunit pos[CSP_MAX_AXES], vel[CSP_MAX_AXES];
+		p.Reset();
+		p.PlayPath(0.0, pos, vel);
+		for (int i = 0; i < axisCt; i++) {
+			axes[i].pos = (double)pos[i];
+			axes[i].vel = axes[i].acc = 0.0;
+		}
+
+		bool last = false;
+		while (!last) {
+			if (pointCt >= maxPoints) {
+				Finish();
+				return &CspPlayerError::TooLong;
+			}
+
+			last = p.PlayPath(period, pos, vel);
+			for (int i = 0; i < axisCt; i++) {
+				pointPos.push_back((double)pos[i]);
+				pointVel.push_back((double)vel[i]);
+			}
+			pointCt++;
+		}
+
+		playing = PLAY_PATH;
+		nextPoint = 0;
+		elapsed = 0.0;
+		done = false;
+		return 0;
+	}
+
+	/**
+	 * Move on by one cycle period. Once the trajectory is done, every
+	 * axis is held at rest on its last position. Only the buffers filled
+	 * by Start() are read.
+	 */
+	void Update(void)
+	{
+		if (done) return;
+
+		elapsed += period;
+
+		if (playing == PLAY_PATH) {
+			const double* p = &pointPos[nextPoint * axisCt];
+			const double* v = &pointVel[nextPoint * axisCt];
+			for (int i = 0; i < axisCt; i++) {
+				AxisState& ax = axes[i];
+				ax.acc = (v[i] - ax.vel) / period;
+				ax.pos = p[i];
+				ax.vel = v[i];
+			}
+			if (++nextPoint >= pointCt) Hold();
+			return;
+		}
+
+		segTime += period;
+		while (segTime >= segLength) {
+			if (nextPoint + 1 >= pointCt) {
+				// that was the last segment.
+				EndOnPoint();
+				return;
+			}
+
+			segTime -= segLength;
+			NextPvtSegment();
+		}
+
+		// evaluate the segment's cubic.
+		double t = segTime;
+		for (int i = 0; i < axisCt; i++) {
+			AxisState& ax = axes[i];
+			ax.pos = ax.c0 + (ax.c1 + (ax.c2 + ax.c3 * t) * t) * t;
+			ax.vel = ax.c1 + (2.0 * ax.c2 + 3.0 * ax.c3 * t) * t;
+			ax.acc = 2.0 * ax.c2 + 6.0 * ax.c3 * t;
+		}
+	}
+
+	// Stop playing and drop the buffered trajectory. The axes are held
+	// where they are. Not for the cyclic thread, as it frees the buffers.
+	void Finish(void)
+	{
+		pointPos.clear();
+		pointVel.clear();
+		pointTimes.clear();
+		pointCt = 0;
+		nextPoint = 0;
+		playing = PLAY_NONE;
+		Hold();
+	}
+
+	double GetPosition(int axis) const { return axes[axis].pos; }
+	double GetVelocity(int axis) const { return axes[axis].vel; }
+	double GetAcceleration(int axis) const { return axes[axis].acc; }
+
+	// The velocity, in the drive's velocity offset (0x60B1) units.
+	int32 GetVelocityOffset(int axis) const
+	{
+		return (int32)Clamp(axes[axis].vel * axes[axis].velScale, -2147483647.0, 2147483647.0);
+	}
+
+	// The acceleration, in the drive's torque offset (0x60B2) units.
+	int16 GetTorqueOffset(int axis) const
+	{
+		return (int16)Clamp(axes[axis].acc * axes[axis].torqueScale, -32767.0, 32767.0);
+	}
+
+	// Seconds played since Start().
+	double GetElapsed(void) const { return elapsed; }
+
+	// True once the trajectory has been played to its end.
+	bool IsDone(void) const { return done; }
+
+protected:
+
+	enum { PLAY_NONE, PLAY_PVT, PLAY_PATH };
+
+	struct AxisState
+	{
+		double pos, vel, acc;
+		double c0, c1, c2, c3;      // the current segment's cubic
+		double velScale, torqueScale;
+	};
+
+	static double Clamp(double v, double lo, double hi)
+	{
+		v = floor(v + 0.5);
+		return (v < lo) ? lo : (v > hi) ? hi : v;
+	}
+
+	// Start the segment from point nextPoint to the one after it, and
+	// move nextPoint on to the point that ends it.
+	void NextPvtSegment(void)
+	{
+		const double* p0 = &pointPos[nextPoint * axisCt];
+		const double* v0 = &pointVel[nextPoint * axisCt];
+		const double* p1 = p0 + axisCt;
+		const double* v1 = v0 + axisCt;
+
+		segLength = pointTimes[nextPoint] * 0.001;
+		nextPoint++;
+
+		// the cubic Hermite curve from (p0, v0) to (p1, v1) over h seconds.
+		double h = segLength;
+		for (int i = 0; i < axisCt; i++) {
+			AxisState& ax = axes[i];
+			double slope = (p1[i] - p0[i]) / h;
+			ax.pos = ax.c0 = p0[i];
+			ax.vel = ax.c1 = v0[i];
+			ax.c2 = (3.0 * slope - 2.0 * v0[i] - v1[i]) / h;
+			ax.c3 = (v0[i] + v1[i] - 2.0 * slope) / (h * h);
+			ax.acc = 2.0 * ax.c2;
+		}
+	}
+
+	// Stop on the last point.
+	void EndOnPoint(void)
+	{
+		const double* p = &pointPos[(pointCt - 1) * axisCt];
+		for (int i = 0; i < axisCt; i++)
+			axes[i].pos = p[i];
+		Hold();
+	}
+
+	// Stop where the axes are.
+	void Hold(void)
+	{
+		for (int i = 0; i < axisCt; i++)
+			axes[i].vel = axes[i].acc = 0.0;
+		done = true;
+	}
+
+	int axisCt;
+	double period;
+	size_t maxPoints;
+	int playing;                // what the buffers hold
+	bool done;
+	double elapsed;             // seconds since Start()
+
+	// the PVT points, or the path samples, axisCt values each.
+	std::vector<double> pointPos;
+	std::vector<double> pointVel;
+	std::vector<uint8> pointTimes;   // ms from each PVT point to the next
+	size_t pointCt;
+	size_t nextPoint;           // the point ending the segment, or the next sample
+
+	double segTime;             // seconds into the current segment
+	double segLength;           // seconds in the current segment
+	AxisState axes[CSP_MAX_AXES];
+};
+
+CML_NAMESPACE_END()
+
+#endif
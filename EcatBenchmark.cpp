@@ -0,0 +1,605 @@
+/*
+
+EcatBenchmark.cpp
+
+The following program measures the host CPU cost of the PDO handling
+done every cycle by a cyclic (CSP, CSV, CST) EtherCAT program. It opens
+the network and sets up the fixed CSP RxPDO (0x1700) of both axes of
+the first drive, the same way EcatCspMode.cpp does. The drive is never
+enabled: the control word sent is always zero.
+
+The calls are made back to back, without waiting for the cycle, so the
+results are the time the host spends per cycle and not the network
+timing. Run the program on the target machine with nothing else
+running.
+
+Benchmarks:
+
+1. RPDO commit. The control RPDO of every axis is sent once per cycle,
+   first with one Send() call per axis (a network lookup and a
+   transmit per axis, as EcatCspMode.cpp did) and then by writing all
+   of the mapped variables and calling RpdoProcessImage::Commit()
+   (RpdoProcessImage.h) once. The 8 and 32 axis cases send the two
+   RPDOs of the drive over and over, so the work per axis is the same
+   as with one RPDO per axis. The result is reported in microseconds
+   of host CPU per cycle.
+
+2. RPDO transmit. One RPDO is written and transmitted over and over,
+   looking the network up with a RefObjLocker<Network> on every call
+   and with the network pinned once by a PinnedNetwork
+   (PinnedNetwork.h). The result is reported in transmit calls per
+   second.
+
+3. TPDO snapshot contention. One thread publishes the five fields of
+   the CSP status TPDO (0x1B00) as fast as it can, the way a TPDO's
+   Received() does once per cycle, while 1, 2 and 4 threads read them.
+   It is run with a TpdoSnapshot (TpdoSnapshot.h) and with the fields
+   guarded by a std::mutex. The publish rate and the read rate of each
+   reader are reported in millions per second, along with the number
+   of reads that got fields from different publishes (there should be
+   none). This benchmark does not use the network.
+
+4. CSP setpoint generation. A CspSetpointGenerator
+   (CspSetpointGenerator.h) runs 32 axes for 100000 cycles of 1 ms,
+   with each axis given a new target position or velocity every few
+   hundred cycles, staggered so some axis is always retargeting. The
+   result is reported in nanoseconds of host CPU per axis per cycle,
+   for the average cycle and the slowest one. This benchmark does not
+   use the network.
+
+5. PDO field access. Each cycle the control law of every axis reads
+   the five fields of the CSP status TPDO 1, 4 and 16 times and writes
+   the four fields of the control RPDO once. It is run with one Pmap
+   object per field, read or written on every access as the PDO
+   classes did before PdoLayout.h, and with the PdoLayout used by
+   EcatCspMode.cpp, which unpacks the Pmap objects into a packed Data
+   once per cycle and packs the outputs once. The result is reported in
+   nanoseconds of host CPU per axis per cycle. This benchmark does not
+   use the network.
+
+6. Deferred TPDO processing. Eight DeferredTpdo objects
+   (TpdoExecutor.h) are received back to back every millisecond for two
+   seconds, the way the receive thread handles the TPDOs of a cycle.
+   One of them takes about 500 us to process and the others about
+   20 us. They are run inline on the receiving thread, with each PDO
+   on a dedicated worker, and on a shared pool of four workers. The
+   time the receiving thread spends per cycle is reported in
+   microseconds, along with the 99th percentile latency from receive to
+   processing of a fast PDO and of the slow one, the deepest queue and
+   the records dropped. This benchmark does not use the network.
+
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "CML.h"
+#include "RpdoProcessImage.h"
+#include "PinnedNetwork.h"
+#include "TpdoSnapshot.h"
+#include "CspSetpointGenerator.h"
+#include "PdoLayout.h"
+#include "TpdoExecutor.h"
+
+#if defined( WIN32 )
+#  include <ecat/ecat_winudp.h>
+#else
+#  include <ecat/ecat_linux.h>
+#endif
+
+// If a namespace has been defined in CML_Settings.h, this
+// macros starts using it.
+CML_NAMESPACE_USE();
+
+/* local functions */
+static void showerr(const Error* err, const char* str);
+static void benchmarkCommit(RpdoProcessImage& image, int axisNum, int cycleNum);
+static void benchmarkTransmit(int callNum);
+template <class Store> static void benchmarkSnapshot(const char* name, int readerNum, double seconds);
+static void benchmarkSetpoints(int axisNum, int cycleNum);
+static void benchmarkFieldAccess(int readNum, int cycleNum);
+static void benchmarkDeferred(const char* name, int mode, int cycleNum);
+
+// Used to time each benchmark.
+typedef std::chrono::steady_clock BenchClock;
+
+static double secondsSince(BenchClock::time_point start)
+{
+	return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+// The fixed CSP RxPDO (0x1700), as in EcatCspMode.cpp.
+class RpdoCspCtrl : public RPDO
+{
+	uint32 netRef;
+	PinnedNetwork network;
+
+public:
+	Pmap16 ctrl;
+	Pmap32 pos;
+	Pmap32 voff;
+	Pmap16 toff;
+
+	RpdoCspCtrl() { SetRefName("RpdoCspCtrl"); }
+	virtual ~RpdoCspCtrl() { KillRef(); }
+
+	const Error* Init(Node& node, uint16 slot = 0x100)
+	{
+		netRef = node.GetNetworkRef();
+		const Error* err = network.Pin(node);
+		int off = (slot == 0x140) ? 0x800 : 0;
+
+		if (!err) err = ctrl.Init(0x6040 + off, 0);
+		if (!err) err = pos.Init(0x607A + off, 0);
+		if (!err) err = voff.Init(0x60B1 + off, 0);
+		if (!err) err = toff.Init(0x60B2 + off, 0);
+
+		if (!err) err = AddVar(ctrl);
+		if (!err) err = AddVar(pos);
+		if (!err) err = AddVar(voff);
+		if (!err) err = AddVar(toff);
+
+		if (!err) err = node.PdoSet(slot, *this);
+		return err;
+	}
+
+	void Write(uint16 C, int32 P)
+	{
+		ctrl.Write(C);
+		pos.Write(P);
+		voff.Write(0);
+		toff.Write(0);
+	}
+
+	// Write and transmit, looking the network up on every call.
+	const Error* Send(uint16 C, int32 P)
+	{
+		Write(C, P);
+
+		RefObjLocker<Network> net(netRef);
+		if (!net) return &NodeError::NetworkUnavailable;
+
+		return Transmit(*net);
+	}
+
+	// Write and transmit on the network pinned by Init().
+	const Error* SendPinned(uint16 C, int32 P)
+	{
+		Write(C, P);
+		return network.Transmit(*this);
+	}
+};
+
+static RpdoCspCtrl ctrlPDO[2];
+
+// The fields of the CSP status TPDO (0x1B00), as in EcatCspMode.cpp.
+struct CspStatus
+{
+	uint16 statusWord;
+	int32 actualPos;
+	int32 followingErr;
+	int32 actualVel;
+	int16 actualTorque;
+};
+
+// Fill all of the fields from one counter, so a mixed read can be seen.
+static void makeStatus(CspStatus& s, int32 i)
+{
+	s.statusWord = (uint16)i;
+	s.actualPos = i;
+	s.followingErr = -i;
+	s.actualVel = i;
+	s.actualTorque = (int16)i;
+}
+
+static bool statusIsTorn(const CspStatus& s)
+{
+	return s.followingErr != -s.actualPos || s.actualVel != s.actualPos ||
+		s.statusWord != (uint16)s.actualPos || s.actualTorque != (int16)s.actualPos;
+}
+
+// The layouts of the CSP PDOs, as in EcatCspMode.cpp.
+enum { STAT_STATUS, STAT_POS, STAT_ERR, STAT_VEL, STAT_TORQUE };
+typedef PdoLayout<
+	PdoEntry<0x6041, 0, uint16>,
+	PdoEntry<0x6064, 0, int32>,
+	PdoEntry<0x60F4, 0, int32>,
+	PdoEntry<0x606C, 0, int32>,
+	PdoEntry<0x6077, 0, int16> > CspStatusLayout;
+
+enum { CTRL_WORD, CTRL_POS, CTRL_VOFF, CTRL_TOFF };
+typedef PdoLayout<
+	PdoEntry<0x6040, 0, uint16>,
+	PdoEntry<0x607A, 0, int32>,
+	PdoEntry<0x60B1, 0, int32>,
+	PdoEntry<0x60B2, 0, int16> > CspCtrlLayout;
+
+// A TPDO whose processing takes a fixed time, for the deferred
+// processing benchmark.
+class BusyTpdo : public DeferredTpdo<int32>
+{
+public:
+	double workUs;
+	int32 count;
+
+	BusyTpdo() : workUs(0), count(0) {}
+
+protected:
+	virtual bool Capture(int32& record)
+	{
+		record = count++;
+		return true;
+	}
+
+	virtual void Process(const int32&)
+	{
+		BenchClock::time_point start = BenchClock::now();
+		while (secondsSince(start) * 1e6 < workUs) {}
+	}
+};
+
+// The status held in a TpdoSnapshot.
+struct SeqlockStatus
+{
+	TpdoSnapshot<CspStatus> snapshot;
+	void Publish(const CspStatus& s) { snapshot.Publish(s); }
+	void Read(CspStatus& s) { snapshot.Read(s); }
+};
+
+// The status guarded by a mutex.
+struct MutexStatus
+{
+	std::mutex mutex;
+	CspStatus status;
+	MutexStatus() { makeStatus(status, 0); }
+	void Publish(const CspStatus& s) { std::lock_guard<std::mutex> lock(mutex); status = s; }
+	void Read(CspStatus& s) { std::lock_guard<std::mutex> lock(mutex); s = status; }
+};
+
+int main(void)
+{
+	const Error* err;
+#if defined( WIN32 )
+	WinUdpEcatHardware eth0("192.168.0.92");
+#else
+	LinuxEcatHardware eth0("eth0");
+#endif
+
+	EtherCAT ecat;
+	err = ecat.Open(eth0);
+	showerr(err, "opening EtherCAT network");
+
+	Node node;
+	err = node.Init(ecat, -1);
+	showerr(err, "initting node");
+
+	err = ctrlPDO[0].Init(node);
+	showerr(err, "initting control PDO axis A");
+	err = ctrlPDO[1].Init(node, 0x140);
+	showerr(err, "initting control PDO axis B");
+
+	err = node.StartNode();
+	showerr(err, "starting node");
+
+	printf("RPDO commit (microseconds of host CPU per cycle)\n");
+	printf("%6s %16s %16s %8s\n", "axes", "Send per axis", "one Commit", "speedup");
+
+	int axisCounts[] = { 2, 8, 32 };
+	for (int axisNum : axisCounts) {
+		RpdoProcessImage image;
+		err = image.Init(node);
+		showerr(err, "initting process image");
+		benchmarkCommit(image, axisNum, 20000);
+	}
+
+	printf("\nRPDO transmit (calls per second)\n");
+	printf("%16s %16s %8s\n", "RefObjLocker", "PinnedNetwork", "speedup");
+	benchmarkTransmit(200000);
+
+	printf("\nTPDO snapshot contention (millions per second)\n");
+	printf("%-12s %8s %10s %16s %12s\n", "store", "readers", "publish", "read per reader", "torn reads");
+	int readerCounts[] = { 1, 2, 4 };
+	for (int readerNum : readerCounts) {
+		benchmarkSnapshot<SeqlockStatus>("TpdoSnapshot", readerNum, 0.5);
+		benchmarkSnapshot<MutexStatus>("std::mutex", readerNum, 0.5);
+	}
+
+	printf("\nCSP setpoint generation (nanoseconds per axis per cycle)\n");
+	printf("%6s %10s %10s %10s\n", "axes", "average", "slowest", "retargets");
+	benchmarkSetpoints(32, 100000);
+
+	printf("\nPDO field access (nanoseconds per axis per cycle)\n");
+	printf("%12s %12s %12s %8s\n", "reads/field", "Pmap", "PdoLayout", "speedup");
+	int readCounts[] = { 1, 4, 16 };
+	for (int readNum : readCounts)
+		benchmarkFieldAccess(readNum, 1000000);
+
+	printf("\nDeferred TPDO processing (microseconds)\n");
+	printf("%-12s %12s %12s %12s %8s %8s\n", "executor", "receive avg", "p99 fast", "p99 slow", "depth", "dropped");
+	benchmarkDeferred("inline", 0, 2000);
+	benchmarkDeferred("dedicated", 1, 2000);
+	benchmarkDeferred("pool of 4", 4, 2000);
+
+	// the control PDOs are static and outlive the network.
+	PinnedNetwork::ReleaseAll(ecat);
+
+	return 0;
+}
+
+/**
+ * Time sending the RPDOs of axisNum axes, one Send() per axis and with
+ * a single RpdoProcessImage::Commit().
+ */
+static void benchmarkCommit(RpdoProcessImage& image, int axisNum, int cycleNum)
+{
+	const Error* err = 0;
+
+	for (int a = 0; a < axisNum; a++)
+		image.Add(ctrlPDO[a % 2]);
+
+	BenchClock::time_point start = BenchClock::now();
+	for (int c = 0; c < cycleNum && !err; c++) {
+		for (int a = 0; a < axisNum && !err; a++)
+			err = ctrlPDO[a % 2].Send(0, c);
+	}
+	double sendSeconds = secondsSince(start);
+	showerr(err, "sending control PDOs");
+
+	start = BenchClock::now();
+	for (int c = 0; c < cycleNum && !err; c++) {
+		for (int a = 0; a < axisNum; a++)
+			ctrlPDO[a % 2].Write(0, c);
+		err = image.Commit();
+	}
+	double commitSeconds = secondsSince(start);
+	showerr(err, "committing the process image");
+
+	printf("%6d %16.2f %16.2f %7.1fx\n", axisNum, sendSeconds * 1e6 / cycleNum,
+		commitSeconds * 1e6 / cycleNum, sendSeconds / commitSeconds);
+}
+
+/**
+ * Time transmitting one RPDO, looking the network up on every call and
+ * with the network pinned.
+ */
+static void benchmarkTransmit(int callNum)
+{
+	const Error* err = 0;
+
+	BenchClock::time_point start = BenchClock::now();
+	for (int c = 0; c < callNum && !err; c++)
+		err = ctrlPDO[0].Send(0, c);
+	double lockedSeconds = secondsSince(start);
+	showerr(err, "sending with a network lookup");
+
+	start = BenchClock::now();
+	for (int c = 0; c < callNum && !err; c++)
+		err = ctrlPDO[0].SendPinned(0, c);
+	double pinnedSeconds = secondsSince(start);
+	showerr(err, "sending on the pinned network");
+
+	printf("%16.0f %16.0f %7.1fx\n", callNum / lockedSeconds, callNum / pinnedSeconds, lockedSeconds / pinnedSeconds);
+}
+
+/**
+ * Time one thread publishing the CSP status while readerNum threads
+ * read it, for the number of seconds passed.
+ */
+template <class Store>
+static void benchmarkSnapshot(const char* name, int readerNum, double seconds)
+{
+	Store store;
+	std::atomic<bool> stop(false);
+	std::atomic<int> ready(0);
+	std::vector<uint64> reads(readerNum, 0), torn(readerNum, 0);
+	std::vector<std::thread> readers;
+
+	for (int r = 0; r < readerNum; r++) {
+		readers.push_back(std::thread([&store, &stop, &ready, &reads, &torn, r] {
+			CspStatus s;
+			uint64 n = 0, bad = 0;
+			ready++;
+			while (!stop.load(std::memory_order_relaxed)) {
+				store.Read(s);
+				if (statusIsTorn(s)) bad++;
+				n++;
+			}
+			reads[r] = n;
+			torn[r] = bad;
+		}));
+	}
+
+	// start timing once every reader is running.
+	while (ready.load() < readerNum)
+		std::this_thread::yield();
+
+	uint64 publishes = 0;
+	BenchClock::time_point start = BenchClock::now();
+	while (secondsSince(start) < seconds) {
+		for (int i = 0; i < 1000; i++) {
+			CspStatus s;
+			makeStatus(s, (int32)++publishes);
+			store.Publish(s);
+		}
+	}
+	double elapsed = secondsSince(start);
+	stop.store(true);
+
+	uint64 readTotal = 0, tornTotal = 0;
+	for (int r = 0; r < readerNum; r++) {
+		readers[r].join();
+		readTotal += reads[r];
+		tornTotal += torn[r];
+	}
+
+	printf("%-12s %8d %10.2f %16.2f %12llu\n", name, readerNum, publishes / elapsed * 1e-6,
+		readTotal / elapsed / readerNum * 1e-6, (unsigned long long)tornTotal);
+}
+
+/**
+ * Time a CspSetpointGenerator running axisNum axes for cycleNum
+ * cycles, with the axes retargeted at staggered cycles.
+ */
+static void benchmarkSetpoints(int axisNum, int cycleNum)
+{
+	CspSetpointGenerator gen;
+	const Error* err = gen.Init(axisNum, 0.001);
+	if (!err) err = gen.SetLimits(100000, 1000000, 20000000);
+	showerr(err, "initting the setpoint generator");
+
+	// the same targets every run.
+	srand(1);
+
+	double worst = 0;
+	long retargets = 0;
+	BenchClock::time_point start = BenchClock::now();
+	for (int c = 0; c < cycleNum; c++) {
+		// each axis gets a new target every 500 cycles, at its own offset.
+		for (int a = 0; a < axisNum; a++) {
+			if ((c + a * 37) % 500) continue;
+			if (rand() & 1)
+				gen.MoveTo(a, (rand() % 200001) - 100000);
+			else
+				gen.MoveVel(a, (rand() % 200001) - 100000);
+			retargets++;
+		}
+
+		BenchClock::time_point cycleStart = BenchClock::now();
+		gen.Update();
+		double cycleSeconds = secondsSince(cycleStart);
+		if (cycleSeconds > worst) worst = cycleSeconds;
+	}
+	double seconds = secondsSince(start);
+
+	printf("%6d %10.1f %10.1f %10ld\n", axisNum, seconds * 1e9 / cycleNum / axisNum,
+		worst * 1e9 / axisNum, retargets);
+}
+
+/**
+ * Time the field accesses of one axis' CSP PDOs for cycleNum cycles,
+ * reading each status field readNum times a cycle, through Pmap objects
+ * and through a PdoLayout.
+ */
+static void benchmarkFieldAccess(int readNum, int cycleNum)
+{
+	// keeps the compiler from dropping the reads.
+	volatile int64 sink = 0;
+	int64 sum = 0;
+
+	Pmap16 statusWord, ctrl, toff;
+	Pmap32 actualPos, followingErr, actualVel, pos, voff;
+	Pmap16 actualTorque;
+
+	BenchClock::time_point start = BenchClock::now();
+	for (int c = 0; c < cycleNum; c++) {
+		for (int r = 0; r < readNum; r++) {
+			sum += (uint16)statusWord.Read() + (int32)actualPos.Read() + (int32)followingErr.Read() +
+				(int32)actualVel.Read() + (int16)actualTorque.Read();
+		}
+		ctrl.Write((uint16)sum);
+		pos.Write((int32)c);
+		voff.Write((int32)sum);
+		toff.Write((int16)c);
+	}
+	double pmapSeconds = secondsSince(start);
+	sink = sum;
+
+	PdoLayoutMap<CspStatusLayout> statMap;
+	PdoLayoutMap<CspCtrlLayout> ctrlMap;
+	CspStatusLayout::Data in;
+	CspCtrlLayout::Data out;
+	sum = 0;
+
+	start = BenchClock::now();
+	for (int c = 0; c < cycleNum; c++) {
+		statMap.Unpack(in);
+		for (int r = 0; r < readNum; r++) {
+			sum += in.Get<STAT_STATUS>() + in.Get<STAT_POS>() + in.Get<STAT_ERR>() +
+				in.Get<STAT_VEL>() + in.Get<STAT_TORQUE>();
+		}
+		out.Set<CTRL_WORD>((uint16)sum);
+		out.Set<CTRL_POS>((int32)c);
+		out.Set<CTRL_VOFF>((int32)sum);
+		out.Set<CTRL_TOFF>((int16)c);
+		ctrlMap.Pack(out);
+	}
+	double layoutSeconds = secondsSince(start);
+	sink = sink + sum;
+
+	printf("%12d %12.1f %12.1f %7.1fx\n", readNum, pmapSeconds * 1e9 / cycleNum,
+		layoutSeconds * 1e9 / cycleNum, pmapSeconds / layoutSeconds);
+}
+
+/**
+ * Receive eight busy TPDOs once a millisecond for cycleNum cycles, with
+ * the processing run inline (mode 0), on a dedicated worker per PDO
+ * (mode 1) or on a shared pool of mode workers.
+ */
+static void benchmarkDeferred(const char* name, int mode, int cycleNum)
+{
+	const int pdoNum = 8;
+	BusyTpdo pdos[pdoNum];
+	TpdoExecutor dedicated[pdoNum];
+	TpdoExecutor pool;
+	const Error* err = 0;
+
+	for (int i = 0; i < pdoNum && !err; i++) {
+		pdos[i].workUs = i ? 20 : 500;
+		if (mode == 1) {
+			err = dedicated[i].Start(1);
+			if (!err) err = pdos[i].SetExecutor(&dedicated[i]);
+		}
+		else if (mode > 1) {
+			if (!i) err = pool.Start(mode);
+			if (!err) err = pdos[i].SetExecutor(&pool);
+		}
+	}
+	showerr(err, "starting the TPDO executors");
+
+	double receiveSeconds = 0;
+	BenchClock::time_point next = BenchClock::now();
+	for (int c = 0; c < cycleNum; c++) {
+		next += std::chrono::milliseconds(1);
+		std::this_thread::sleep_until(next);
+
+		BenchClock::time_point start = BenchClock::now();
+		for (int i = 0; i < pdoNum; i++)
+			pdos[i].Received();
+		receiveSeconds += secondsSince(start);
+	}
+
+	uint64 depth = 0, dropped = 0;
+	for (int i = 0; i < pdoNum; i++) {
+		pdos[i].WaitIdle(1000);
+		TpdoExecStats st = pdos[i].GetStats();
+		if (st.maxDepth > depth) depth = st.maxDepth;
+		dropped += st.dropped;
+	}
+
+	// detach the PDOs, which are destroyed after the executors.
+	for (int i = 0; i < pdoNum; i++)
+		pdos[i].SetExecutor(0);
+	pool.Stop();
+	for (int i = 0; i < pdoNum; i++)
+		dedicated[i].Stop();
+
+	printf("%-12s %12.1f %12.1f %12.1f %8llu %8llu\n", name, receiveSeconds * 1e6 / cycleNum,
+		pdos[1].GetHistogram(TPDO_EXEC_LATENCY).GetPercentile(99),
+		pdos[0].GetHistogram(TPDO_EXEC_LATENCY).GetPercentile(99),
+		(unsigned long long)depth, (unsigned long long)dropped);
+}
+
+/**************************************************/
+
+static void showerr(const Error* err, const char* str)
+{
+	if (err)
+	{
+		printf("Error %s: %s\n", str, err->toString());
+		exit(1);
+	}
+}
@@ -12,9 +12,18 @@ The following example illustrates how to command a dual axis
 EtherCAT drive in CSP mode using fixed PDO's.
 
 CML will command positions in the positive direction until the
-actual velocity exceeds the maximum velocity. It will then
+commanded velocity reaches the maximum velocity. It will then
 slow down the motor and begin the same process in the negative
-direction.
+direction. The positions come from a CspSetpointGenerator
+(CspSetpointGenerator.h), which limits the velocity, acceleration
+and jerk of the setpoints and steps by the real cycle period.
+
+Run the program with the argument "pvt" or "path" to play a PVT
+trajectory (a PvtConstAccelTrj) or a two axis Path in CSP mode
+instead. A CspTrajectoryPlayer (CspTrajectoryPlayer.h) samples the
+trajectory on the host every cycle and the velocity and acceleration
+are sent in the velocity and torque offsets as feedforward, so the
+drive's PVT buffer is not used at all.
 
 Fixed PDO's are handled by the drive's firmware in a high
 priority thread. They are fixed, meaning their contents are
@@ -31,6 +40,20 @@ It commands the following important objects to the drive:
 Control Word (0x6040), Target Position (0x607A), Velocity
 Offset (0x60B1), and Torque Offset (0x60B2).
 
+The control law runs once per EtherCAT cycle on a real-time thread
+owned by an EcatCyclicExecutor (EcatCyclicExecutor.h). The thread is
+given a SCHED_FIFO priority, pinned to a CPU and has its memory locked
+before the first cycle, and it counts the cycles that overrun. Run the
+program with the privilege to do this (root, or CAP_SYS_NICE and
+CAP_IPC_LOCK); it prints what could not be set up. When the program
+is stopped it prints histograms of the cycle period, wake latency,
+compute and transmit times; use the worst finish time to pick a
+pdoUpdateRate that is safe on the host.
+
+Nothing on the real-time thread prints. The control law pushes what it
+has to report (faults, trajectory errors, the phases of the move) to a
+TelemetrySink (TelemetrySink.h), whose own thread prints it.
+
 */
 
 #include <CML.h>
@@ -47,6 +70,15 @@ Offset (0x60B1), and Torque Offset (0x60B2).
 #include <time.h>
 #include <math.h>
 #include <stdint.h>
+#include <atomic>
+#include "EcatCyclicExecutor.h"
+#include "RpdoProcessImage.h"
+#include "PinnedNetwork.h"
+#include "TpdoSnapshot.h"
+#include "CspSetpointGenerator.h"
+#include "CspTrajectoryPlayer.h"
+#include "PdoLayout.h"
+#include "TelemetrySink.h"
 
 CML_NAMESPACE_USE();
 
@@ -56,97 +88,111 @@ int axisCt = 2;
 
 int pdoUpdateRate = 3; // 3 millisecond PDO update rate
 
+int cyclicCpu = -1;    // CPU to run the control law on, -1 for any
+
+// Velocity offset (0x60B1) units per count/s, and torque offset (0x60B2)
+// units per count/s^2 sent as feedforward when playing a trajectory.
+// The torque scale depends on the load; it is left at zero until tuned.
+double velFeedforward = 10.0;
+double torqueFeedforward = 0.0;
+
+// The layout of the fixed transmit PDO (0x1B00).
+enum { STAT_STATUS, STAT_POS, STAT_ERR, STAT_VEL, STAT_TORQUE };
+typedef PdoLayout<
+    PdoEntry<0x6041, 0, uint16>,    // status word
+    PdoEntry<0x6064, 0, int32>,     // actual position
+    PdoEntry<0x60F4, 0, int32>,     // following error
+    PdoEntry<0x606C, 0, int32>,     // actual velocity
+    PdoEntry<0x6077, 0, int16> > NodeStatLayout;
+
+// The data of the fixed transmit PDO, as received in one cycle.
+typedef NodeStatLayout::Data NodeStat;
+
+// Print one status record, on the telemetry thread.
+static void printNodeStat(FILE* fp, const NodeStat& stat)
+{
+    fprintf(fp, "stat: 0x%04x,  pos: %- 8d,  err: %- 8d,  vel: %- 8d,  trq: %- 5d \r", stat.Get<STAT_STATUS>(),
+        stat.Get<STAT_POS>(), stat.Get<STAT_ERR>(), stat.Get<STAT_VEL>(), stat.Get<STAT_TORQUE>());
+}
+
 // This PDO represents the fixed transmit PDO (0x1B00) in the drive
 class TPDO_NodeStat : public TPDO
 {
 public:
-    Pmap16 statusWord;
-    Pmap32 actualPos;
-    Pmap32 followingErr;
-    Pmap32 actualVel;
-    Pmap16 actualTorque;
-    int display;
+    PdoLayoutMap<NodeStatLayout> map;
+
+    // If set, every status received is passed to this sink to be printed.
+    // Set and cleared by main() while the receive thread reads it.
+    std::atomic<TelemetrySink<NodeStat>*> telemetry;
+
+    // The last data received. Other threads read the fields from here
+    // rather than from the mapped variables, so they always get all of
+    // them from the same cycle.
+    TpdoSnapshot<NodeStat> snapshot;
 
     /// Default constructor for this PDO
-    TPDO_NodeStat() { SetRefName("TPDO_Status"); }
+    TPDO_NodeStat() : telemetry(0) { SetRefName("TPDO_Status"); }
     virtual ~TPDO_NodeStat() { KillRef(); }
     const Error* Init(Node& node, uint16 slot = 0x100)
     {
         // Set transmit type to transmit on events
         const Error* err = 0;// = SetType(255);
 
-        int offset = (slot == 0x140) ? 0x800 : 0;
+        // axis B's objects are 0x800 above axis A's.
+        int axis = (slot == 0x140) ? 1 : 0;
 
-        // Let the various mapped variables know which 
-        // objects in the amp's object dictionary they
-        // are linked to.
-        if (!err) err = statusWord.Init(0x6041 + offset, 0);
-        if (!err) err = actualPos.Init(0x6064 + offset, 0);
-        if (!err) err = followingErr.Init(0x60F4 + offset, 0);
-        if (!err) err = actualVel.Init(0x606C + offset, 0);
-        if (!err) err = actualTorque.Init(0x6077 + offset, 0);
-
-        // Add the mapped variables
-        if (!err) err = AddVar(statusWord);
-        if (!err) err = AddVar(actualPos);
-        if (!err) err = AddVar(followingErr);
-        if (!err) err = AddVar(actualVel);
-        if (!err) err = AddVar(actualTorque);
+        // Map the objects of the layout, in order.
+        if (!err) err = map.Init(*this, axis);
 
         // Program this PDO in the amp, and enable it
         if (!err) err = node.PdoSet(slot, *this);
 
-        display = 0;
-
         return err;
     }
     virtual void Received(void)
     {
-        uint16 s = statusWord.Read();
-        int32 p = actualPos.Read();
-        int32 e = followingErr.Read();
-        int32 v = actualVel.Read();
-        int16 t = actualTorque.Read();
-        if (display)
-            printf("stat: 0x%04x,  pos: %- 8d,  err: %- 8d,  vel: %- 8d,  trq: %- 5d \r", s, p, e, v, t);
+        NodeStat stat;
+        map.Unpack(stat);
+        snapshot.Publish(stat);
+
+        // printing here would hold up the receive thread; the sink's
+        // thread does it.
+        TelemetrySink<NodeStat>* sink = telemetry.load(std::memory_order_acquire);
+        if (sink)
+            sink->Push(stat);
     }
 };
 
+// The layout of the fixed receive PDO used in CSP mode (0x1700).
+enum { CTRL_WORD, CTRL_POS, CTRL_VOFF, CTRL_TOFF };
+typedef PdoLayout<
+    PdoEntry<0x6040, 0, uint16>,    // control word
+    PdoEntry<0x607A, 0, int32>,     // target position
+    PdoEntry<0x60B1, 0, int32>,     // velocity offset
+    PdoEntry<0x60B2, 0, int16> > NodeCtrlLayout;
+
 // This represents the fixed receive PDO used in CSP mode (0x1700)
 class RPDO_NodeCtrl : public RPDO
 {
-    uint32 netRef;
+    PinnedNetwork network;
 
 public:
-    Pmap16 ctrl;
-    Pmap32 pos;
-    Pmap32 voff;
-    Pmap16 toff;
+    PdoLayoutMap<NodeCtrlLayout> map;
+    NodeCtrlLayout::Data data;
 
     /// Default constructor for this PDO
     RPDO_NodeCtrl() { SetRefName("RPDO_NodeCtrl"); }
     virtual ~RPDO_NodeCtrl() { KillRef(); }
     const Error* Init(Node& node, uint16 slot = 0x100)
     {
-        netRef = node.GetNetworkRef();
-        const Error* err = 0;
-
-        // define an 0x800 offset for object indices belonging to axis B.
-        int off = (slot == 0x140) ? 0x800 : 0;
-
-        // Let the various mapped variables know which 
-        // objects in the amp's object dictionary they
-        // are linked to.
-        if (!err) err = ctrl.Init(0x6040 + off, 0);
-        if (!err) err = pos.Init(0x607A + off, 0);
-        if (!err) err = voff.Init(0x60B1 + off, 0);
-        if (!err) err = toff.Init(0x60B2 + off, 0);
-
-        // Add the mapped variables
-        if (!err) err = AddVar(ctrl);
-        if (!err) err = AddVar(pos);
-        if (!err) err = AddVar(voff);
-        if (!err) err = AddVar(toff);
+        // look the network up once, so Send() does not have to.
+        const Error* err = network.Pin(node);
+
+        // axis B's objects are 0x800 above axis A's.
+        int axis = (slot == 0x140) ? 1 : 0;
+
+        // Map the objects of the layout, in order.
+        if (!err) err = map.Init(*this, axis);
 
         // Program this PDO in the amp, and enable it
         if (!err) err = node.PdoSet(slot, *this);
@@ -154,17 +200,211 @@ public:
         return err;
     }
 
+    // Write the mapped variables without transmitting. Used with an
+    // RpdoProcessImage, which transmits all of the RPDOs together.
+    void Write(uint16 C, int32 P, int32 vo = 0, int16 to = 0)
+    {
+        data.Set<CTRL_WORD>(C);
+        data.Set<CTRL_POS>(P);
+        data.Set<CTRL_VOFF>(vo);
+        data.Set<CTRL_TOFF>(to);
+        map.Pack(data);
+    }
+
     const Error* Send(uint16 C, int32 P, int32 vo = 0, int16 to = 0)
     {
-        ctrl.Write(C);
-        pos.Write(P);
-        voff.Write(vo);
-        toff.Write(to);
+        Write(C, P, vo, to);
+
+        return network.Transmit(*this);
+    }
+};
+
+// The TPDO data the control law reads each cycle.
+struct CspInputs
+{
+    uint16 statusWord[2];
+};
+
+// The RPDO data the control law writes each cycle.
+struct CspOutputs
+{
+    uint16 ctrl[2];
+    int32 pos[2];
+    int32 voff[2];
+    int16 toff[2];
+};
 
-        RefObjLocker<Network> net(netRef);
-        if (!net) return &NodeError::NetworkUnavailable;
+// Something the control law reports. The control law runs on the
+// real-time thread, so it pushes these to a TelemetrySink rather than
+// printing them itself.
+enum CspEventKind { CSP_FAULT, CSP_TRJ_DONE, CSP_AT_MAX_VEL, CSP_SLOWDOWN, CSP_AT_NEG_MAX_VEL };
 
-        return Transmit(*net);
+struct CspEvent
+{
+    int kind;
+    int axis;
+    double value;
+};
+
+// Print one control law event, on the telemetry thread.
+static void printCspEvent(FILE* fp, const CspEvent& ev)
+{
+    switch (ev.kind)
+    {
+    case CSP_FAULT:          fprintf(fp, "\n\nClearing fault on axis %d\n\n", ev.axis); break;
+    case CSP_TRJ_DONE:       fprintf(fp, "\nTrajectory done after %f s\n", ev.value); break;
+    case CSP_AT_MAX_VEL:     fprintf(fp, "\nAt max velocity %f\n", ev.value); break;
+    case CSP_SLOWDOWN:       fprintf(fp, "\nStarting slowdown\n"); break;
+    case CSP_AT_NEG_MAX_VEL: fprintf(fp, "\nAt negative max velocity\n"); break;
+    }
+}
+
+// The CSP control law. It is run by an EcatCyclicExecutor once per
+// EtherCAT cycle. The setpoints come from a jerk-limited
+// CspSetpointGenerator, which runs up to the maximum velocity, holds it
+// for a second, and then runs to the maximum velocity the other way.
+// If a trajectory player is passed, the setpoints and the velocity and
+// torque feedforward come from the trajectory it is playing instead.
+class CspTask : public EcatCyclicTask<CspInputs, CspOutputs>
+{
+public:
+    TPDO_NodeStat* statPDO;
+    RPDO_NodeCtrl* ctrlPDO;
+    RpdoProcessImage* image;
+    CspTrajectoryPlayer* player;
+
+    CspSetpointGenerator gen;
+    int32 wrap;
+    double maxvel;   // cts/s
+    int qstop;
+    int halt;
+    int delay;       // cycles left at max velocity
+    int phase;       // 0: to +maxvel, 1: holding, 2: to -maxvel, 3: done
+    bool faulted[2]; // the fault bit was set last cycle
+
+    // What the control law reports, printed on the sink's thread. Start
+    // it before the executor and stop it after.
+    TelemetrySink<CspEvent> events;
+
+    CspTask(TPDO_NodeStat* stat, RPDO_NodeCtrl* ctrl, RpdoProcessImage* img, CspTrajectoryPlayer* play = 0) : statPDO(stat),
+        ctrlPDO(ctrl), image(img), player(play), wrap(0),
+        maxvel(0), qstop(0), halt(0), delay(0), phase(0), events(printCspEvent, 64)
+    {
+        faulted[0] = faulted[1] = false;
+    }
+
+    void Report(int kind, int axis = 0, double value = 0.0)
+    {
+        CspEvent ev = { kind, axis, value };
+        events.Push(ev);
+    }
+
+    // Start every axis from its actual position towards the max velocity.
+    const Error* Init(const int32* startPos, double periodSeconds, double acc, double jrk)
+    {
+        const Error* err = gen.Init(axisCt, periodSeconds);
+        if (!err) err = gen.SetLimits(maxvel, acc, jrk);
+        if (err) return err;
+
+        for (int i = 0; i < axisCt; i++)
+        {
+            gen.SetPosition(i, startPos[i]);
+            gen.MoveVel(i, maxvel);
+        }
+        return 0;
+    }
+
+    virtual void ReadInputs(CspInputs& in)
+    {
+        for (int i = 0; i < axisCt; i++)
+            in.statusWord[i] = statPDO[i].snapshot.Get().Get<STAT_STATUS>();
+    }
+
+    virtual bool Cycle(const CspInputs& in, CspOutputs& out)
+    {
+        if (player)
+            player->Update();
+        else
+            gen.Update();
+
+        for (int i = 0; i < axisCt; i++)
+        {
+            double sp = player ? player->GetPosition(i) : gen.GetPosition(i);
+            int64 p = (int64)floor(sp + 0.5);
+
+            if (wrap)
+            {
+                p %= wrap;
+                if (p < 0) p += wrap;
+            }
+
+            int ctrl = 0x000f;
+            if (qstop) ctrl = 0x0003;
+            if (halt) ctrl |= 0x0100;
+
+            // report a fault once, when it appears, not every cycle
+            // it is being cleared.
+            bool fault = (in.statusWord[i] & 0x0008) != 0;
+            if (fault)
+            {
+                if (!faulted[i]) Report(CSP_FAULT, i);
+                ctrl |= 0x80;
+            }
+            faulted[i] = fault;
+
+            out.ctrl[i] = (uint16)ctrl;
+            out.pos[i] = (int32)p;
+            out.voff[i] = player ? player->GetVelocityOffset(i) : 0;
+            out.toff[i] = player ? player->GetTorqueOffset(i) : 0;
+        }
+
+        if (player)
+        {
+            if (phase == 0 && player->IsDone())
+            {
+                phase = 3;
+                Report(CSP_TRJ_DONE, 0, player->GetElapsed());
+            }
+            return true;
+        }
+
+        if (phase == 0 && gen.IsDone())
+        {
+            phase = 1;
+            delay = (int)(1000 / pdoUpdateRate);
+            Report(CSP_AT_MAX_VEL, 0, gen.GetVelocity(0));
+        }
+
+        //if( delay == 3000 )
+        //{
+        //   printf( "\nhalt\n" );
+        //   halt = 1;
+        //}
+        //if( delay == 2000 ) qstop = 0;
+
+        if (phase == 1 && !--delay)
+        {
+            phase = 2;
+            for (int i = 0; i < axisCt; i++)
+                gen.MoveVel(i, -maxvel);
+            Report(CSP_SLOWDOWN);
+        }
+
+        if (phase == 2 && gen.IsDone())
+        {
+            phase = 3;
+            Report(CSP_AT_NEG_MAX_VEL);
+        }
+
+        return true;
+    }
+
+    // Write every axis' RPDO, then send them all with one call.
+    virtual const Error* WriteOutputs(const CspOutputs& out)
+    {
+        for (int i = 0; i < axisCt; i++)
+            ctrlPDO[i].Write(out.ctrl[i], out.pos[i], out.voff[i], out.toff[i]);
+        return image->Commit();
     }
 };
 
@@ -242,7 +482,11 @@ int main(int argc, char** argv)
         showerr(err, "Setting PVT period");
     }
 
-    statPDO[1].display = 1;
+    // print axis B's status as it is received.
+    TelemetrySink<NodeStat> statSink(printNodeStat);
+    err = statSink.Start(stdout);
+    showerr(err, "Starting the status printing thread");
+    statPDO[1].telemetry.store(&statSink);
 
     printf("Setting heartbeat\n");
     err = node.StartHeartbeat(100, 0);
@@ -289,101 +533,110 @@ int main(int argc, char** argv)
 
     printf("\n\nCts/rev: %d\n\n", cpr);
 
-    double vel = 0;      // cts/s
-    double maxvel = cpr * 5;
-    double acc = maxvel;
-
-    int32_t wrap;
-    err = node.sdo.Upld32(0x2220, 0, wrap);
-    showerr(err, "Getting encoder wrap");
+    // the control PDOs of all axes are sent together each cycle.
+    RpdoProcessImage image;
+    err = image.Init(node);
+    showerr(err, "Initting the RPDO process image");
+    for (int i = 0; i < axisCt; i++)
+        image.Add(ctrlPDO[i]);
 
-    int qstop = 0;
-    int halt = 0;
+    // the trajectories start from the actual positions. The PVT
+    // trajectory goes one revolution out and back over four seconds, and
+    // the path is a square of one revolution on each side.
+    const char* play = (argc > 1) ? argv[1] : "";
+    PvtConstAccelTrj pvt;
+    Path path(axisCt);
+    CspTrajectoryPlayer player;
 
-    int i = 0;
-    int delay = 0;
-    while (1)
+    if (!strcmp(play, "pvt"))
     {
-        err = ecat.WaitCycleUpdate(100);
-        showerr(err, "Waiting on cycle thread");
-
-        for (int i = 0; i < axisCt; i++)
-        {
-            pos[i] += (int32)(vel * 0.001);
-
-            if (wrap)
-            {
-                pos[i] %= wrap;
-                if (pos[i] < 0) pos[i] += wrap;
-            }
-
-            int ctrl = 0x000f;
-            if (qstop) ctrl = 0x0003;
-            if (halt) ctrl |= 0x0100;
+        err = pvt.Init(axisCt);
+        showerr(err, "Initting the PVT trajectory");
 
-            if (statPDO[i].statusWord.Read() & 0x0008)
-            {
-                printf("\n\nClearing fault\n\n");
-                ctrl |= 0x80;
-            }
-
-            err = ctrlPDO[i].Send(ctrl, pos[i]);
-            showerr(err, "Updating ctrl PDO");
-            //         printf( "Sending position %d, vel %f\n", pos[i], vel );
-
-        }
-
-        vel += acc * 0.001;
-
-        if ((vel >= maxvel) && (acc > 0))
+        const double twoPi = 6.283185307179586;
+        uint8 pointTime = 40;
+        for (int k = 0; k <= 100; k++)
         {
-            acc = 0;
-            vel = maxvel;
-            delay = 1000;
-            printf("\nAt max velocity %f\n", vel);
+            std::vector<double> p(axisCt);
+            for (int i = 0; i < axisCt; i++)
+                p[i] = pos[i] + cpr * 0.5 * (1.0 - cos(k * twoPi / 100));
+            err = pvt.addPvtPoint(&p, &pointTime);
+            showerr(err, "Adding a PVT point");
         }
+        err = player.Init(axisCt, pdoUpdateRate * 0.001);
+        if (!err) err = player.Start(pvt);
+        showerr(err, "Starting the PVT trajectory");
+    }
+    else if (!strcmp(play, "path"))
+    {
+        err = path.SetVel(cpr * 2.0);  showerr(err, "Setting velocity");
+        err = path.SetAcc(cpr * 10.0); showerr(err, "Setting acceleration");
+        err = path.SetDec(cpr * 10.0); showerr(err, "Setting deceleration");
+        err = path.SetJrk(cpr * 100.0); showerr(err, "Setting jerk");
+
+        Point<2> p;
+        p[0] = pos[0];
+        p[1] = pos[1];
+        err = path.SetStartPos(p); showerr(err, "Setting start position");
+
+        p[0] += cpr; err = path.AddLine(p); showerr(err, "Adding line");
+        p[1] += cpr; err = path.AddLine(p); showerr(err, "Adding line");
+        p[0] -= cpr; err = path.AddLine(p); showerr(err, "Adding line");
+        p[1] -= cpr; err = path.AddLine(p); showerr(err, "Adding line");
+
+        err = player.Init(axisCt, pdoUpdateRate * 0.001);
+        if (!err) err = player.Start(path);
+        showerr(err, "Starting the path");
+    }
+    if (player.GetAxisCount())
+        player.SetFeedforward(velFeedforward, torqueFeedforward);
 
-        //if( delay == 3000 )
-        //{
-        //   printf( "\nhalt\n" );
-        //   halt = 1;
-        //}
-        //if( delay == 2000 ) qstop = 0;
+    CspTask task(statPDO, ctrlPDO, &image, player.GetAxisCount() ? &player : 0);
+    task.maxvel = cpr * 5;
 
-        if (delay)
-        {
-            if (!--delay)
-            {
-                acc = -maxvel;
-                printf("\nStarting slowdown\n");
-            }
-        }
+    err = node.sdo.Upld32(0x2220, 0, task.wrap);
+    showerr(err, "Getting encoder wrap");
 
-        if ((vel <= -maxvel) && (acc < 0))
-        {
-            vel = -maxvel;
-            acc = 0;
-            printf("\nAt negative max velocity\n");
-        }
+    // reach max velocity in one second, with the acceleration ramped up
+    // over a tenth of a second.
+    err = task.Init(pos, pdoUpdateRate * 0.001, task.maxvel, task.maxvel * 10);
+    showerr(err, "Initting the setpoint generator");
 
+    // run the control law on its own real-time thread, once per cycle.
+    EcatCyclicSettings cyclicSettings;
+    cyclicSettings.periodMs = pdoUpdateRate;
+    cyclicSettings.cpu = cyclicCpu;
 
-        /*
-              i++;
-              if( i == 2000 ) printf( "\nSending shutdown\n" );
-              if( i == 5000 ) printf( "\nClearing shutdown\n" );
+    err = task.events.Start(stdout);
+    showerr(err, "Starting the event printing thread");
 
-              if( (i >= 2000) && (i<5000) )
-                 ctrl &= ~1;
-        */
+    EcatCyclicExecutor<CspInputs, CspOutputs> executor(ecat, task);
+    err = executor.Start(cyclicSettings);
+    showerr(err, "Starting the cyclic thread");
 
+    EcatCyclicStats st = executor.GetStats();
+    if (!st.realTimePriority || !st.memoryLocked)
+        printf("WARNING: the cyclic thread is not fully real-time, expect overruns\n");
 
-        /*
-           int cap = capPDO.cstat.Read();
-           err = capSend.Send( cap );
-           showerr( err, "Updating cap PDO" );
-        */
+    printf("Press enter to stop\n");
+    getchar();
 
-    }
+    executor.Stop();
+    task.events.Stop();
+    player.Finish();
+
+    // stop the PDOs before the sink is stopped and destroyed, so the
+    // receive thread is no longer pushing to it.
+    err = node.PreOpNode();
+    showerr(err, "Stopping the PDOs");
+    statPDO[1].telemetry.store(0);
+    statSink.Stop();
+    printf("\n%llu status records printed, %llu dropped\n", (unsigned long long)statSink.GetWritten(),
+        (unsigned long long)statSink.GetDropped());
+    executor.Dump(stdout);
+
+    st = executor.GetStats();
+    showerr(st.stopError, "Running the cyclic thread");
 
     return 0;
 }
@@ -0,0 +1,494 @@
+/*
+
+EcatCyclicExecutor.h
+
+The EcatCyclicExecutor class runs a cyclic control law (CSP, CSV, CST)
+once per EtherCAT cycle on a thread of its own.
+
+Calling EtherCAT::WaitCycleUpdate() from main() runs the control law at
+whatever priority and on whatever core the main thread happens to get,
+and any page fault or heap allocation in the loop shows up as a late
+cycle. The executor instead owns a thread that is set up for the job
+before the first cycle:
+
+- it runs at a real-time priority (SCHED_FIFO on Linux,
+  THREAD_PRIORITY_TIME_CRITICAL on Windows),
+- it may be pinned to one CPU, ideally one kept free of other work,
+- the process memory is locked (mlockall) so it is never paged out,
+- the thread's stack is touched once so it does not fault in later,
+- the inputs and outputs of the control law are members of the
+  executor, so nothing is allocated once it runs.
+
+The control law is an EcatCyclicTask. Every cycle the executor wakes
+on WaitCycleUpdate() and calls, in order:
+
+	ReadInputs(in)       copy the latest TPDO data into in
+	Cycle(in, out)       the control law; return false to stop
+	WriteOutputs(out)    write out to the RPDOs and transmit them
+
+A cycle overruns when the time from waking up to WriteOutputs()
+returning is longer than the cycle period, and a cycle is missed when
+the executor wakes up more than one and a half periods after the last
+wake up. Both are counted in GetStats(). The cyclic thread keeps its
+counts to itself and publishes a copy at the end of every cycle through
+a TpdoSnapshot (TpdoSnapshot.h), so GetStats() never holds it up.
+
+Every cycle is also timed into four histograms (TelemetryHistogram.h),
+in microseconds:
+
+- cycle period, the time between successive wake ups,
+- wake latency, how late the wake up was. The expected wake up times
+  are locked to the earliest wake ups seen and may creep by up to
+  100 ppm a cycle to follow the drift between the host clock and the
+  network clock,
+- compute time, ReadInputs() and Cycle(),
+- transmit time, WriteOutputs().
+
+The worst wake latency and the worst finish time (wake latency plus
+the time to write the outputs) are kept with the cycle they happened
+in. A finish time close to the period means the period is too short
+for the host. The histograms are always on; recording a cycle costs a
+few tens of nanoseconds. They can be copied while the executor runs
+with GetHistogram() and are printed by Dump(). Neither takes a lock the
+cyclic thread uses: they ask for a copy, and the cyclic thread makes it
+at the end of its next cycle into buffers allocated up front, so the
+formatting and allocation happen on the caller's thread.
+
+If the real-time setup fails (the program does not have the privilege
+to raise its priority or lock its memory) the executor still runs, and
+GetStats() shows what was not done. Set requireRealTime to fail Start()
+instead. Raising the PDO update rate (EtherCatSettings::cyclePeriod) is
+the fallback for a host that keeps overrunning even so.
+
+Usage:
+
+	class MyTask : public EcatCyclicTask<MyInputs, MyOutputs> { ... };
+
+	MyTask task;
+	EcatCyclicExecutor<MyInputs, MyOutputs> executor(ecat, task);
+
+	EcatCyclicSettings settings;
+	settings.periodMs = 3.0;
+	settings.cpu = 3;
+	err = executor.Start(settings);
+	...
+	executor.Stop();
+	executor.Dump(stdout);
+
+*/
+
+#ifndef ECAT_CYCLIC_EXECUTOR_H
+#define ECAT_CYCLIC_EXECUTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include "CML.h"
+#include "TelemetryHistogram.h"
+#include "TpdoSnapshot.h"
+
+#if defined( WIN32 )
+#  include <windows.h>
+#else
+#  include <pthread.h>
+#  include <sched.h>
+#  include <sys/mman.h>
+#endif
+
+CML_NAMESPACE_START()
+
+// Bytes of stack the cyclic thread touches before its first cycle.
+#define ECAT_CYCLIC_PREFAULT_BYTES (64 * 1024)
+
+class EcatCyclicError : public Error
+{
+public:
+	static const EcatCyclicError AlreadyRunning;
+	static const EcatCyclicError BadPeriod;
+	static const EcatCyclicError RealTimeUnavailable;
+
+protected:
+	EcatCyclicError(uint16 id, const char* desc) : Error(id, desc) {}
+};
+
+inline const EcatCyclicError EcatCyclicError::AlreadyRunning(0x9200, "The cyclic executor is already running");
+inline const EcatCyclicError EcatCyclicError::BadPeriod(0x9201, "The cycle period must be greater than zero");
+inline const EcatCyclicError EcatCyclicError::RealTimeUnavailable(0x9202, "Unable to set up the cyclic thread for real-time use");
+
+// How the cyclic thread is set up.
+struct EcatCyclicSettings
+{
+	double periodMs;          // the EtherCAT cycle (PDO update) period
+	int priority;             // SCHED_FIFO priority, 1 to 99
+	int cpu;                  // CPU to pin the thread to, or -1 for any
+	bool lockMemory;          // lock the process memory with mlockall()
+	bool requireRealTime;     // fail Start() if the set up is incomplete
+	int32 waitTimeout;        // timeout (ms) of each WaitCycleUpdate()
+
+	EcatCyclicSettings() : periodMs(1.0), priority(80), cpu(-1), lockMemory(true),
+		requireRealTime(false), waitTimeout(100) {}
+};
+
+// The cycle timings kept by an EcatCyclicExecutor.
+enum EcatCycleTiming
+{
+	ECAT_CYCLE_PERIOD,
+	ECAT_CYCLE_WAKE_LATENCY,
+	ECAT_CYCLE_COMPUTE,
+	ECAT_CYCLE_TRANSMIT,
+	ECAT_CYCLE_TIMINGS
+};
+
+// What the cyclic executor has seen so far.
+struct EcatCyclicStats
+{
+	uint64 cycles;            // cycles run
+	uint64 overruns;          // cycles that took longer than the period
+	uint64 missedCycles;      // cycles slept through
+	double lastBusyMs;        // wake up to outputs written, last cycle
+	double worstBusyMs;       // wake up to outputs written, worst cycle
+	double worstWakeUs;       // latest wake up
+	uint64 worstWakeCycle;    // the cycle it happened in
+	double worstFinishUs;     // expected wake up to outputs written, worst cycle
+	uint64 worstFinishCycle;  // the cycle it happened in
+	bool realTimePriority;    // the real-time priority was set
+	bool cpuPinned;           // the thread was pinned to the CPU asked for
+	bool memoryLocked;        // the process memory was locked
+	bool running;
+	const Error* stopError;   // the error that stopped the executor, if any
+};
+
+// The control law run by an EcatCyclicExecutor.
+template <class Inputs, class Outputs>
+class EcatCyclicTask
+{
+public:
+	virtual ~EcatCyclicTask() {}
+
+	// Copy the latest TPDO data into in.
+	virtual void ReadInputs(Inputs& in) = 0;
+
+	// Work out this cycle's outputs. Return false to stop the executor.
+	virtual bool Cycle(const Inputs& in, Outputs& out) = 0;
+
+	// Write out to the RPDOs and transmit them.
+	virtual const Error* WriteOutputs(const Outputs& out) = 0;
+};
+
+template <class Inputs, class Outputs>
+class EcatCyclicExecutor
+{
+public:
+
+	EcatCyclicExecutor(EtherCAT& network, EcatCyclicTask<Inputs, Outputs>& cyclicTask) :
+		ecat(network), task(cyclicTask), stopRequest(false), running(false), setupDone(false)
+	{
+		hist[ECAT_CYCLE_PERIOD].SetLogBuckets(1.0, 131072.0);
+		hist[ECAT_CYCLE_WAKE_LATENCY].SetLogBuckets(1.0, 131072.0);
+		hist[ECAT_CYCLE_COMPUTE].SetLogBuckets(0.125, 131072.0);
+		hist[ECAT_CYCLE_TRANSMIT].SetLogBuckets(0.125, 131072.0);
+		ClearStats();
+	}
+
+	virtual ~EcatCyclicExecutor() { Stop(); }
+
+	/**
+	 * Start the cyclic thread. Returns once the thread is set up and about
+	 * to wait for its first cycle.
+	 *
+	 * @param cyclicSettings How to set up the thread.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Start(const EcatCyclicSettings& cyclicSettings)
+	{
+		if (running.load()) return &EcatCyclicError::AlreadyRunning;
+		if (!(cyclicSettings.periodMs > 0.0)) return &EcatCyclicError::BadPeriod;
+
+		// the thread of a previous run that stopped on its own.
+		if (thread.joinable()) thread.join();
+
+		settings = cyclicSettings;
+		ClearStats();
+
+#if !defined( WIN32 )
+		if (settings.lockMemory)
+			stats.memoryLocked = (mlockall(MCL_CURRENT | MCL_FUTURE) == 0);
+#endif
+
+		stopRequest.store(false);
+		setupDone = false;
+		running.store(true);
+		thread = std::thread(&EcatCyclicExecutor::Run, this);
+
+		std::unique_lock<std::mutex> lock(setupMutex);
+		setupCond.wait(lock, [this] { return setupDone; });
+		lock.unlock();
+
+		EcatCyclicStats st = published.Get();
+		bool complete = st.realTimePriority && (settings.cpu < 0 || st.cpuPinned) &&
+			(!settings.lockMemory || st.memoryLocked);
+
+		if (settings.requireRealTime && !complete) {
+			Stop();
+#if !defined( WIN32 )
+			// do not leave the process locked for a thread that is not running.
+			if (st.memoryLocked) munlockall();
+#endif
+			return &EcatCyclicError::RealTimeUnavailable;
+		}
+		return 0;
+	}
+
+	// Ask the thread to stop after its current cycle and wait for it.
+	void Stop(void)
+	{
+		stopRequest.store(true);
+		if (thread.joinable()) thread.join();
+	}
+
+	// True until the thread stops, either by Stop(), a false return from
+	// Cycle() or an error.
+	bool IsRunning(void) const { return running.load(); }
+
+	// Read what the executor has seen so far. Safe to call while it runs,
+	// and never makes the cyclic thread wait.
+	EcatCyclicStats GetStats(void)
+	{
+		EcatCyclicStats st = published.Get();
+		st.running = running.load();
+		return st;
+	}
+
+	// Copy one of the timing histograms. Safe to call while it runs; it
+	// waits for the end of the next cycle.
+	TelemetryHistogram GetHistogram(EcatCycleTiming timing)
+	{
+		std::lock_guard<std::mutex> lock(copyMutex);
+		return CopyHistograms()[timing];
+	}
+
+	// Print the summary and the timing histograms.
+	void Dump(FILE* fp)
+	{
+		EcatCyclicStats st = GetStats();
+		fprintf(fp, "Cyclic executor: %llu cycles, %llu overruns, %llu missed, busy %.3f ms last, %.3f ms worst (period %.3f ms)\n",
+			(unsigned long long)st.cycles, (unsigned long long)st.overruns, (unsigned long long)st.missedCycles,
+			st.lastBusyMs, st.worstBusyMs, settings.periodMs);
+		fprintf(fp, "  real-time priority %s, CPU pinned %s, memory locked %s\n", st.realTimePriority ? "yes" : "no",
+			(settings.cpu < 0) ? "n/a" : (st.cpuPinned ? "yes" : "no"), st.memoryLocked ? "yes" : "no");
+		fprintf(fp, "  worst wake latency %.1f us (cycle %llu), worst finish %.1f us (cycle %llu)\n",
+			st.worstWakeUs, (unsigned long long)st.worstWakeCycle, st.worstFinishUs, (unsigned long long)st.worstFinishCycle);
+		if (st.stopError)
+			fprintf(fp, "  stopped by error: %s\n", st.stopError->toString());
+
+		TelemetryHistogram h[ECAT_CYCLE_TIMINGS];
+		{
+			std::lock_guard<std::mutex> lock(copyMutex);
+			const TelemetryHistogram* copy = CopyHistograms();
+			for (int i = 0; i < ECAT_CYCLE_TIMINGS; i++)
+				h[i] = copy[i];
+		}
+		h[ECAT_CYCLE_PERIOD].Print(fp, "Cycle period", "us");
+		h[ECAT_CYCLE_WAKE_LATENCY].Print(fp, "Wake latency", "us");
+		h[ECAT_CYCLE_COMPUTE].Print(fp, "Compute time", "us");
+		h[ECAT_CYCLE_TRANSMIT].Print(fp, "Transmit time", "us");
+	}
+
+protected:
+
+	typedef std::chrono::steady_clock Clock;
+
+	void ClearStats(void)
+	{
+		EcatCyclicStats empty = { 0, 0, 0, 0.0, 0.0, 0.0, 0, 0.0, 0, false, false, false, false, 0 };
+		stats = empty;
+		published.Publish(stats);
+		for (int i = 0; i < ECAT_CYCLE_TIMINGS; i++) {
+			hist[i].Clear();
+			histCopy[i] = hist[i];
+		}
+		copyRequest.store(false);
+	}
+
+	/**
+	 * Get a copy of the histograms from the cyclic thread. If it is not
+	 * running they are read directly. Call with copyMutex held; the copy
+	 * is good until it is released.
+	 */
+	const TelemetryHistogram* CopyHistograms(void)
+	{
+		copyRequest.store(true, std::memory_order_release);
+		while (copyRequest.load(std::memory_order_acquire)) {
+			if (!running.load(std::memory_order_acquire)) {
+				copyRequest.store(false);
+				return hist;
+			}
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+		return histCopy;
+	}
+
+	// Copy the histograms for a reader that asked for them. Called on the
+	// cyclic thread. The buckets match, so nothing is allocated.
+	void ServeCopy(void)
+	{
+		if (!copyRequest.load(std::memory_order_acquire)) return;
+		for (int i = 0; i < ECAT_CYCLE_TIMINGS; i++)
+			histCopy[i] = hist[i];
+		copyRequest.store(false, std::memory_order_release);
+	}
+
+	static double Micros(Clock::duration d) { return std::chrono::duration<double, std::micro>(d).count(); }
+
+	// Touch the stack the cycles will use so it is already mapped.
+	static void PrefaultStack(void)
+	{
+		volatile uint8 stack[ECAT_CYCLIC_PREFAULT_BYTES];
+		for (int i = 0; i < ECAT_CYCLIC_PREFAULT_BYTES; i += 1024)
+			stack[i] = 0;
+		(void)stack[0];
+	}
+
+	// Set up this thread for real-time use. Called on the cyclic thread.
+	void SetUpThread(bool& priorityOk, bool& pinned)
+	{
+#if defined( WIN32 )
+		priorityOk = SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+		pinned = (settings.cpu >= 0) && SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << settings.cpu) != 0;
+#else
+		sched_param param;
+		param.sched_priority = settings.priority;
+		priorityOk = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+
+		pinned = false;
+		if (settings.cpu >= 0) {
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			CPU_SET(settings.cpu, &cpus);
+			pinned = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+		}
+#endif
+	}
+
+	void Run(void)
+	{
+		bool priorityOk = false, pinned = false;
+		SetUpThread(priorityOk, pinned);
+		PrefaultStack();
+
+		stats.realTimePriority = priorityOk;
+		stats.cpuPinned = pinned;
+		published.Publish(stats);
+		{
+			std::lock_guard<std::mutex> lock(setupMutex);
+			setupDone = true;
+		}
+		setupCond.notify_all();
+
+		const double periodMs = settings.periodMs;
+		const double periodUs = periodMs * 1000.0;
+		const double creepUs = periodUs * 1e-4;
+		const Error* err = 0;
+		bool first = true;
+		Clock::time_point start, lastWake;
+		double expectedUs = 0.0;     // expected wake up, from start
+
+		while (!stopRequest.load()) {
+			err = ecat.WaitCycleUpdate(settings.waitTimeout);
+			if (err) break;
+
+			Clock::time_point wake = Clock::now();
+
+			task.ReadInputs(inputs);
+			bool keepGoing = task.Cycle(inputs, outputs);
+			Clock::time_point computed = Clock::now();
+
+			err = task.WriteOutputs(outputs);
+			Clock::time_point written = Clock::now();
+
+			if (first) start = lastWake = wake;
+			double wakeUs = Micros(wake - start);
+			double intervalUs = first ? periodUs : Micros(wake - lastWake);
+			double computeUs = Micros(computed - wake);
+			double transmitUs = Micros(written - computed);
+			double busyMs = (computeUs + transmitUs) * 0.001;
+			lastWake = wake;
+
+			// the wake latency, against a schedule locked to the earliest
+			// wake ups that may creep a little each cycle.
+			if (!first) expectedUs += periodUs * floor(intervalUs / periodUs + 0.5);
+			double latencyUs = wakeUs - expectedUs;
+			if (latencyUs < 0.0) {
+				expectedUs = wakeUs;
+				latencyUs = 0.0;
+			}
+			else expectedUs += (latencyUs < creepUs) ? latencyUs : creepUs;
+			first = false;
+
+			stats.cycles++;
+			stats.lastBusyMs = busyMs;
+			if (busyMs > stats.worstBusyMs) stats.worstBusyMs = busyMs;
+			if (busyMs > periodMs) stats.overruns++;
+			if (intervalUs > 1.5 * periodUs) stats.missedCycles += (uint64)(intervalUs / periodUs + 0.5) - 1;
+
+			if (latencyUs > stats.worstWakeUs) {
+				stats.worstWakeUs = latencyUs;
+				stats.worstWakeCycle = stats.cycles;
+			}
+			double finishUs = latencyUs + computeUs + transmitUs;
+			if (finishUs > stats.worstFinishUs) {
+				stats.worstFinishUs = finishUs;
+				stats.worstFinishCycle = stats.cycles;
+			}
+			published.Publish(stats);
+
+			hist[ECAT_CYCLE_PERIOD].Record(intervalUs);
+			hist[ECAT_CYCLE_WAKE_LATENCY].Record(latencyUs);
+			hist[ECAT_CYCLE_COMPUTE].Record(computeUs);
+			hist[ECAT_CYCLE_TRANSMIT].Record(transmitUs);
+			ServeCopy();
+
+			if (err || !keepGoing) break;
+		}
+
+		stats.stopError = err;
+		published.Publish(stats);
+		running.store(false);
+	}
+
+	EtherCAT& ecat;
+	EcatCyclicTask<Inputs, Outputs>& task;
+	EcatCyclicSettings settings;
+
+	// used only by the cyclic thread once it runs
+	Inputs inputs;
+	Outputs outputs;
+
+	std::thread thread;
+	std::atomic<bool> stopRequest;
+	std::atomic<bool> running;
+
+	std::mutex setupMutex;
+	std::condition_variable setupCond;
+	bool setupDone;
+
+	// the counts, kept by the cyclic thread and published every cycle.
+	EcatCyclicStats stats;
+	TpdoSnapshot<EcatCyclicStats> published;
+
+	// the histograms, recorded by the cyclic thread, and the copy it
+	// makes when a reader sets copyRequest. Readers hold copyMutex, which
+	// the cyclic thread never takes.
+	TelemetryHistogram hist[ECAT_CYCLE_TIMINGS];
+	TelemetryHistogram histCopy[ECAT_CYCLE_TIMINGS];
+	std::atomic<bool> copyRequest;
+	std::mutex copyMutex;
+};
+
+CML_NAMESPACE_END()
+
+#endif
@@ -23,6 +23,7 @@ value of 11.
 #include <iostream>
 
 #include "CML.h"
+#include "PinnedNetwork.h"
 
 //#define USE_CAN
 #if defined( USE_CAN )
@@ -73,7 +74,7 @@ public:
 // to update the programmed velocity of the amp.
 class RpdoEcatProgrammedVelocityDualAxis : public RPDO
 {
-    uint32 networkReference;
+    PinnedNetwork network;
     Pmap32 programmedVelocityAxisA;
     Pmap32 programmedVelocityAxisB;
 
@@ -204,6 +205,10 @@ int main(void)
 
     tpdo.displayTpdoInfo = false;
 
+    // the RxPDO is global and outlives the network, so give its
+    // network back before the network is destroyed.
+    PinnedNetwork::ReleaseAll(net);
+
     printf("Finished. Press any key to quit.\n");
     return 0;
 }
@@ -271,10 +276,11 @@ void TpdoEcatActVelActPosDualAxis::Received(void)
 
 const Error* RpdoEcatProgrammedVelocityDualAxis::Init(Amp& amp, uint16 slotNumber)
 {
-    networkReference = amp.GetNetworkRef();
+    // look the network up once, so Transmit() does not have to.
+    const Error* err = network.Pin(amp);
 
     // Init the base class
-    const Error* err = RPDO::Init(0x200 + slotNumber * 0x100 + amp.GetNodeID()); //0x200+slot*0x100+amp.GetNodeID() );
+    if (!err) err = RPDO::Init(0x200 + slotNumber * 0x100 + amp.GetNodeID()); //0x200+slot*0x100+amp.GetNodeID() );
 
     // Init the mapping objects that describe the data mapped to this PDO
     if (!err) err = programmedVelocityAxisA.Init(OBJID_PROG_VEL);
@@ -302,14 +308,8 @@ const Error* RpdoEcatProgrammedVelocityDualAxis::Transmit(int32 programmedVeloci
     programmedVelocityAxisA.Write(programmedVelocityValueAxisA);
     programmedVelocityAxisB.Write(programmedVelocityValueAxisB);
 
-    // acquire a reference to the network.
-    RefObjLocker<Network> net(networkReference);
-
-    // check that the network is available.
-    if (!net) return &NodeError::NetworkUnavailable;
-
-    // tranmit the RxPDO on the network.
-    return RPDO::Transmit(*net);
+    // tranmit the RxPDO on the network looked up in Init().
+    return network.Transmit(*this);
 }
 
 // show any errors to the user.
@@ -60,6 +60,8 @@ RPDO's.
 #include <cstdlib>
 
 #include "CML.h"
+#include "PinnedNetwork.h"
+#include "TelemetrySink.h"
 
 #if defined( USE_CAN )
 #include "can/can_copley.h"
@@ -82,6 +84,20 @@ static void showerr( const Error *err, const char *str );
 int32 canBPS = 1000000;             // CAN network bit rate
 int16 canNodeID = -1;                // CANopen node ID
 
+// The data of one NonFixedTpdoEventStatusAndOutputsXe2, as printed.
+struct EventStatusRecord
+{
+    uint32 eventStatusA;
+    uint32 eventStatusB;
+    uint16 outputs;
+};
+
+// Print one record, on the telemetry thread.
+static void printEventStatus(FILE* fp, const EventStatusRecord& r)
+{
+    fprintf(fp, "evntStatA: 0x%04x evntStatB: 0x%04x DOUT: 0x%04x \n", r.eventStatusA, r.eventStatusB, r.outputs);
+}
+
 // Define a class based on the TPDO base class.
 // A Transmit PDO is one that's transmitted by the
 // CANopen node and received by the master.
@@ -93,8 +109,8 @@ class NonFixedTpdoEventStatusAndOutputsXe2 : public TPDO
 
 public:
 
-    // Default constructor does nothing
-    NonFixedTpdoEventStatusAndOutputsXe2() {}
+    // Default constructor, the records are printed by printEventStatus()
+    NonFixedTpdoEventStatusAndOutputsXe2() : telemetry(printEventStatus) {}
 
     // Called once at startup to map the PDO and configure CML to 
     // listen for it.
@@ -105,6 +121,10 @@ public:
 
     bool display{ false };
 
+    // While display is set, the data received is pushed here and
+    // printed on the sink's own thread.
+    TelemetrySink<EventStatusRecord> telemetry;
+
 private:
 
     // These variables are used to map objects to the PDO.
@@ -165,16 +185,21 @@ const Error * NonFixedTpdoEventStatusAndOutputsXe2::Init( Amp &ampObj, int slotN
  */
 void NonFixedTpdoEventStatusAndOutputsXe2::Received( void )
 {
+   // This runs on the receive thread, so don't print or sleep here;
+   // the telemetry sink prints the record on its own thread.
    if (display) {
-       printf("evntStatA: 0x%04x evntStatB: 0x%04x DOUT: 0x%04x \n", eventStatusAxisA.Read(), eventStatusAxisB.Read(), digitalOutputs.Read());
-       CML::Thread::sleep(1000);
+       EventStatusRecord r;
+       r.eventStatusA = eventStatusAxisA.Read();
+       r.eventStatusB = eventStatusAxisB.Read();
+       r.outputs = digitalOutputs.Read();
+       telemetry.Push(r);
    }
 }
 
 // This represents the non-fixed receive PDO to map the profile position.
 class NonFixedRpdoProfilePosition : public RPDO
 {
-    uint32 netRef;
+    PinnedNetwork network;
 
 public:
     Pmap32 profilePosA;
@@ -185,8 +210,8 @@ public:
     virtual ~NonFixedRpdoProfilePosition() { KillRef(); }
     const Error* Init(Node& node, uint16 slot = 1)
     {
-        netRef = node.GetNetworkRef();
-        const Error* err = 0;
+        // look the network up once, so Send() does not have to.
+        const Error* err = network.Pin(node);
 
         // Let the various mapped variables know which 
         // objects in the amp's object dictionary they
@@ -209,10 +234,7 @@ public:
         profilePosA.Write(commandedPositionA);
         profilePosA.Write(commandedPositionB);
 
-        RefObjLocker<Network> net(netRef);
-        if (!net) return &NodeError::NetworkUnavailable;
-
-        return Transmit(*net);
+        return network.Transmit(*this);
     }
 };
 
@@ -275,6 +297,11 @@ int main( void )
    err = nonFixedTpdo.Init(ampArray[0], 2); // use slot 2 or 3. (slots 0 and 1 are being used by CML, so they are unavailable)
    showerr(err, "Initting non-fixed tpdo");
 
+   // print the TxPDO data once a second.
+   nonFixedTpdo.telemetry.SetMinPeriod(1000);
+   err = nonFixedTpdo.telemetry.Start(stdout);
+   showerr(err, "Starting the telemetry thread");
+
    nonFixedTpdo.display = true;
 
    err = nonFixedRxPDO.Init(ampArray[0], 1); // use slot 1, 2, or 3. (slot 0 is being used by CML, so it is unavailable)
@@ -294,6 +321,9 @@ int main( void )
 
    getchar();
 
+   nonFixedTpdo.display = false;
+   nonFixedTpdo.telemetry.Stop();
+
    return 0;
 }
 
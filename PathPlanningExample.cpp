@@ -8,8 +8,10 @@ class.
 
 The example will create a path, then extract and display all of
 the commanded positions and velocities for both axes. The 
-position data will be saved to a CSV file. The path will then be 
-sent to the drive for execution.
+position data will be saved to a CSV file. The path is then copied
+into a PvtSoaTrj object and checked against the move limits with the
+PvtValidator class (PvtValidator.h) before it is sent to the drive for
+execution.
 
 */
 
@@ -22,6 +24,7 @@ sent to the drive for execution.
 #include <iostream>
 #include <string>
 #include "CML.h"
+#include "PvtValidator.h"
 #include <math.h>
 
 using std::ofstream;
@@ -172,6 +175,24 @@ int main(void)
 
 	excelFile.close();
 
+	// Check the whole path before anything moves. The PVT segments the
+	// linkage sends are copied into a PvtSoaTrj, which is what is sent.
+	// The jerk of a PVT cubic is not comparable to the S-curve jerk limit
+	// (see PvtRetimer.h), so it is not checked, and the cubics between the
+	// path's points are allowed to overshoot the other limits by 10%.
+	PvtSoaTrj checkedPath;
+	err = PvtValidator::Capture(path, checkedPath);
+	showerr(err, "copying the path");
+
+	PvtValidator validator;
+	err = validator.SetMoveLimits(maxVel, maxAcc, maxDec, 0);
+	showerr(err, "setting the validator limits");
+	validator.SetAllowance(0.10);
+
+	err = validator.Validate(checkedPath);
+	if (err) validator.Print(stdout);
+	showerr(err, "validating the path");
+
 	// first, move to the starting position of the path.
 	err = link.MoveTo(startingPos);
 	showerr(err, "moving to starting position");
@@ -179,7 +200,7 @@ int main(void)
 	err = link.WaitMoveDone(-1);
 	showerr(err, "waiting for move to starting position to finish");
 
-	err = link.SendTrajectory(path, true);
+	err = link.SendTrajectory(checkedPath, true);
 	showerr(err, "beginning linkage move");
 
 	err = link.WaitMoveDone(-1);
@@ -0,0 +1,229 @@
+/*
+
+PdoLayout.h
+
+The PdoLayout class template declares the layout of a PDO when the
+program is compiled: the object index, sub-index and type of every
+mapped variable, in order.
+
+The PDO classes in the examples each declare one Pmap object per
+mapped variable, Init() and AddVar() every one of them by hand, and
+read or write the Pmap object every time the control law uses a value.
+With a PdoLayout the fields are listed once, as PdoEntry types:
+
+- PdoLayout<...>::Data is a packed struct of the PDO's bytes. Get<I>()
+  and Set<I>() read and write field I at an offset worked out by the
+  compiler, so each access is a single load or store. Data is
+  trivially copyable and can be held in a TpdoSnapshot
+  (TpdoSnapshot.h) or a cyclic task's inputs and outputs.
+- PdoLayoutMap<Layout> holds the Pmap objects that CML needs for the
+  mapping, of the width of each field, and adds them to a PDO in the
+  declared order with Init(), ready for Node::PdoSet(). Unpack() copies
+  all of the received fields into a Data, and Pack() copies a Data into
+  the fields to be transmitted, with one Pmap access per field per
+  cycle, however often the control law uses them.
+
+Per-axis objects of a multi-axis drive are at an offset of 0x800 per
+axis (0x6040 for axis A, 0x6840 for axis B). Entries are per-axis by
+default, and have the offset added for the axis passed to Init();
+entries declared with PerAxis false are drive-wide objects and are
+mapped as given.
+
+Usage:
+
+	enum { STAT_STATUS, STAT_POS };
+	typedef PdoLayout<
+		PdoEntry<0x6041, 0, uint16>,
+		PdoEntry<0x6064, 0, int32> > StatusLayout;
+
+	class MyTpdo : public TPDO
+	{
+	public:
+		PdoLayoutMap<StatusLayout> map;
+
+		const Error* Init(Node& node, uint16 slot, int axis)
+		{
+			const Error* err = map.Init(*this, axis);
+			if (!err) err = node.PdoSet(slot, *this);
+			return err;
+		}
+
+		virtual void Received(void)
+		{
+			StatusLayout::Data d;
+			map.Unpack(d);
+			int32 pos = d.Get<STAT_POS>();
+			...
+		}
+	};
+
+*/
+
+#ifndef PDO_LAYOUT_H
+#define PDO_LAYOUT_H
+
+#include <cstddef>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "CML.h"
+
+CML_NAMESPACE_START()
+
+// The object index offset between the axes of a multi-axis drive.
+#define PDO_AXIS_OFFSET 0x800
+
+/**
+ * One mapped variable of a PDO.
+ *
+ * @tparam Index   The object index, for axis A if it is per-axis.
+ * @tparam Sub     The object sub-index.
+ * @tparam T       The type of the object: an 8, 16 or 32 bit integer.
+ * @tparam PerAxis True if the object has a copy per axis.
+ */
+template <uint16 Index, uint8 Sub, class T, bool PerAxis = true>
+struct PdoEntry
+{
+	static_assert(std::is_integral<T>::value && (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4),
+		"PDO entries must be 8, 16 or 32 bit integers");
+
+	typedef T Type;
+	static constexpr uint16 index = Index;
+	static constexpr uint8 sub = Sub;
+	static constexpr uint8 bits = sizeof(T) * 8;
+	static constexpr bool perAxis = PerAxis;
+
+	// The object index mapped for an axis.
+	static constexpr uint16 IndexFor(int axis) { return PerAxis ? (uint16)(Index + PDO_AXIS_OFFSET * axis) : Index; }
+};
+
+// The CML Pmap class used to map a field of each width.
+template <size_t BYTES> struct PdoPmap;
+template <> struct PdoPmap<1> { typedef Pmap8 Type; typedef uint8 Raw; };
+template <> struct PdoPmap<2> { typedef Pmap16 Type; typedef uint16 Raw; };
+template <> struct PdoPmap<4> { typedef Pmap32 Type; typedef uint32 Raw; };
+
+template <class... Entries>
+class PdoLayout
+{
+	static_assert(sizeof...(Entries) > 0, "A PDO layout needs at least one entry");
+
+public:
+
+	// The number of fields.
+	static constexpr int COUNT = sizeof...(Entries);
+
+	// The number of bytes of data in the PDO.
+	static constexpr size_t SIZE = (sizeof(typename Entries::Type) + ...);
+
+	template <int I> using Entry = typename std::tuple_element<I, std::tuple<Entries...> >::type;
+	template <int I> using Type = typename Entry<I>::Type;
+
+	// The byte offset of field I in the PDO data.
+	template <int I>
+	static constexpr size_t Offset(void)
+	{
+		constexpr size_t sizes[] = { sizeof(typename Entries::Type)... };
+		size_t off = 0;
+		for (int i = 0; i < I; i++)
+			off += sizes[i];
+		return off;
+	}
+
+	// The PDO data, packed the way it is mapped.
+	struct Data
+	{
+		uint8 bytes[SIZE];
+
+		template <int I>
+		Type<I> Get(void) const
+		{
+			Type<I> v;
+			memcpy(&v, bytes + Offset<I>(), sizeof(v));
+			return v;
+		}
+
+		template <int I>
+		void Set(Type<I> v) { memcpy(bytes + Offset<I>(), &v, sizeof(v)); }
+	};
+};
+
+// The Pmap objects that map a PdoLayout into a PDO.
+template <class Layout> class PdoLayoutMap;
+
+template <class... Entries>
+class PdoLayoutMap<PdoLayout<Entries...> >
+{
+public:
+
+	typedef PdoLayout<Entries...> Layout;
+	typedef typename Layout::Data Data;
+
+	/**
+	 * Set up the Pmap objects for an axis and add them to the PDO, in
+	 * the order of the layout.
+	 *
+	 * @param pdo  The PDO being mapped.
+	 * @param axis The axis of the drive, 0 for axis A.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Init(PDO& pdo, int axis = 0) { return InitAll(pdo, axis, Indices()); }
+
+	// Copy the received fields into d.
+	void Unpack(Data& d) { UnpackAll(d, Indices()); }
+
+	// Copy d into the fields to be transmitted.
+	void Pack(const Data& d) { PackAll(d, Indices()); }
+
+protected:
+
+	typedef std::make_index_sequence<sizeof...(Entries)> Indices;
+
+	template <size_t... I>
+	const Error* InitAll(PDO& pdo, int axis, std::index_sequence<I...>)
+	{
+		const Error* err = 0;
+		((err = err ? err : std::get<I>(maps).Init(Entries::IndexFor(axis), Entries::sub)), ...);
+		((err = err ? err : pdo.AddVar(std::get<I>(maps))), ...);
+		return err;
+	}
+
+	template <size_t... I>
+	void UnpackAll(Data& d, std::index_sequence<I...>)
+	{
+		(UnpackOne<I>(d), ...);
+	}
+
+	template <size_t... I>
+	void PackAll(const Data& d, std::index_sequence<I...>)
+	{
+		(PackOne<I>(d), ...);
+	}
+
+	template <size_t I>
+	void UnpackOne(Data& d)
+	{
+		typedef typename Layout::template Type<I> T;
+		typename PdoPmap<sizeof(T)>::Raw raw = std::get<I>(maps).Read();
+		T v;
+		memcpy(&v, &raw, sizeof(v));
+		d.template Set<I>(v);
+	}
+
+	template <size_t I>
+	void PackOne(const Data& d)
+	{
+		typedef typename Layout::template Type<I> T;
+		T v = d.template Get<I>();
+		typename PdoPmap<sizeof(T)>::Raw raw;
+		memcpy(&raw, &v, sizeof(raw));
+		std::get<I>(maps).Write(raw);
+	}
+
+	std::tuple<typename PdoPmap<sizeof(typename Entries::Type)>::Type...> maps;
+};
+
+CML_NAMESPACE_END()
+
+#endif
@@ -0,0 +1,188 @@
+/*
+
+PinnedNetwork.h
+
+The PinnedNetwork class looks a PDO's network up once, when the PDO
+is set up, so transmitting goes straight to the network object.
+
+A PDO normally keeps the network's reference id and locks it with a
+RefObjLocker<Network> on every transmit, which takes CML's reference
+table lock and finds the object each time. A PinnedNetwork does that
+lookup in Pin() and keeps the network pointer until Release().
+
+Pin() keeps the reference lock for as long as the network is pinned,
+so the network object cannot be freed while a PDO still points to it:
+CML does not destroy a locked object until it is unlocked. The lock is
+given back by Release(), which the destructor calls, so a PDO that
+holds a PinnedNetwork releases its network when it goes away.
+
+A PDO that outlives its network (a global PDO on a network declared in
+main(), for example) must release the network before it is closed or
+destroyed, or the network's destructor waits on the lock. Every
+PinnedNetwork on a network can be released at once with
+PinnedNetwork::ReleaseAll(), once nothing is transmitting any more:
+
+	PinnedNetwork::ReleaseAll(net);
+	return 0;
+
+Usage:
+
+	class MyRpdo : public RPDO
+	{
+		PinnedNetwork network;
+		...
+		const Error* Init(Node& node, uint16 slot)
+		{
+			const Error* err = network.Pin(node);
+			...
+		}
+
+		const Error* Send(int32 value)
+		{
+			data.Write(value);
+			return network.Transmit(*this);
+		}
+	};
+
+*/
+
+#ifndef PINNED_NETWORK_H
+#define PINNED_NETWORK_H
+
+#include <mutex>
+#include "CML.h"
+
+CML_NAMESPACE_START()
+
+class PinnedNetwork
+{
+public:
+
+	PinnedNetwork() : lock(0), net(0), prev(0), next(0) {}
+
+	virtual ~PinnedNetwork() { Release(); }
+
+	PinnedNetwork(const PinnedNetwork&) = delete;
+	PinnedNetwork& operator=(const PinnedNetwork&) = delete;
+
+	/**
+	 * Look up the network the node is on, lock it and keep a pointer to it.
+	 *
+	 * @param node Any node on the network.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Pin(Node& node) { return Pin(node.GetNetworkRef()); }
+
+	/**
+	 * Look up the network reference passed, lock it and keep a pointer
+	 * to it. Any network already pinned is released first.
+	 *
+	 * @param ref The network's reference id.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Pin(uint32 ref)
+	{
+		Release();
+
+		RefObjLocker<Network>* locked = new RefObjLocker<Network>(ref);
+		if (!*locked) {
+			delete locked;
+			return &NodeError::NetworkUnavailable;
+		}
+
+		lock = locked;
+		net = *locked;
+
+		std::lock_guard<std::mutex> guard(pinnedMutex);
+		Link();
+		return 0;
+	}
+
+	// Unlock the pinned network and forget it.
+	void Release(void)
+	{
+		std::lock_guard<std::mutex> guard(pinnedMutex);
+		Unpin();
+	}
+
+	/**
+	 * Release every PinnedNetwork pinned to a network, so the network can
+	 * be closed and destroyed. Nothing may be transmitting on them.
+	 *
+	 * @param network The network about to be closed.
+	 */
+	static void ReleaseAll(Network& network)
+	{
+		std::lock_guard<std::mutex> guard(pinnedMutex);
+		PinnedNetwork* p = pinnedList;
+		while (p) {
+			PinnedNetwork* after = p->next;
+			if (p->net == &network) p->Unpin();
+			p = after;
+		}
+	}
+
+	/**
+	 * Confirm that a network is pinned. The pinned network is locked, so
+	 * it still exists as long as this returns NULL.
+	 *
+	 * @return NULL if a network is pinned, or an error object.
+	 */
+	const Error* Check(void) const
+	{
+		return net ? 0 : &NodeError::NetworkUnavailable;
+	}
+
+	bool IsPinned(void) const { return net != 0; }
+
+	// The pinned network, or NULL if none is pinned.
+	Network* Get(void) const { return net; }
+
+	// Transmit an RPDO on the pinned network.
+	const Error* Transmit(RPDO& pdo)
+	{
+		if (!net) return &NodeError::NetworkUnavailable;
+		return pdo.Transmit(*net);
+	}
+
+protected:
+
+	// Add this object to the list of pinned objects. Called with
+	// pinnedMutex held.
+	void Link(void)
+	{
+		prev = 0;
+		next = pinnedList;
+		if (next) next->prev = this;
+		pinnedList = this;
+	}
+
+	// Remove this object from the list, unlock its network and forget
+	// it. Called with pinnedMutex held.
+	void Unpin(void)
+	{
+		if (!lock) return;
+
+		if (prev) prev->next = next;
+		else pinnedList = next;
+		if (next) next->prev = prev;
+		prev = next = 0;
+
+		net = 0;
+		delete lock;
+		lock = 0;
+	}
+
+	RefObjLocker<Network>* lock;    // held while pinned
+	Network* net;
+
+	// every PinnedNetwork that is pinned, for ReleaseAll().
+	PinnedNetwork* prev;
+	PinnedNetwork* next;
+	static inline PinnedNetwork* pinnedList = 0;
+	static inline std::mutex pinnedMutex;
+};
+
+CML_NAMESPACE_END()
+
+#endif
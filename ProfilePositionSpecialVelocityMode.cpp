@@ -34,6 +34,7 @@ same CAN message ID for this PDO.
 #include <iostream>
 
 #include "CML.h"
+#include "PinnedNetwork.h"
 
 #define USE_CAN
 #if defined( USE_CAN )
@@ -82,7 +83,7 @@ public:
 // to update the profile velocity of the amp.
 class RpdoProfileVelocity : public RPDO
 {
-    uint32 networkReference; // used to transmit the RxPDO on the network
+    PinnedNetwork network; // used to transmit the RxPDO on the network
     Pmap32 profileVelocity;  // used to update the Profile Velocity parameter
     Pmap32 unusedRegister;   // used as filler data to be ignored in the PDO
 
@@ -101,7 +102,7 @@ public:
 // to update the control word of all axes on the network.
 class RpdoControlWord : public RPDO
 {
-    uint32 networkReference;
+    PinnedNetwork network;
     Pmap16 controlWord;
     Pmap32 unusedRegister;
 
@@ -269,6 +270,10 @@ int main(void)
         tpdoArray[j].displayTpdoInfo = false;
     }
 
+    // the RxPDOs are global and outlive the network, so give their
+    // network back before the network is destroyed.
+    PinnedNetwork::ReleaseAll(net);
+
     printf("Finished. Press any key to quit.\n");
     return 0;
 }
@@ -342,11 +347,12 @@ void TpdoActVelActPos::Received(void)
 /// <returns>an error code indicating an error or success</returns>
 const Error* RpdoProfileVelocity::Init(Amp& amp, int canId, int slotNumber, bool isFirstDriveInPair)
 {
-    networkReference = amp.GetNetworkRef();
+    // look the network up once, so Transmit() does not have to.
+    const Error* err = network.Pin(amp);
 
     // Init the base class
     uint32 canMessageId = 0x200 + slotNumber * 0x100 + canId;
-    const Error* err = RPDO::Init(canMessageId);
+    if (!err) err = RPDO::Init(canMessageId);
             
     // Init the mapping objects that describe the data mapped to this PDO
     if (!err) err = profileVelocity.Init(OBJID_PROFILE_VEL);
@@ -385,14 +391,8 @@ const Error* RpdoProfileVelocity::Transmit(int32 profileVelIn1, int32 profileVel
     profileVelocity.Write(profileVelIn1);
     unusedRegister.Write(profileVelIn2);
 
-    // acquire a reference to the network.
-    RefObjLocker<Network> net(networkReference);
-
-    // check that the network is available.
-    if (!net) return &NodeError::NetworkUnavailable;
-
-    // tranmit the RxPDO on the network.
-    return RPDO::Transmit(*net);
+    // tranmit the RxPDO on the network looked up in Init().
+    return network.Transmit(*this);
 }
 
 /// <summary>
@@ -403,11 +403,12 @@ const Error* RpdoProfileVelocity::Transmit(int32 profileVelIn1, int32 profileVel
 /// <returns>an error code indicating an error or success</returns>
 const Error* RpdoControlWord::Init(Amp* amp, int slotNumber)
 {
-    networkReference = amp[0].GetNetworkRef();
+    // look the network up once, so Transmit() does not have to.
+    const Error* err = network.Pin(amp[0]);
 
     // Init the base class
     uint32 canMessageId = 0x200 + slotNumber * 0x100 + amp[0].GetNodeID();
-    const Error* err = RPDO::Init(canMessageId);
+    if (!err) err = RPDO::Init(canMessageId);
 
     // Init the mapping objects that describe the data mapped to this PDO
     if (!err) err = controlWord.Init(OBJID_CONTROL);
@@ -432,14 +433,8 @@ const Error* RpdoControlWord::Transmit(int16 controlWordIn)
 {
     controlWord.Write(controlWordIn);
 
-    // acquire a reference to the network.
-    RefObjLocker<Network> net(networkReference);
-
-    // check that the network is available.
-    if (!net) return &NodeError::NetworkUnavailable;
-
-    // tranmit the RxPDO on the network.
-    return RPDO::Transmit(*net);
+    // tranmit the RxPDO on the network looked up in Init().
+    return network.Transmit(*this);
 }
 
 // show any errors to the user.
@@ -16,6 +16,7 @@ console in real-time.
 #include <iostream>
 
 #include "CML.h"
+#include "PinnedNetwork.h"
 
 #define USE_CAN
 #if defined( USE_CAN )
@@ -64,7 +65,7 @@ public:
 // to update the programmed velocity of the amp.
 class RpdoProgrammedVelocity : public RPDO
 {
-    uint32 networkReference;
+    PinnedNetwork network;
     Pmap32 programmedVelocity;
 
 public:
@@ -189,6 +190,10 @@ int main(void)
         tpdo[j].displayTpdoInfo = false;
     }
 
+    // the RxPDOs are global and outlive the network, so give their
+    // network back before the network is destroyed.
+    PinnedNetwork::ReleaseAll(net);
+
     printf("Finished. Press any key to quit.\n");
     getchar();
     return 0;
@@ -254,10 +259,11 @@ void TpdoActVelActPos::Received(void)
 
 const Error* RpdoProgrammedVelocity::Init(Amp& amp, uint16 slotNumber)
 {
-    networkReference = amp.GetNetworkRef();
+    // look the network up once, so Transmit() does not have to.
+    const Error* err = network.Pin(amp);
 
     // Init the base class
-    const Error* err = RPDO::Init(0x200 + slotNumber * 0x100 + amp.GetNodeID()); //0x200+slot*0x100+amp.GetNodeID() );
+    if (!err) err = RPDO::Init(0x200 + slotNumber * 0x100 + amp.GetNodeID()); //0x200+slot*0x100+amp.GetNodeID() );
 
     // Init the mapping objects that describe the data mapped to this PDO
     if (!err) err = programmedVelocity.Init(OBJID_PROG_VEL);
@@ -282,14 +288,8 @@ const Error* RpdoProgrammedVelocity::Transmit(int32 programmedVelocityValue)
     // update the programmed velocity with the user value.
     programmedVelocity.Write(programmedVelocityValue);
 
-    // acquire a reference to the network.
-    RefObjLocker<Network> net(networkReference);
-
-    // check that the network is available.
-    if (!net) return &NodeError::NetworkUnavailable;
-
-    // tranmit the RxPDO on the network.
-    return RPDO::Transmit(*net);
+    // tranmit the RxPDO on the network looked up in Init().
+    return network.Transmit(*this);
 }
 
 // show any errors to the user.
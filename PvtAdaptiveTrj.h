@@ -0,0 +1,226 @@
+/*
+
+PvtAdaptiveTrj.h
+
+The PvtAdaptiveTrj class adjusts how far ahead of the drive a PVT move
+is kept, based on how the refills are measured to behave while the
+move runs.
+
+CML refills the drive's PVT buffer whenever the drive reports it has
+room, and keeps at most MaximumBufferPointsToUse() points queued in the
+drive. A fixed number that is safe for CAN at 1 Mbps with several axes
+or for EtherCAT on a busy non-RT host wastes latency on a quiet system,
+and a number tuned for a quiet system underflows on a busy one.
+
+PvtAdaptiveTrj is a PvtTelemetryTrj (see PvtTelemetryTrj.h), so it
+measures every refill batch. From those measurements it keeps:
+
+- the refill interval, as a running mean and mean deviation (the
+  round trip from the drive asking for points to the host sending
+  them, plus the host's scheduling jitter),
+- the drive consumption rate, the mean segment time of the points
+  sent so far.
+
+At the start of every refill it sets the number of points the linkage
+may keep queued in the drive to
+
+	ceil((target margin + worst expected interval) / mean segment time)
+
+where the worst expected interval is the mean plus four deviations and
+the target margin is SetTargetMargin() (20 ms by default) or twice the
+worst expected interval, whichever is larger. A correction term is
+added on top: it grows by one point whenever a refill arrives with
+less than the target margin left, and shrinks by one after 16 refills
+in a row with more than twice the target. The result is kept between
+the limits set with SetPointLimits() and the limit of the wrapped
+trajectory.
+
+What was learned is kept from one move to the next, so a program that
+runs the same move repeatedly starts each move with the limit found in
+the previous one. GetAdaptiveStats() shows the current decision and
+the values it was based on.
+
+Usage:
+
+	PvtAdaptiveTrj adaptive(stream);
+	adaptive.SetTargetMargin(30.0);
+	err = link.SendTrajectory(adaptive);
+	...
+	PvtAdaptiveStats st = adaptive.GetAdaptiveStats();
+
+*/
+
+#ifndef PVT_ADAPTIVE_TRJ_H
+#define PVT_ADAPTIVE_TRJ_H
+
+#include <cmath>
+#include <cstdio>
+#include "CML.h"
+#include "PvtTelemetryTrj.h"
+
+CML_NAMESPACE_START()
+
+// The current decision of a PvtAdaptiveTrj and the values it is based on.
+struct PvtAdaptiveStats
+{
+	int pointLimit;           // points the linkage may keep in the drive
+	int correction;           // points added by the margin feedback
+	int minPointLimit;        // smallest limit used so far
+	int maxPointLimit;        // largest limit used so far
+	uint32 adjustments;       // number of times the limit changed
+	double targetMarginMs;    // margin being aimed for
+	double intervalMeanMs;    // running mean of the refill interval
+	double intervalDevMs;     // running mean deviation of the refill interval
+	double segmentMs;         // mean time of the segments sent
+	double lastMarginMs;      // margin at the last refill
+};
+
+class PvtAdaptiveTrj : public PvtTelemetryTrj
+{
+public:
+
+	/**
+	 * @param wrapped    The trajectory to pass the calls on to.
+	 * @param startLimit The number of points to keep in the drive until
+	 *                   the first refills have been measured.
+	 */
+	PvtAdaptiveTrj(LinkTrajectory& wrapped, int startLimit = 32) : PvtTelemetryTrj(wrapped),
+		minPoints(4), maxPoints(256), targetMarginMs(20.0), startPoints(startLimit)
+	{
+		ResetLearning();
+	}
+
+	virtual ~PvtAdaptiveTrj() {}
+
+	// The margin (ms) of queued motion to aim for at every refill.
+	void SetTargetMargin(double ms) { targetMarginMs = (ms > 0.0) ? ms : 1.0; }
+
+	// The smallest and largest number of points to keep in the drive.
+	void SetPointLimits(int minimum, int maximum)
+	{
+		std::lock_guard<std::mutex> lock(telemetryMutex);
+		minPoints = (minimum > 1) ? minimum : 1;
+		maxPoints = (maximum > minPoints) ? maximum : minPoints;
+		pointLimit = Clamp(pointLimit);
+	}
+
+	// Forget what was learned and go back to the starting limit.
+	void ResetLearning(void)
+	{
+		std::lock_guard<std::mutex> lock(telemetryMutex);
+		pointLimit = Clamp(startPoints);
+		correction = 0;
+		quietRefills = 0;
+		intervalMean = 0.0;
+		intervalDev = 0.0;
+		intervalSamples = 0;
+
+		PvtAdaptiveStats empty = { pointLimit, 0, pointLimit, pointLimit, 0, targetMarginMs, 0.0, 0.0, 0.0, 0.0 };
+		adaptiveStats = empty;
+	}
+
+	// Read the current decision. Safe to call while the move is running.
+	PvtAdaptiveStats GetAdaptiveStats(void)
+	{
+		std::lock_guard<std::mutex> lock(telemetryMutex);
+		return adaptiveStats;
+	}
+
+	// Print the refill telemetry followed by the adaptive decision.
+	void Dump(FILE* fp)
+	{
+		PvtTelemetryTrj::Dump(fp);
+
+		PvtAdaptiveStats st = GetAdaptiveStats();
+		fprintf(fp, "Adaptive refill: %d points in the drive (%d to %d used, %u changes), correction %+d\n",
+			st.pointLimit, st.minPointLimit, st.maxPointLimit, st.adjustments, st.correction);
+		fprintf(fp, "  target margin %.1f ms, refill interval %.1f +/- %.1f ms, segment %.1f ms\n",
+			st.targetMarginMs, st.intervalMeanMs, st.intervalDevMs, st.segmentMs);
+	}
+
+	// The linkage keeps no more than this many points queued in the drive.
+	virtual int MaximumBufferPointsToUse(void)
+	{
+		int wrappedLimit = trj.MaximumBufferPointsToUse();
+		std::lock_guard<std::mutex> lock(telemetryMutex);
+		return (pointLimit < wrappedLimit) ? pointLimit : wrappedLimit;
+	}
+
+protected:
+
+	int Clamp(int points) const
+	{
+		if (points < minPoints) return minPoints;
+		if (points > maxPoints) return maxPoints;
+		return points;
+	}
+
+	// Update the estimates and the point limit. The mutex is held.
+	virtual void OnRefill(const PvtRefillSample& sample)
+	{
+		// running mean and mean deviation of the refill interval, with a
+		// faster start so the first few refills count.
+		double weight = (intervalSamples < 8) ? 1.0 / (intervalSamples + 1) : 0.125;
+		double dev = fabs(sample.intervalMs - intervalMean);
+		intervalMean += weight * (sample.intervalMs - intervalMean);
+		intervalDev += weight * (dev - intervalDev);
+		intervalSamples++;
+
+		double segmentMs = stats.points ? queuedMs / stats.points : 0.0;
+		if (segmentMs <= 0.0) return;
+
+		double worstInterval = intervalMean + 4.0 * intervalDev;
+		double target = targetMarginMs;
+		if (2.0 * worstInterval > target) target = 2.0 * worstInterval;
+
+		// margin feedback
+		if (sample.marginMs < target) {
+			correction++;
+			quietRefills = 0;
+		}
+		else if (sample.marginMs > 2.0 * target && ++quietRefills >= 16) {
+			if (correction > -maxPoints) correction--;
+			quietRefills = 0;
+		}
+
+		int feedForward = (int)ceil((target + worstInterval) / segmentMs);
+		int limit = Clamp(feedForward + correction);
+
+		// keep the correction from winding up past the limits.
+		if (feedForward + correction > maxPoints) correction = maxPoints - feedForward;
+		if (feedForward + correction < minPoints) correction = minPoints - feedForward;
+
+		if (limit != pointLimit) {
+			pointLimit = limit;
+			adaptiveStats.adjustments++;
+		}
+
+		adaptiveStats.pointLimit = pointLimit;
+		adaptiveStats.correction = correction;
+		if (pointLimit < adaptiveStats.minPointLimit) adaptiveStats.minPointLimit = pointLimit;
+		if (pointLimit > adaptiveStats.maxPointLimit) adaptiveStats.maxPointLimit = pointLimit;
+		adaptiveStats.targetMarginMs = target;
+		adaptiveStats.intervalMeanMs = intervalMean;
+		adaptiveStats.intervalDevMs = intervalDev;
+		adaptiveStats.segmentMs = segmentMs;
+		adaptiveStats.lastMarginMs = sample.marginMs;
+	}
+
+	int minPoints;
+	int maxPoints;
+	double targetMarginMs;
+	int startPoints;
+
+	int pointLimit;
+	int correction;
+	int quietRefills;
+	double intervalMean;
+	double intervalDev;
+	uint32 intervalSamples;
+
+	PvtAdaptiveStats adaptiveStats;
+};
+
+CML_NAMESPACE_END()
+
+#endif
@@ -0,0 +1,227 @@
+/*
+
+PvtBatchSolver.h
+
+Vectorized solver for the continuous-acceleration PVT velocities used
+by PvtSoaTrj (PvtSoaTrj.h).
+
+The velocity of each point depends on the velocity of its neighbours,
+so solving a single axis is a chain of dependent multiply/adds along
+the trajectory. The axes are independent of each other and share the
+same factored matrix (it only depends on the segment times), so this
+solver runs several axes side by side in the lanes of a SIMD register:
+
+- AVX2 (x86-64, compiled with -mavx2 or /arch:AVX2): 4 axes per pass.
+- SSE2 (any other x86-64 build, and x86 with -msse2): 2 axes per pass.
+- NEON (AArch64): 2 axes per pass.
+- Anything else: a portable version that works on 4 axes per pass in
+  plain C++, which still hides most of the dependency chain latency.
+
+The forward sweep gathers one point of each axis in the block into a
+register and keeps its intermediate results in an interleaved scratch
+buffer, so the backward sweep only uses contiguous vector loads. The
+backward sweep writes the finished velocities straight into the
+per-axis buffers.
+
+*/
+
+#ifndef PVT_BATCH_SOLVER_H
+#define PVT_BATCH_SOLVER_H
+
+#include <cstddef>
+#include <vector>
+#include "CML.h"
+
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#elif defined( __SSE2__ )
+#include <emmintrin.h>
+#elif defined( __ARM_NEON ) && defined( __aarch64__ )
+#include <arm_neon.h>
+#endif
+
+CML_NAMESPACE_START()
+
+// The lane type and helpers of the batch solver, shared with the
+// pre-flight validator (PvtValidator.h).
+namespace PvtBatchDetail
+{
+
+// One register holding the same value for LANES axes.
+#if defined( __AVX2__ )
+
+enum { LANES = 4 };
+typedef __m256d PvtLanes;
+static inline PvtLanes LanesLoad(const double* p) { return _mm256_loadu_pd(p); }
+static inline void LanesStore(double* p, PvtLanes v) { _mm256_storeu_pd(p, v); }
+static inline PvtLanes LanesSet(double s) { return _mm256_set1_pd(s); }
+static inline PvtLanes LanesAdd(PvtLanes a, PvtLanes b) { return _mm256_add_pd(a, b); }
+static inline PvtLanes LanesSub(PvtLanes a, PvtLanes b) { return _mm256_sub_pd(a, b); }
+static inline PvtLanes LanesMul(PvtLanes a, PvtLanes b) { return _mm256_mul_pd(a, b); }
+static inline PvtLanes LanesGather(const double* const p[], size_t i) { return _mm256_set_pd(p[3][i], p[2][i], p[1][i], p[0][i]); }
+static inline PvtLanes LanesMin(PvtLanes a, PvtLanes b) { return _mm256_min_pd(a, b); }
+static inline PvtLanes LanesMax(PvtLanes a, PvtLanes b) { return _mm256_max_pd(a, b); }
+
+#elif defined( __SSE2__ )
+
+enum { LANES = 2 };
+typedef __m128d PvtLanes;
+static inline PvtLanes LanesLoad(const double* p) { return _mm_loadu_pd(p); }
+static inline void LanesStore(double* p, PvtLanes v) { _mm_storeu_pd(p, v); }
+static inline PvtLanes LanesSet(double s) { return _mm_set1_pd(s); }
+static inline PvtLanes LanesAdd(PvtLanes a, PvtLanes b) { return _mm_add_pd(a, b); }
+static inline PvtLanes LanesSub(PvtLanes a, PvtLanes b) { return _mm_sub_pd(a, b); }
+static inline PvtLanes LanesMul(PvtLanes a, PvtLanes b) { return _mm_mul_pd(a, b); }
+static inline PvtLanes LanesGather(const double* const p[], size_t i) { return _mm_set_pd(p[1][i], p[0][i]); }
+static inline PvtLanes LanesMin(PvtLanes a, PvtLanes b) { return _mm_min_pd(a, b); }
+static inline PvtLanes LanesMax(PvtLanes a, PvtLanes b) { return _mm_max_pd(a, b); }
+
+#elif defined( __ARM_NEON ) && defined( __aarch64__ )
+
+enum { LANES = 2 };
+typedef float64x2_t PvtLanes;
+static inline PvtLanes LanesLoad(const double* p) { return vld1q_f64(p); }
+static inline void LanesStore(double* p, PvtLanes v) { vst1q_f64(p, v); }
+static inline PvtLanes LanesSet(double s) { return vdupq_n_f64(s); }
+static inline PvtLanes LanesAdd(PvtLanes a, PvtLanes b) { return vaddq_f64(a, b); }
+static inline PvtLanes LanesSub(PvtLanes a, PvtLanes b) { return vsubq_f64(a, b); }
+static inline PvtLanes LanesMul(PvtLanes a, PvtLanes b) { return vmulq_f64(a, b); }
+static inline PvtLanes LanesGather(const double* const p[], size_t i) { return vsetq_lane_f64(p[1][i], vdupq_n_f64(p[0][i]), 1); }
+static inline PvtLanes LanesMin(PvtLanes a, PvtLanes b) { return vminq_f64(a, b); }
+static inline PvtLanes LanesMax(PvtLanes a, PvtLanes b) { return vmaxq_f64(a, b); }
+
+#else
+
+enum { LANES = 4 };
+struct PvtLanes { double v[LANES]; };
+static inline PvtLanes LanesLoad(const double* p) { PvtLanes r; for (int l = 0; l < LANES; l++) r.v[l] = p[l]; return r; }
+static inline void LanesStore(double* p, PvtLanes a) { for (int l = 0; l < LANES; l++) p[l] = a.v[l]; }
+static inline PvtLanes LanesSet(double s) { PvtLanes r; for (int l = 0; l < LANES; l++) r.v[l] = s; return r; }
+static inline PvtLanes LanesAdd(PvtLanes a, PvtLanes b) { for (int l = 0; l < LANES; l++) a.v[l] += b.v[l]; return a; }
+static inline PvtLanes LanesSub(PvtLanes a, PvtLanes b) { for (int l = 0; l < LANES; l++) a.v[l] -= b.v[l]; return a; }
+static inline PvtLanes LanesMul(PvtLanes a, PvtLanes b) { for (int l = 0; l < LANES; l++) a.v[l] *= b.v[l]; return a; }
+static inline PvtLanes LanesGather(const double* const p[], size_t i) { PvtLanes r; for (int l = 0; l < LANES; l++) r.v[l] = p[l][i]; return r; }
+static inline PvtLanes LanesMin(PvtLanes a, PvtLanes b) { for (int l = 0; l < LANES; l++) a.v[l] = (b.v[l] < a.v[l]) ? b.v[l] : a.v[l]; return a; }
+static inline PvtLanes LanesMax(PvtLanes a, PvtLanes b) { for (int l = 0; l < LANES; l++) a.v[l] = (b.v[l] > a.v[l]) ? b.v[l] : a.v[l]; return a; }
+
+#endif
+
+}
+
+class PvtBatchSolver
+{
+public:
+
+	// The number of axes solved per pass.
+	enum { LANES = PvtBatchDetail::LANES };
+
+	// The name of the instruction set this solver was compiled for.
+	static const char* GetInstructionSet(void)
+	{
+#if defined( __AVX2__ )
+		return "AVX2";
+#elif defined( __SSE2__ )
+		return "SSE2";
+#elif defined( __ARM_NEON ) && defined( __aarch64__ )
+		return "NEON";
+#else
+		return "portable";
+#endif
+	}
+
+	/**
+	 * Solve the velocities of all axes.
+	 *
+	 * The factors are the Thomas algorithm coefficients built from the
+	 * segment times (see PvtSoaTrj::BuildFactors()), indexed by point.
+	 *
+	 * @param pos      Per-axis position buffers, n points each.
+	 * @param vel      Per-axis velocity buffers to fill, n points each.
+	 * @param axisCt   The number of axes.
+	 * @param n        The number of points.
+	 * @param invH     1 / segment time (1/s) of each point.
+	 * @param lower    Sub-diagonal of each row.
+	 * @param upper    Eliminated super-diagonal of each row.
+	 * @param invPivot 1 / pivot of each row.
+	 */
+	void Solve(const double* const pos[], double* const vel[], int axisCt, size_t n,
+		const double* invH, const double* lower, const double* upper, const double* invPivot)
+	{
+		const int W = LANES;
+
+		laneVel.resize(n * W);
+
+		for (int first = 0; first < axisCt; first += W) {
+
+			// the last block may be partly used. Unused lanes repeat the
+			// last axis and are not written back.
+			const double* p[LANES];
+			double* v[LANES];
+			int used = (axisCt - first < W) ? axisCt - first : W;
+			for (int l = 0; l < W; l++) {
+				p[l] = pos[first + ((l < used) ? l : used - 1)];
+				v[l] = vel[first + ((l < used) ? l : used - 1)];
+			}
+
+			SolveBlock(p, v, used, n, invH, lower, upper, invPivot);
+		}
+	}
+
+protected:
+
+	// Write one point of each used lane into the per-axis velocity buffers.
+	static void Scatter(double* const v[], int used, size_t i, PvtBatchDetail::PvtLanes x)
+	{
+		using namespace PvtBatchDetail;
+		double tmp[LANES];
+		LanesStore(tmp, x);
+		for (int l = 0; l < used; l++)
+			v[l][i] = tmp[l];
+	}
+
+	// Forward and backward sweep for one block of axes.
+	void SolveBlock(const double* const p[], double* const v[], int used, size_t n,
+		const double* invH, const double* lower, const double* upper, const double* invPivot)
+	{
+		using namespace PvtBatchDetail;
+		const int W = LANES;
+		double* lv = laneVel.data();
+
+		PvtLanes zero = LanesSet(0.0);
+		Scatter(v, used, 0, zero);
+		Scatter(v, used, n - 1, zero);
+		if (n < 3) return;
+
+		// forward sweep, lv holds the modified right hand side.
+		PvtLanes three = LanesSet(3.0);
+		PvtLanes prevP = LanesGather(p, 0);
+		PvtLanes curP = LanesGather(p, 1);
+		PvtLanes prev = zero;
+
+		for (size_t i = 1; i + 1 < n; i++) {
+			PvtLanes nextP = LanesGather(p, i + 1);
+			PvtLanes d0 = LanesMul(LanesSub(curP, prevP), LanesSet(invH[i - 1] * invH[i - 1]));
+			PvtLanes d1 = LanesMul(LanesSub(nextP, curP), LanesSet(invH[i] * invH[i]));
+			PvtLanes rhs = LanesMul(three, LanesAdd(d0, d1));
+			prev = LanesMul(LanesSub(rhs, LanesMul(LanesSet(lower[i]), prev)), LanesSet(invPivot[i]));
+			LanesStore(lv + i * W, prev);
+			prevP = curP;
+			curP = nextP;
+		}
+
+		// back substitution.
+		PvtLanes next = LanesLoad(lv + (n - 2) * W);
+		Scatter(v, used, n - 2, next);
+		for (size_t i = n - 2; i > 1; i--) {
+			PvtLanes cur = LanesSub(LanesLoad(lv + (i - 1) * W), LanesMul(LanesSet(upper[i - 1]), next));
+			Scatter(v, used, i - 1, cur);
+			next = cur;
+		}
+	}
+
+	std::vector<double> laneVel;   // interleaved scratch, LANES values per point
+};
+
+CML_NAMESPACE_END()
+
+#endif
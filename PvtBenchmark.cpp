@@ -0,0 +1,618 @@
+/*
+
+PvtBenchmark.cpp
+
+The following program measures how quickly PVT trajectories can be
+built on the host. It does not need a drive or a network, only the CML
+library, so it can be run on the target machine before commissioning
+to see how much host CPU a PVT stream of a given size will cost.
+
+Benchmarks:
+
+1. Point ingest rate. The same trajectory is loaded into CML's
+   PvtConstAccelTrj class one point at a time with addPvtPoint(), and
+   into the PvtSoaTrj class (PvtSoaTrj.h) with a single call to
+   addPvtPoints(). The velocities are then calculated for both. The
+   result is reported in points per second.
+
+2. Velocity solver. The continuous-acceleration velocities of an 
+   already loaded trajectory are calculated at 2, 7 and 32 axes with 
+   PvtConstAccelTrj (axis by axis over linked lists), with PvtSoaTrj's 
+   axis by axis solver and with the SIMD batch solver 
+   (PvtBatchSolver.h). PvtConstAccelTrj is timed from StartNew(), which 
+   is where the linkage asks the trajectory to prepare itself. Compile 
+   with -O2 -mavx2 (or /O2 /arch:AVX2) to use the AVX2 version of the 
+   batch solver on x86-64; otherwise it uses the SSE2 version.
+
+3. Trajectory loading. A 1,000,000 point, three axis trajectory is
+   written to a CSV file (the layout used by PvtFromCsvFile.cpp) and
+   to a binary trajectory file (PvtTrjFile.h). The time to get from 
+   the file name to the first PVT segment is measured for both: 
+   getline/stringstream/stod parsing into PvtConstAccelTrj, and 
+   mapping the binary file with PvtMappedTrj. The files are written to
+   the current directory and removed afterwards.
+
+4. CSV parsing throughput. A CSV file of about 300 MB (seven axis
+   columns and a time column) is parsed with getline/stringstream/stod
+   and with the PvtCsvParser class (PvtCsvParser.h). The time from the
+   file name to the points being in memory is reported in MB per
+   second.
+
+5. Retiming. The points of PvtFromCsvFile/XyzPoints.csv (10 ms apart)
+   and of StartPvtPositions.h (50 ms apart) are retimed with the 
+   PvtRetimer class (PvtRetimer.h) using the move limits of their 
+   examples. The move time with the fixed spacing and with the 
+   retimed spacing is reported, along with the number of fixed 
+   segments that already break the limits. Dwells keep their fixed 
+   time, so the speedup comes only from the moves. It is run with and 
+   without the jerk limit. Run the program from the repository 
+   directory so XyzPoints.csv can be found.
+
+6. Pre-flight validation. A 1,000,000 point, three axis trajectory is
+   checked against the move limits and position limits segment by
+   segment (PvtRetimer::CountViolations()) and with the PvtValidator
+   class (PvtValidator.h), which sweeps the per-axis buffers several
+   segments at a time. The time of one check is reported in
+   milliseconds.
+
+7. Fixed axis counts. The same points are added one at a time and
+   solved with PvtConstAccelTrj, PvtSoaTrj and PvtConstAccelTrjN<N>
+   (PvtConstAccelTrjN.h), for the 1, 2, 3 and 7 axis linkages used
+   by the examples and the MoveIt bridge. The result is reported in
+   points per second.
+
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "CML.h"
+#include "PvtSoaTrj.h"
+#include "PvtCsvParser.h"
+#include "PvtTrjFile.h"
+#include "PvtRetimer.h"
+#include "PvtValidator.h"
+#include "PvtConstAccelTrjN.h"
+#include "StartPvtPositions.h"
+
+using std::ifstream;
+using std::string;
+using std::stringstream;
+using std::vector;
+
+// If a namespace has been defined in CML_Settings.h, this
+// macros starts using it.
+CML_NAMESPACE_USE();
+
+/* local functions */
+static void showerr(const Error* err, const char* str);
+static void benchmarkIngest(int axisNum, size_t pointNum);
+static void benchmarkSolver(int axisNum, size_t pointNum);
+static void benchmarkLoading(size_t pointNum);
+static void benchmarkCsvParse(size_t pointNum);
+static void benchmarkRetime(const char* name, const double* pointPositions, size_t pointNum, int axisNum,
+	uint8 fixedTime, double vel, double acc, double dec, double jrk);
+static void benchmarkValidate(int axisNum, size_t pointNum);
+template <int N> static void benchmarkFixed(size_t pointNum);
+
+// Used to time each benchmark.
+typedef std::chrono::steady_clock BenchClock;
+
+static double secondsSince(BenchClock::time_point start)
+{
+	return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+// Fill the passed buffer with a smooth test trajectory. The positions
+// are stored point by point, axisNum values per point.
+static void makeTestPoints(vector<double>& pointPositions, int axisNum, size_t pointNum)
+{
+	pointPositions.resize(pointNum * axisNum);
+	for (size_t i = 0; i < pointNum; i++) {
+		for (int a = 0; a < axisNum; a++) {
+			pointPositions[i * axisNum + a] = 10000.0 * sin(0.001 * i + a);
+		}
+	}
+}
+
+int main(void)
+{
+	printf("PVT point ingest (points per second)\n");
+	printf("%6s %10s %18s %18s %8s\n", "axes", "points", "PvtConstAccelTrj", "PvtSoaTrj", "speedup");
+
+	size_t pointCounts[] = { 10000, 100000 };
+	int axisCounts[] = { 1, 2, 3, 7 };
+
+	for (size_t pointNum : pointCounts) {
+		for (int axisNum : axisCounts) {
+			benchmarkIngest(axisNum, pointNum);
+		}
+	}
+
+	printf("\nVelocity solver, %s batch solver (microseconds per solve)\n", PvtBatchSolver::GetInstructionSet());
+	printf("%6s %10s %18s %18s %18s\n", "axes", "points", "PvtConstAccelTrj", "axis by axis", "batch");
+
+	int solverAxisCounts[] = { 2, 7, 32 };
+	for (int axisNum : solverAxisCounts) {
+		benchmarkSolver(axisNum, 100000);
+	}
+
+	printf("\nTrajectory loading, file name to first PVT segment (milliseconds)\n");
+	benchmarkLoading(1000000);
+
+	printf("\nCSV parsing (MB per second)\n");
+	benchmarkCsvParse(3000000);
+
+	printf("\nRetiming under the linkage move limits (move time in milliseconds)\n");
+	printf("%-16s %8s %8s %10s %10s %8s %10s %12s\n", "path", "points", "jerk", "fixed", "retimed",
+		"speedup", "fixed over", "retime (ms)");
+
+	PvtCsvParser csvParser;
+	PvtSoaTrj csvTrj;
+	const Error* err = csvParser.ParseFile("PvtFromCsvFile/XyzPoints.csv", csvTrj, 10);
+	if (err) err = csvParser.ParseFile("XyzPoints.csv", csvTrj, 10);
+	if (err) {
+		printf("XyzPoints.csv not found, skipped\n");
+	}
+	else {
+		size_t pointNum = csvParser.GetTimes().size();
+		benchmarkRetime("XyzPoints.csv", csvParser.GetPoints().data(), pointNum, 3, 10, 160000, 960000, 960000, 200000);
+		benchmarkRetime("XyzPoints.csv", csvParser.GetPoints().data(), pointNum, 3, 10, 160000, 960000, 960000, 0);
+	}
+
+	// StartPvtUsingDigitalInput.cpp mirrors axis A on axis B.
+	size_t arrNum = sizeof(positionsArr) / sizeof(positionsArr[0]);
+	vector<double> arrPoints(arrNum * 2);
+	for (size_t i = 0; i < arrNum; i++) {
+		arrPoints[i * 2] = positionsArr[i];
+		arrPoints[i * 2 + 1] = positionsArr[i];
+	}
+	benchmarkRetime("positionsArr", arrPoints.data(), arrNum, 2, 50, 2000000, 960000, 960000, 200000);
+	benchmarkRetime("positionsArr", arrPoints.data(), arrNum, 2, 50, 2000000, 960000, 960000, 0);
+
+	printf("\nPre-flight validation, %s lanes (milliseconds per check)\n", PvtBatchSolver::GetInstructionSet());
+	benchmarkValidate(3, 1000000);
+
+	printf("\nFixed axis count, one point per call (points per second)\n");
+	printf("%6s %10s %18s %18s %18s %8s\n", "axes", "points", "PvtConstAccelTrj", "PvtSoaTrj",
+		"PvtConstAccelTrjN", "speedup");
+	benchmarkFixed<1>(100000);
+	benchmarkFixed<2>(100000);
+	benchmarkFixed<3>(100000);
+	benchmarkFixed<7>(100000);
+
+	return 0;
+}
+
+/**
+ * Time loading and solving the same trajectory with PvtConstAccelTrj
+ * (list based, one point per call) and PvtSoaTrj (contiguous buffers,
+ * one call for all points).
+ */
+static void benchmarkIngest(int axisNum, size_t pointNum)
+{
+	const Error* err = 0;
+	uint8 timeBetweenPoints = 10;
+
+	vector<double> pointPositions;
+	makeTestPoints(pointPositions, axisNum, pointNum);
+
+	// List based path, the way the examples load points today.
+	PvtConstAccelTrj listTrj;
+	err = listTrj.Init(axisNum);
+	showerr(err, "initializing the PvtConstAccelTrj object");
+
+	BenchClock::time_point start = BenchClock::now();
+
+	vector<double> tempVec(axisNum);
+	for (size_t i = 0; i < pointNum; i++) {
+		for (int a = 0; a < axisNum; a++) {
+			tempVec[a] = pointPositions[i * axisNum + a];
+		}
+		err = listTrj.addPvtPoint(&tempVec, &timeBetweenPoints);
+		showerr(err, "adding points to the PvtConstAccelTrj object");
+	}
+	err = listTrj.StartNew();
+	showerr(err, "calculating PvtConstAccelTrj velocities");
+
+	double listSeconds = secondsSince(start);
+
+	// Contiguous buffers, bulk append.
+	PvtSoaTrj soaTrj;
+	err = soaTrj.Init(axisNum);
+	showerr(err, "initializing the PvtSoaTrj object");
+
+	start = BenchClock::now();
+
+	err = soaTrj.addPvtPoints(pointPositions.data(), timeBetweenPoints, pointNum);
+	showerr(err, "adding points to the PvtSoaTrj object");
+	err = soaTrj.CalcVelocities();
+	showerr(err, "calculating PvtSoaTrj velocities");
+
+	double soaSeconds = secondsSince(start);
+
+	printf("%6d %10zu %18.0f %18.0f %7.1fx\n", axisNum, pointNum,
+		pointNum / listSeconds, pointNum / soaSeconds, listSeconds / soaSeconds);
+}
+
+/**
+ * Time the velocity calculation alone, with the points already loaded.
+ */
+static void benchmarkSolver(int axisNum, size_t pointNum)
+{
+	const Error* err = 0;
+	uint8 timeBetweenPoints = 10;
+
+	vector<double> pointPositions;
+	makeTestPoints(pointPositions, axisNum, pointNum);
+
+	PvtConstAccelTrj listTrj;
+	err = listTrj.Init(axisNum);
+	showerr(err, "initializing the PvtConstAccelTrj object");
+
+	vector<double> tempVec(axisNum);
+	for (size_t i = 0; i < pointNum; i++) {
+		for (int a = 0; a < axisNum; a++) {
+			tempVec[a] = pointPositions[i * axisNum + a];
+		}
+		err = listTrj.addPvtPoint(&tempVec, &timeBetweenPoints);
+		showerr(err, "adding points to the PvtConstAccelTrj object");
+	}
+
+	BenchClock::time_point start = BenchClock::now();
+	err = listTrj.StartNew();
+	showerr(err, "calculating PvtConstAccelTrj velocities");
+	double listSeconds = secondsSince(start);
+
+	PvtSoaTrj soaTrj;
+	err = soaTrj.Init(axisNum);
+	showerr(err, "initializing the PvtSoaTrj object");
+	err = soaTrj.addPvtPoints(pointPositions.data(), timeBetweenPoints, pointNum);
+	showerr(err, "adding points to the PvtSoaTrj object");
+
+	// run each solver a few times and keep the best time.
+	double axisSeconds = 1e9;
+	double batchSeconds = 1e9;
+	for (int run = 0; run < 5; run++) {
+		soaTrj.UseBatchSolver(false);
+		start = BenchClock::now();
+		err = soaTrj.CalcVelocities();
+		showerr(err, "calculating velocities axis by axis");
+		double seconds = secondsSince(start);
+		if (seconds < axisSeconds) axisSeconds = seconds;
+
+		soaTrj.UseBatchSolver(true);
+		start = BenchClock::now();
+		err = soaTrj.CalcVelocities();
+		showerr(err, "calculating velocities with the batch solver");
+		seconds = secondsSince(start);
+		if (seconds < batchSeconds) batchSeconds = seconds;
+	}
+
+	printf("%6d %10zu %18.0f %18.0f %18.0f\n", axisNum, pointNum,
+		listSeconds * 1e6, axisSeconds * 1e6, batchSeconds * 1e6);
+}
+
+/**
+ * Time how long it takes before the first PVT segment of a trajectory
+ * file is available, for a CSV file and for a binary trajectory file.
+ */
+static void benchmarkLoading(size_t pointNum)
+{
+	const Error* err = 0;
+	const int axisNum = 3;
+	uint8 timeBetweenPoints = 10;
+	const char* csvFileName = "PvtBenchmark.csv";
+	const char* trjFileName = "PvtBenchmark.pvt";
+
+	vector<double> pointPositions;
+	makeTestPoints(pointPositions, axisNum, pointNum);
+
+	// write the test files. This is not timed.
+	FILE* fp = fopen(csvFileName, "w");
+	if (!fp) { printf("Unable to create %s\n", csvFileName); return; }
+	fprintf(fp, "X Coordinate,Y Coordinate,Z Coordinate\n");
+	for (size_t i = 0; i < pointNum; i++) {
+		const double* p = &pointPositions[i * axisNum];
+		fprintf(fp, "%f,%f,%f\n", p[0], p[1], p[2]);
+	}
+	fclose(fp);
+
+	err = PvtTrjFileFromCsv(csvFileName, trjFileName, timeBetweenPoints);
+	showerr(err, "writing the trajectory file");
+
+	uunit pos[axisNum], vel[axisNum];
+	uint8 time;
+
+	// CSV, parsed the way PvtFromCsvFile.cpp does it.
+	BenchClock::time_point start = BenchClock::now();
+	{
+		PvtConstAccelTrj listTrj;
+		err = listTrj.Init(axisNum);
+		showerr(err, "initializing the PvtConstAccelTrj object");
+
+		ifstream csv(csvFileName);
+		string lineOfData;
+		vector<double> tempVec(axisNum);
+		getline(csv, lineOfData);
+		while (getline(csv, lineOfData)) {
+			stringstream strStream(lineOfData);
+			string tempStr;
+			for (int a = 0; a < axisNum && getline(strStream, tempStr, ','); a++) {
+				tempVec[a] = std::stod(tempStr);
+			}
+			err = listTrj.addPvtPoint(&tempVec, &timeBetweenPoints);
+			showerr(err, "adding points to the PvtConstAccelTrj object");
+		}
+
+		err = listTrj.StartNew();
+		if (!err) err = listTrj.NextSegment(pos, vel, time);
+		showerr(err, "getting the first CSV segment");
+	}
+	double csvSeconds = secondsSince(start);
+
+	// binary trajectory file, memory-mapped.
+	start = BenchClock::now();
+	{
+		PvtMappedTrj mappedTrj;
+		err = mappedTrj.Open(trjFileName);
+		if (!err) err = mappedTrj.StartNew();
+		if (!err) err = mappedTrj.NextSegment(pos, vel, time);
+		showerr(err, "getting the first mapped segment");
+	}
+	double mappedSeconds = secondsSince(start);
+
+	remove(csvFileName);
+	remove(trjFileName);
+
+	printf("%10zu points: CSV %.1f ms, mapped %.3f ms (%.0fx)\n", pointNum,
+		csvSeconds * 1e3, mappedSeconds * 1e3, csvSeconds / mappedSeconds);
+}
+
+/**
+ * Time parsing a large CSV file with getline/stringstream/stod and
+ * with PvtCsvParser.
+ */
+static void benchmarkCsvParse(size_t pointNum)
+{
+	const Error* err = 0;
+	const int axisNum = 7;
+	const char* csvFileName = "PvtBenchmarkParse.csv";
+
+	vector<double> pointPositions;
+	makeTestPoints(pointPositions, axisNum, pointNum);
+
+	// write the test file. This is not timed.
+	FILE* fp = fopen(csvFileName, "w");
+	if (!fp) { printf("Unable to create %s\n", csvFileName); return; }
+	fprintf(fp, "A,B,C,D,E,F,G,Time\n");
+	for (size_t i = 0; i < pointNum; i++) {
+		const double* p = &pointPositions[i * axisNum];
+		fprintf(fp, "%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%d\n",
+			p[0], p[1], p[2], p[3], p[4], p[5], p[6], 10 + (int)(i % 5));
+	}
+	long fileBytes = ftell(fp);
+	fclose(fp);
+	double fileMB = fileBytes / 1e6;
+
+	// getline/stringstream/stod, the way PvtFromCsvFile.cpp used to do it.
+	vector<double> lineValues;
+	vector<uint8> lineTimes;
+	lineValues.reserve(pointNum * axisNum);
+	lineTimes.reserve(pointNum);
+
+	BenchClock::time_point start = BenchClock::now();
+	{
+		ifstream csv(csvFileName);
+		string lineOfData;
+		getline(csv, lineOfData);
+		while (getline(csv, lineOfData)) {
+			stringstream strStream(lineOfData);
+			string tempStr;
+			for (int a = 0; a < axisNum && getline(strStream, tempStr, ','); a++) {
+				lineValues.push_back(std::stod(tempStr));
+			}
+			if (getline(strStream, tempStr, ','))
+				lineTimes.push_back((uint8)std::stoi(tempStr));
+		}
+	}
+	double lineSeconds = secondsSince(start);
+
+	// PvtCsvParser, whole file read and parsed in place.
+	PvtCsvParser csvParser;
+	PvtSoaTrj soaTrj;
+
+	start = BenchClock::now();
+	err = csvParser.ParseFile(csvFileName, soaTrj, 10);
+	double parserSeconds = secondsSince(start);
+	if (err) printf("line %d: %s\n", csvParser.GetErrorLine(), csvParser.GetErrorText());
+	showerr(err, "parsing the CSV file");
+
+	remove(csvFileName);
+
+	if (lineTimes.size() != csvParser.GetTimes().size())
+		printf("Point count mismatch: %zu / %zu\n", lineTimes.size(), csvParser.GetTimes().size());
+
+	printf("%8.0f MB, %zu points: getline/stod %.0f MB/s, PvtCsvParser %.0f MB/s (%.1fx)\n",
+		fileMB, pointNum, fileMB / lineSeconds, fileMB / parserSeconds, lineSeconds / parserSeconds);
+}
+
+/**
+ * Compare the move time of a path at a fixed spacing with the move
+ * time after retiming it under the passed limits.
+ */
+static void benchmarkRetime(const char* name, const double* pointPositions, size_t pointNum, int axisNum,
+	uint8 fixedTime, double vel, double acc, double dec, double jrk)
+{
+	const Error* err = 0;
+
+	PvtRetimer retimer;
+	err = retimer.SetLimits(vel, acc, dec, jrk);
+	showerr(err, "setting the retimer limits");
+
+	// check the fixed spacing against the same limits.
+	PvtSoaTrj fixedTrj;
+	err = fixedTrj.Init(axisNum);
+	showerr(err, "initializing the PvtSoaTrj object");
+	err = fixedTrj.addPvtPoints(pointPositions, fixedTime, pointNum);
+	showerr(err, "adding points to the PvtSoaTrj object");
+
+	uint32 fixedOver = retimer.CountViolations(fixedTrj);
+
+	// dwells keep the fixed time.
+	vector<uint8> pointTimes(pointNum, fixedTime);
+
+	PvtSoaTrj retimedTrj;
+	BenchClock::time_point start = BenchClock::now();
+	err = retimer.Retime(pointPositions, pointTimes.data(), pointNum, axisNum, retimedTrj);
+	double retimeSeconds = secondsSince(start);
+	showerr(err, "retiming the points");
+
+	uint32 fixedMs = (uint32)(pointNum - 1) * fixedTime;
+	char jerk[16];
+	snprintf(jerk, sizeof(jerk), "%.0f", jrk);
+
+	printf("%-16s %8zu %8s %10u %10u %7.2fx %10u %12.1f\n", name, pointNum, jrk > 0 ? jerk : "off",
+		fixedMs, retimer.GetTotalTime(), (double)fixedMs / retimer.GetTotalTime(), fixedOver, retimeSeconds * 1e3);
+	if (retimer.GetViolations())
+		printf("%-16s %u retimed segments still over the limits at 255 ms\n", "", retimer.GetViolations());
+}
+
+/**
+ * Time checking a solved trajectory against the move limits, segment by
+ * segment and with PvtValidator.
+ */
+static void benchmarkValidate(int axisNum, size_t pointNum)
+{
+	const Error* err = 0;
+	const int repeats = 5;
+
+	vector<double> pointPositions;
+	makeTestPoints(pointPositions, axisNum, pointNum);
+
+	PvtSoaTrj trj;
+	err = trj.Init(axisNum);
+	showerr(err, "initializing the PvtSoaTrj object");
+	err = trj.addPvtPoints(pointPositions.data(), (uint8)10, pointNum);
+	showerr(err, "adding points to the PvtSoaTrj object");
+	err = trj.CalcVelocities();
+	showerr(err, "calculating velocities");
+
+	PvtRetimer retimer;
+	err = retimer.SetLimits(20000, 960000, 960000, 200000);
+	showerr(err, "setting the retimer limits");
+
+	PvtValidator validator;
+	err = validator.SetMoveLimits(20000, 960000, 960000, 200000);
+	showerr(err, "setting the validator limits");
+	for (int a = 0; a < axisNum; a++)
+		validator.SetPositionLimits(a, -20000, 20000);
+
+	uint32 segmentOver = 0;
+	BenchClock::time_point start = BenchClock::now();
+	for (int r = 0; r < repeats; r++)
+		segmentOver = retimer.CountViolations(trj);
+	double segmentSeconds = secondsSince(start) / repeats;
+
+	start = BenchClock::now();
+	for (int r = 0; r < repeats; r++)
+		err = validator.Validate(trj);
+	double validatorSeconds = secondsSince(start) / repeats;
+	if (err && err != &PvtTrjError::LimitExceeded) showerr(err, "validating the trajectory");
+
+	if (segmentOver != validator.GetViolations())
+		printf("Violation count mismatch: %u / %llu\n", segmentOver, (unsigned long long)validator.GetViolations());
+
+	printf("%d axes, %zu points: segment by segment %.1f ms, PvtValidator %.1f ms (%.1fx), %llu segments over\n",
+		axisNum, pointNum, segmentSeconds * 1e3, validatorSeconds * 1e3, segmentSeconds / validatorSeconds,
+		(unsigned long long)validator.GetViolations());
+}
+
+/**
+ * Time adding points one at a time and solving them with the run time
+ * sized trajectories and with PvtConstAccelTrjN<N>.
+ */
+template <int N>
+static void benchmarkFixed(size_t pointNum)
+{
+	const Error* err = 0;
+	uint8 timeBetweenPoints = 10;
+
+	vector<double> pointPositions;
+	makeTestPoints(pointPositions, N, pointNum);
+
+	PvtConstAccelTrj listTrj;
+	err = listTrj.Init(N);
+	showerr(err, "initializing the PvtConstAccelTrj object");
+
+	BenchClock::time_point start = BenchClock::now();
+
+	vector<double> tempVec(N);
+	for (size_t i = 0; i < pointNum; i++) {
+		for (int a = 0; a < N; a++) {
+			tempVec[a] = pointPositions[i * N + a];
+		}
+		err = listTrj.addPvtPoint(&tempVec, &timeBetweenPoints);
+		showerr(err, "adding points to the PvtConstAccelTrj object");
+	}
+	err = listTrj.StartNew();
+	showerr(err, "calculating PvtConstAccelTrj velocities");
+
+	double listSeconds = secondsSince(start);
+
+	PvtSoaTrj soaTrj;
+	err = soaTrj.Init(N);
+	showerr(err, "initializing the PvtSoaTrj object");
+	soaTrj.Reserve(pointNum);
+
+	start = BenchClock::now();
+
+	for (size_t i = 0; i < pointNum; i++) {
+		for (int a = 0; a < N; a++) {
+			tempVec[a] = pointPositions[i * N + a];
+		}
+		err = soaTrj.addPvtPoint(&tempVec, &timeBetweenPoints);
+		showerr(err, "adding points to the PvtSoaTrj object");
+	}
+	err = soaTrj.CalcVelocities();
+	showerr(err, "calculating PvtSoaTrj velocities");
+
+	double soaSeconds = secondsSince(start);
+
+	PvtConstAccelTrjN<N> fixedTrj;
+	fixedTrj.Reserve(pointNum);
+
+	start = BenchClock::now();
+
+	typename PvtConstAccelTrjN<N>::Axes point;
+	for (size_t i = 0; i < pointNum; i++) {
+		for (int a = 0; a < N; a++) {
+			point[a] = pointPositions[i * N + a];
+		}
+		err = fixedTrj.addPvtPoint(point, timeBetweenPoints);
+		showerr(err, "adding points to the PvtConstAccelTrjN object");
+	}
+	err = fixedTrj.CalcVelocities();
+	showerr(err, "calculating PvtConstAccelTrjN velocities");
+
+	double fixedSeconds = secondsSince(start);
+
+	printf("%6d %10zu %18.0f %18.0f %18.0f %7.1fx\n", N, pointNum, pointNum / listSeconds,
+		pointNum / soaSeconds, pointNum / fixedSeconds, listSeconds / fixedSeconds);
+}
+
+/**************************************************/
+
+static void showerr(const Error* err, const char* str)
+{
+	if (err)
+	{
+		printf("Error %s: %s\n", str, err->toString());
+		exit(1);
+	}
+}
@@ -8,6 +8,12 @@ The PvtConstAccelTrj class contains an algorithm that calculates velocities
 which will produce constant accel/decel values. The velocities are calculated 
 using the positions in the lists and the times between each PVT point.
 
+The two trajectories are chained through a PvtStreamTrj object 
+(PvtStreamTrj.h) instead of being sent one after the other. The second
+trajectory is appended while the first one is running and starts where
+the first one ends, so the axes keep moving across the join instead of
+stopping and waiting for the host between the two moves.
+
 */
 
 // Comment this out to use EtherCAT
@@ -21,6 +27,7 @@ using the positions in the lists and the times between each PVT point.
 #include<vector> // for vectors 
 #include <list>
 #include "CML.h"
+#include "PvtStreamTrj.h"
 
 using std::list;
 
@@ -163,15 +170,29 @@ int main(void)
 		showerr(err, "adding points to the PVT object");
 	}
 
+	// the stream that the trajectories are chained on. Its buffer holds 
+	// a whole trajectory, so the 1st one can be queued before the move starts.
+	PvtStreamTrj trjChain;
+	err = trjChain.Init(axisNum, 8, 2 * numberOfPvtPoints);
+	showerr(err, "initializing the PvtStreamTrj object");
+
+	// queue the 1st trajectory on the stream.
+	err = trjChain.AppendTrajectory(pvtConstTrjObj);
+	showerr(err, "appending the 1st trajectory");
+
 	// Create my trajectory and send it to the linkage object
 	printf("Sending 1st trajectory to drives\n");
 
-	// send the trajectory to the linkage.
-	err = link.SendTrajectory(pvtConstTrjObj);
+	// send the stream to the linkage. The move keeps running while the
+	// 2nd trajectory is built and appended below.
+	err = link.SendTrajectory(trjChain);
 	showerr(err, "sending trajectory");
 
-	// Wait 20 seconds for the move to finish. Set to -1 to wait indefinitely.
-	err = link.WaitMoveDone(-1);
+	// the 2nd move starts where the 1st one ends.
+	vector<double> endOfFirstMove(axisNum);
+	for (int i = 0; i < axisNum; i++) {
+		endOfFirstMove[i] = multiDimensionalPositionData[i].back();
+	}
 	
 	////////////////////////
 	//   2nd Move
@@ -193,8 +214,7 @@ int main(void)
 	// initialize the position data
 	for (int i = 0; i < axisNum; i++) {
 
-		double commandedPosition{ 0.0 };
-		amp[i].GetPositionActual(commandedPosition);
+		double commandedPosition = endOfFirstMove[i];
 
 		// temporary vector for loading points
 		vector<double> tempVec;
@@ -216,12 +236,15 @@ int main(void)
 		showerr(err, "adding points to the PVT object");
 	}
 
-	// Create my trajectory and send it to the linkage object
-	printf("Sending 2nd trajectory to drives\n");
+	// append the 2nd trajectory to the running stream. Its first point is
+	// the last point of the 1st trajectory, so the move continues through it.
+	printf("Appending 2nd trajectory to the running move\n");
 
-	// send the trajectory to the linkage.
-	err = link.SendTrajectory(pvtConstTrjObj);
-	showerr(err, "sending trajectory");
+	err = trjChain.AppendTrajectory(pvtConstTrjObj);
+	showerr(err, "appending the 2nd trajectory");
+
+	// nothing more will be appended, the move ends at the last point.
+	trjChain.EndStream();
 	
 	// Wait 20 seconds for the move to finish. Set to -1 to wait indefinitely.
     err = link.WaitMoveDone(-1);
@@ -0,0 +1,288 @@
+/*
+
+PvtConstAccelTrjN.h
+
+The PvtConstAccelTrjN<N> class template is a PVT trajectory whose
+number of axes is fixed when the program is compiled, the same way
+CML's Point<N> is.
+
+PvtConstAccelTrj and PvtSoaTrj are sized at run time by Init(axisNum),
+so every loop over the axes has a count the compiler cannot see, and
+PvtConstAccelTrj allocates one list node per axis for every point
+added. PvtConstAccelTrjN<N> stores each point's positions and
+velocities in a std::array<double, N> held in a contiguous buffer:
+
+- no Init() call is needed, and the axis count cannot be wrong,
+- adding a point does not allocate once Reserve() has been called (the
+  buffer otherwise grows like a std::vector),
+- the loops over the axes have a fixed count, so the compiler unrolls
+  them and solves all N axes of a point together in SIMD registers.
+
+The velocities are calculated the same way PvtConstAccelTrj and
+PvtSoaTrj do it (see PvtSoaTrj.h): the trajectory starts and ends at
+rest and acceleration is continuous across every other point. The
+Thomas algorithm factors depend only on the segment times and are
+worked out during the forward sweep, so the whole solve is one pass
+forward and one pass back over the points.
+
+The class is a LinkTrajectory and is passed to Linkage::SendTrajectory()
+like any other trajectory.
+
+Usage:
+
+	PvtConstAccelTrjN<3> trj;
+	trj.Reserve(pointCount);
+
+	Point<3> p;
+	...
+	err = trj.addPvtPoint(p, 10);
+
+	err = link.SendTrajectory(trj);
+
+*/
+
+#ifndef PVT_CONST_ACCEL_TRJ_N_H
+#define PVT_CONST_ACCEL_TRJ_N_H
+
+#include <array>
+#include <cstddef>
+#include <vector>
+#include "CML.h"
+#include "PvtSoaTrj.h"
+
+CML_NAMESPACE_START()
+
+template <int N>
+class PvtConstAccelTrjN : public LinkTrajectory
+{
+	static_assert(N >= 1 && N <= PVT_SOA_MAX_AXES, "Linkages support 1 to 32 axes");
+
+public:
+
+	typedef std::array<double, N> Axes;
+
+	PvtConstAccelTrjN() : nextPoint(0), velocitiesValid(false), reusable(false) {}
+
+	virtual ~PvtConstAccelTrjN() {}
+
+	// Remove all of the points from the trajectory.
+	void Clear(void)
+	{
+		positions.clear();
+		velocities.clear();
+		times.clear();
+		nextPoint = 0;
+		velocitiesValid = false;
+	}
+
+	// Pre-allocate room for the passed number of points.
+	void Reserve(size_t pointCt)
+	{
+		positions.reserve(pointCt);
+		velocities.reserve(pointCt);
+		times.reserve(pointCt);
+		upper.reserve(pointCt);
+	}
+
+	/**
+	 * Add a single PVT point.
+	 *
+	 * @param position One position per axis.
+	 * @param time     The time (ms) from this point to the next.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* addPvtPoint(const Axes& position, uint8 time)
+	{
+		if (time == 0) return &PvtTrjError::BadPointTime;
+
+		positions.push_back(position);
+		times.push_back(time);
+		velocitiesValid = false;
+		return 0;
+	}
+
+	// Add a single PVT point held in a CML point.
+	const Error* addPvtPoint(Point<N>& position, uint8 time)
+	{
+		Axes p;
+		for (int a = 0; a < N; a++)
+			p[a] = (double)position[a];
+		return addPvtPoint(p, time);
+	}
+
+	/**
+	 * Add a single PVT point. This has the same signature as
+	 * PvtConstAccelTrj::addPvtPoint() so existing code can switch over
+	 * without changes.
+	 */
+	const Error* addPvtPoint(std::vector<double>* position, uint8* time)
+	{
+		if (!position || !time || (int)position->size() != N)
+			return &PvtTrjError::BadPointData;
+
+		Axes p;
+		for (int a = 0; a < N; a++)
+			p[a] = (*position)[a];
+		return addPvtPoint(p, *time);
+	}
+
+	/**
+	 * Append a block of PVT points with a single call.
+	 *
+	 * @param pointPositions Positions stored point by point, N values per
+	 *                       point: { A0, B0, A1, B1, ... }.
+	 * @param pointTimes     One time (ms) per point.
+	 * @param pointCt        The number of points to append.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* addPvtPoints(const double* pointPositions, const uint8* pointTimes, size_t pointCt)
+	{
+		if (!pointCt) return 0;
+		if (!pointPositions || !pointTimes) return &PvtTrjError::BadPointData;
+
+		for (size_t i = 0; i < pointCt; i++) {
+			if (pointTimes[i] == 0) return &PvtTrjError::BadPointTime;
+		}
+
+		size_t oldCt = times.size();
+		positions.resize(oldCt + pointCt);
+		for (size_t i = 0; i < pointCt; i++) {
+			for (int a = 0; a < N; a++)
+				positions[oldCt + i][a] = pointPositions[i * N + a];
+		}
+		times.insert(times.end(), pointTimes, pointTimes + pointCt);
+
+		velocitiesValid = false;
+		return 0;
+	}
+
+	// Append a block of points that all use the same time between points.
+	const Error* addPvtPoints(const double* pointPositions, uint8 pointTime, size_t pointCt)
+	{
+		std::vector<uint8> pointTimes(pointCt, pointTime);
+		return addPvtPoints(pointPositions, pointTimes.data(), pointCt);
+	}
+
+	// See PvtSoaTrj::SetReusable().
+	void SetReusable(bool reuse) { reusable = reuse; }
+
+	// The number of points in the trajectory that have not been sent yet.
+	size_t GetPointCount(void) const { return times.size() - nextPoint; }
+
+	// The positions of the next point to send onwards.
+	const Axes* GetPositions(void) const { return positions.data() + nextPoint; }
+
+	// The velocities of the next point to send onwards. Only valid after CalcVelocities().
+	const Axes* GetVelocities(void) const { return velocities.data() + nextPoint; }
+
+	// Segment times (ms), starting at the next point to send.
+	const uint8* GetTimes(void) const { return times.data() + nextPoint; }
+
+	/**
+	 * Calculate the velocity of every point that has not been sent yet.
+	 * This is done automatically by StartNew() when the trajectory is
+	 * passed to Linkage::SendTrajectory().
+	 *
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* CalcVelocities(void)
+	{
+		size_t n = GetPointCount();
+		if (!n) return &PvtTrjError::NoPoints;
+
+		velocities.resize(times.size());
+		upper.resize(n);
+
+		const Axes* p = GetPositions();
+		Axes* v = velocities.data() + nextPoint;
+		const uint8* t = GetTimes();
+
+		v[0].fill(0.0);
+		v[n - 1].fill(0.0);
+
+		if (n >= 3) {
+			// forward sweep, factoring the system as it goes. v[] holds the
+			// modified right hand side. See PvtSoaTrj::BuildFactors().
+			double prevInvH = 1000.0 / t[0];
+			double prevUpper = 0.0;
+			for (size_t i = 1; i + 1 < n; i++) {
+				double invH = 1000.0 / t[i];
+				double lower = (i > 1) ? prevInvH : 0.0;
+				double invPivot = 1.0 / (2.0 * (prevInvH + invH) - lower * prevUpper);
+				double w0 = 3.0 * prevInvH * prevInvH;
+				double w1 = 3.0 * invH * invH;
+
+				for (int a = 0; a < N; a++) {
+					double rhs = (p[i][a] - p[i - 1][a]) * w0 + (p[i + 1][a] - p[i][a]) * w1;
+					v[i][a] = (rhs - lower * v[i - 1][a]) * invPivot;
+				}
+
+				upper[i] = (i + 2 < n) ? invH * invPivot : 0.0;
+				prevUpper = upper[i];
+				prevInvH = invH;
+			}
+
+			// back substitution.
+			for (size_t i = n - 2; i > 1; i--) {
+				for (int a = 0; a < N; a++)
+					v[i - 1][a] -= upper[i - 1] * v[i][a];
+			}
+		}
+
+		velocitiesValid = true;
+		return 0;
+	}
+
+	virtual int GetDim(void) { return N; }
+
+	// Called by the linkage before the first segment is requested.
+	virtual const Error* StartNew(void)
+	{
+		if (reusable) nextPoint = 0;
+		if (!GetPointCount()) return &PvtTrjError::NoPoints;
+		if (!velocitiesValid) return CalcVelocities();
+		return 0;
+	}
+
+	// Called by the linkage once the trajectory is finished. See
+	// PvtSoaTrj::Finish().
+	virtual void Finish(void)
+	{
+		if (reusable) nextPoint = 0;
+		else if (nextPoint >= times.size()) Clear();
+	}
+
+	/**
+	 * Return the next PVT segment to the linkage. The last point of the
+	 * trajectory is returned with a time of zero to end the move.
+	 */
+	virtual const Error* NextSegment(uunit pos[], uunit vel[], uint8& time)
+	{
+		if (nextPoint >= times.size()) return &PvtTrjError::NoPoints;
+
+		const Axes& p = positions[nextPoint];
+		const Axes& v = velocities[nextPoint];
+		for (int a = 0; a < N; a++) {
+			pos[a] = (uunit)p[a];
+			vel[a] = (uunit)v[a];
+		}
+
+		time = (nextPoint + 1 < times.size()) ? times[nextPoint] : 0;
+		nextPoint++;
+		return 0;
+	}
+
+protected:
+
+	std::vector<Axes> positions;     // one entry per point
+	std::vector<Axes> velocities;    // one entry per point
+	std::vector<uint8> times;
+	std::vector<double> upper;       // Thomas algorithm factors, by point
+	size_t nextPoint;           // index of the next point to send
+	bool velocitiesValid;
+	bool reusable;              // keep the points after they are sent
+};
+
+CML_NAMESPACE_END()
+
+#endif
@@ -0,0 +1,302 @@
+/*
+
+PvtCsvParser.h
+
+The PvtCsvParser class loads PVT positions from a CSV file into a
+PvtSoaTrj object (PvtSoaTrj.h).
+
+The whole file is read into memory with one read and parsed in place
+with std::from_chars, which is several times faster than reading it
+line by line with getline() and converting each field with std::stod.
+The points are added to the trajectory with a single addPvtPoints()
+call.
+
+File layout:
+
+- The first row holds the column names.
+- Every column is an axis position, except for an optional time
+  column. A column named "time" (in any case), or whose name starts
+  with "time" followed by anything but a letter or digit, such as
+  "Time (ms)" or "time_ms", is used as the time column, e.g.
+
+	X Coordinate,Y Coordinate,Z Coordinate,Time
+	11285.99,11271.99,-14350.00,10
+	11285.99,11271.99,-14400.00,15
+
+  The time of a row is the time (1-255 ms) taken to travel to the next
+  row. Files without a time column use the time passed to ParseFile()
+  for every row.
+- Blank lines are ignored. Fields may be surrounded by spaces.
+
+If a row cannot be parsed, ParseFile() returns an error and
+GetErrorLine() / GetErrorText() describe where and why.
+
+*/
+
+#ifndef PVT_CSV_PARSER_H
+#define PVT_CSV_PARSER_H
+
+#include <cctype>
+#include <cstdarg>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "CML.h"
+#include "PvtSoaTrj.h"
+
+CML_NAMESPACE_START()
+
+class PvtCsvParser
+{
+public:
+
+	PvtCsvParser() : axisCt(0), timeColumn(-1), forcedTimeColumn(-2), errorLine(0) { errorText[0] = 0; }
+
+	/**
+	 * Use the passed column (0 based) as the time column instead of
+	 * looking for it by name. Pass -1 if the file has no time column.
+	 */
+	void SetTimeColumn(int column) { forcedTimeColumn = column; }
+
+	/**
+	 * Read a CSV file and add its points to a trajectory. If the
+	 * trajectory has not been initialized yet it is initialized with the
+	 * number of axis columns in the file.
+	 *
+	 * @param fileName          Name of the CSV file.
+	 * @param trj               The trajectory to add the points to.
+	 * @param timeBetweenPoints Time (ms) used for every row if the file
+	 *                          has no time column.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* ParseFile(const char* fileName, PvtSoaTrj& trj, uint8 timeBetweenPoints)
+	{
+		std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+		if (!file.is_open()) {
+			SetError(0, "unable to open %s", fileName);
+			return &PvtTrjError::FileOpen;
+		}
+
+		std::streamoff size = file.tellg();
+		file.seekg(0);
+		fileData.resize((size_t)size);
+		if (size && !file.read(fileData.data(), size)) {
+			SetError(0, "unable to read %s", fileName);
+			return &PvtTrjError::FileOpen;
+		}
+
+		const Error* err = ParseBuffer(fileData.data(), fileData.size(), timeBetweenPoints);
+		if (err) return err;
+
+		if (!trj.GetDim()) {
+			err = trj.Init(axisCt);
+			if (err) return err;
+		}
+		else if (trj.GetDim() != axisCt) {
+			SetError(0, "the file has %d axis columns, the trajectory has %d", axisCt, trj.GetDim());
+			return &PvtTrjError::BadAxisCount;
+		}
+
+		return trj.addPvtPoints(points.data(), times.data(), times.size());
+	}
+
+	/**
+	 * Parse CSV text that is already in memory. The results are available
+	 * from GetPoints() and GetTimes().
+	 */
+	const Error* ParseBuffer(const char* data, size_t length, uint8 timeBetweenPoints)
+	{
+		const char* p = data;
+		const char* end = data + length;
+
+		points.clear();
+		times.clear();
+		errorLine = 0;
+		errorText[0] = 0;
+
+		// the title row sets the number of columns and the time column.
+		const char* lineEnd = FindLineEnd(p, end);
+		int columnCt = ParseTitleRow(p, lineEnd);
+		if (columnCt <= 0) {
+			SetError(1, "missing title row");
+			return &PvtTrjError::FileFormat;
+		}
+
+		axisCt = (timeColumn >= 0) ? columnCt - 1 : columnCt;
+		if (axisCt < 1 || axisCt > PVT_SOA_MAX_AXES) {
+			SetError(1, "%d axis columns, 1 to %d are supported", axisCt, PVT_SOA_MAX_AXES);
+			return &PvtTrjError::BadAxisCount;
+		}
+
+		// a rough guess of the row count saves re-allocating the buffers.
+		size_t rowGuess = length / (size_t)(columnCt * 8 + 1);
+		points.reserve(rowGuess * axisCt);
+		times.reserve(rowGuess);
+
+		int lineNum = 1;
+		p = NextLine(lineEnd, end);
+
+		while (p < end) {
+			lineNum++;
+			lineEnd = FindLineEnd(p, end);
+
+			if (!IsBlank(p, lineEnd)) {
+				const Error* err = ParseRow(p, lineEnd, columnCt, lineNum, timeBetweenPoints);
+				if (err) return err;
+			}
+
+			p = NextLine(lineEnd, end);
+		}
+
+		if (times.empty()) {
+			SetError(lineNum, "the file does not contain any points");
+			return &PvtTrjError::NoPoints;
+		}
+
+		return 0;
+	}
+
+	// Number of axis columns found in the last file parsed.
+	int GetAxisCount(void) const { return axisCt; }
+
+	// Parsed positions, stored point by point (axisCt values per point).
+	const std::vector<double>& GetPoints(void) const { return points; }
+
+	// Parsed segment times, one per point.
+	const std::vector<uint8>& GetTimes(void) const { return times; }
+
+	// Line number (1 based) of the last error, or 0 if not line related.
+	int GetErrorLine(void) const { return errorLine; }
+
+	// Description of the last error.
+	const char* GetErrorText(void) const { return errorText; }
+
+protected:
+
+	static const char* FindLineEnd(const char* p, const char* end)
+	{
+		const char* nl = (const char*)memchr(p, '\n', end - p);
+		return nl ? nl : end;
+	}
+
+	static const char* NextLine(const char* lineEnd, const char* end)
+	{
+		return (lineEnd < end) ? lineEnd + 1 : end;
+	}
+
+	static bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+	static bool IsBlank(const char* p, const char* lineEnd)
+	{
+		while (p < lineEnd && IsSpace(*p)) p++;
+		return p == lineEnd;
+	}
+
+	// A time column is named "time", or starts with "time" and a
+	// separator ("Time (ms)"), so "Runtime" or "Timestamp" are not.
+	static bool IsTimeName(const char* p, const char* fieldEnd)
+	{
+		while (p < fieldEnd && IsSpace(*p)) p++;
+		for (const char* t = "time"; *t; t++, p++) {
+			if (p >= fieldEnd || tolower((unsigned char)*p) != *t)
+				return false;
+		}
+		return p >= fieldEnd || !isalnum((unsigned char)*p);
+	}
+
+	// Count the columns of the title row and look for the time column.
+	int ParseTitleRow(const char* p, const char* lineEnd)
+	{
+		if (IsBlank(p, lineEnd)) return 0;
+
+		int column = 0;
+		timeColumn = -1;
+		while (true) {
+			const char* comma = (const char*)memchr(p, ',', lineEnd - p);
+			const char* fieldEnd = comma ? comma : lineEnd;
+
+			if (timeColumn < 0 && IsTimeName(p, fieldEnd))
+				timeColumn = column;
+
+			column++;
+			if (!comma) break;
+			p = comma + 1;
+		}
+
+		if (forcedTimeColumn >= -1) timeColumn = forcedTimeColumn;
+		if (timeColumn >= column) timeColumn = -1;
+		return column;
+	}
+
+	// Parse one data row into the points and times buffers.
+	const Error* ParseRow(const char* p, const char* lineEnd, int columnCt, int lineNum, uint8 timeBetweenPoints)
+	{
+		uint8 rowTime = timeBetweenPoints;
+
+		for (int column = 0; column < columnCt; column++) {
+			while (p < lineEnd && IsSpace(*p)) p++;
+			if (p < lineEnd && *p == '+') p++;
+
+			double value;
+			std::from_chars_result res = std::from_chars(p, lineEnd, value);
+			if (res.ec != std::errc()) {
+				SetError(lineNum, "column %d is not a number", column + 1);
+				return &PvtTrjError::BadPointData;
+			}
+			p = res.ptr;
+
+			if (column == timeColumn) {
+				if (!(value >= 1 && value <= 255) || value != (double)(int)value) {
+					SetError(lineNum, "time %g is not a whole number of milliseconds from 1 to 255", value);
+					return &PvtTrjError::BadPointTime;
+				}
+				rowTime = (uint8)value;
+			}
+			else {
+				points.push_back(value);
+			}
+
+			while (p < lineEnd && IsSpace(*p)) p++;
+			if (column + 1 < columnCt) {
+				if (p >= lineEnd || *p != ',') {
+					SetError(lineNum, "expected %d columns, found %d", columnCt, column + 1);
+					return &PvtTrjError::BadPointData;
+				}
+				p++;
+			}
+		}
+
+		if (p != lineEnd) {
+			SetError(lineNum, "expected %d columns, found more", columnCt);
+			return &PvtTrjError::BadPointData;
+		}
+
+		times.push_back(rowTime);
+		return 0;
+	}
+
+	void SetError(int lineNum, const char* fmt, ...)
+	{
+		errorLine = lineNum;
+		va_list args;
+		va_start(args, fmt);
+		vsnprintf(errorText, sizeof(errorText), fmt, args);
+		va_end(args);
+	}
+
+	int axisCt;
+	int timeColumn;
+	int forcedTimeColumn;    // -2 = find by name, -1 = none, otherwise the column
+	int errorLine;
+	char errorText[128];
+
+	std::vector<char> fileData;
+	std::vector<double> points;
+	std::vector<uint8> times;
+};
+
+CML_NAMESPACE_END()
+
+#endif
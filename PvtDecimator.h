@@ -0,0 +1,305 @@
+/*
+
+PvtDecimator.h
+
+The PvtDecimator class removes redundant points from a recorded
+trajectory, for example the positions captured during a teach session
+(see RobotTeachMode.cpp), while keeping the path the drives will follow
+within a position tolerance of every recorded sample.
+
+Recorded data is sampled at a fixed rate, so slow or straight parts of
+the motion produce long runs of points that carry almost no
+information. Each PVT point costs one buffer message per axis on the
+network, so sending all of them wastes bandwidth and drive buffer
+space.
+
+The decimator works like the Ramer-Douglas-Peucker algorithm, extended
+to any number of axes, but it measures the error against the path the
+drive actually plays: a cubic between each pair of kept points, using
+the continuous-acceleration velocities that PvtSoaTrj calculates for
+the kept points. Starting from the first and last point, it repeatedly:
+
+1. calculates the velocities of the points kept so far,
+2. evaluates the PVT cubic of every segment at each recorded sample
+   inside it, and
+3. keeps the sample with the largest error in every segment where some
+   axis is further than its tolerance from the recording.
+
+This stops once every sample is within tolerance on every axis. The
+kept points get variable time steps (the sum of the recorded times
+they replace), and a segment is never made longer than the 255 ms a
+PVT point can hold.
+
+Usage:
+
+	PvtDecimator decimator;
+	err = decimator.SetTolerance(5.0);   // counts, all axes
+
+	PvtSoaTrj trj;
+	err = decimator.Decimate(recordedPoints, 10, pointCount, axisCount, trj);
+	printf("%zu of %zu points kept\n", decimator.GetOutputPoints(), decimator.GetInputPoints());
+
+*/
+
+#ifndef PVT_DECIMATOR_H
+#define PVT_DECIMATOR_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "CML.h"
+#include "PvtSoaTrj.h"
+
+CML_NAMESPACE_START()
+
+class PvtDecimator
+{
+public:
+
+	PvtDecimator() : inputPoints(0), outputPoints(0), axisCt(0), iterations(0)
+	{
+		tolerance.assign(PVT_SOA_MAX_AXES, 1.0);
+	}
+
+	/**
+	 * Use the same position tolerance for every axis.
+	 *
+	 * @param tol The tolerance, in position units.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* SetTolerance(double tol)
+	{
+		if (!(tol > 0.0)) return &PvtTrjError::BadPointData;
+
+		tolerance.assign(PVT_SOA_MAX_AXES, tol);
+		return 0;
+	}
+
+	/**
+	 * Set a different position tolerance for each axis.
+	 *
+	 * @param tol    One tolerance per axis, in position units.
+	 * @param axisNum The number of values in tol.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* SetTolerance(const double* tol, int axisNum)
+	{
+		if (axisNum < 1 || axisNum > PVT_SOA_MAX_AXES) return &PvtTrjError::BadAxisCount;
+		if (!tol) return &PvtTrjError::BadPointData;
+
+		for (int a = 0; a < axisNum; a++) {
+			if (!(tol[a] > 0.0)) return &PvtTrjError::BadPointData;
+			tolerance[a] = tol[a];
+		}
+		return 0;
+	}
+
+	/**
+	 * Decimate a recorded trajectory into a PvtSoaTrj object. The output
+	 * trajectory is initialized with axisNum axes and its velocities are
+	 * already calculated when this returns.
+	 *
+	 * @param pointPositions Recorded positions stored point by point,
+	 *                       axisNum values per point: { A0, B0, A1, B1, ... }.
+	 * @param pointTimes     One time (ms) per recorded point, the time to
+	 *                       the next point.
+	 * @param pointCt        The number of recorded points.
+	 * @param axisNum        The number of axes.
+	 * @param out            The trajectory to fill.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Decimate(const double* pointPositions, const uint8* pointTimes, size_t pointCt, int axisNum, PvtSoaTrj& out)
+	{
+		if (axisNum < 1 || axisNum > PVT_SOA_MAX_AXES) return &PvtTrjError::BadAxisCount;
+		if (!pointCt) return &PvtTrjError::NoPoints;
+		if (!pointPositions || !pointTimes) return &PvtTrjError::BadPointData;
+
+		for (size_t i = 0; i < pointCt; i++) {
+			if (pointTimes[i] == 0) return &PvtTrjError::BadPointTime;
+		}
+
+		const Error* err = out.Init(axisNum);
+		if (err) return err;
+
+		src = pointPositions;
+		srcTimes = pointTimes;
+		inputPoints = pointCt;
+		axisCt = axisNum;
+		iterations = 0;
+
+		// sample times (ms) from the start of the recording.
+		sampleTime.resize(pointCt);
+		uint32 t = 0;
+		for (size_t i = 0; i < pointCt; i++) {
+			sampleTime[i] = t;
+			t += pointTimes[i];
+		}
+
+		// start from the end points, plus any points needed to keep the
+		// segments short enough for a PVT time.
+		keep.assign(pointCt, false);
+		keep[0] = true;
+		keep[pointCt - 1] = true;
+		size_t lastKept = 0;
+		for (size_t i = 1; i < pointCt; i++) {
+			if (sampleTime[i] - sampleTime[lastKept] > 255) {
+				keep[i - 1] = true;
+				lastKept = i - 1;
+			}
+		}
+
+		while (true) {
+			iterations++;
+
+			err = BuildTrajectory(out);
+			if (err) return err;
+
+			if (!KeepWorstPoints(out)) break;
+		}
+
+		outputPoints = out.GetPointCount();
+		return 0;
+	}
+
+	// Decimate a recording with the same time between every point.
+	const Error* Decimate(const double* pointPositions, uint8 pointTime, size_t pointCt, int axisNum, PvtSoaTrj& out)
+	{
+		std::vector<uint8> pointTimes(pointCt, pointTime);
+		return Decimate(pointPositions, pointTimes.data(), pointCt, axisNum, out);
+	}
+
+	// The number of points passed to the last Decimate() call.
+	size_t GetInputPoints(void) const { return inputPoints; }
+
+	// The number of points kept by the last Decimate() call.
+	size_t GetOutputPoints(void) const { return outputPoints; }
+
+	// The number of solve / check passes the last Decimate() call took.
+	int GetIterations(void) const { return iterations; }
+
+	// The largest difference between the played path and the recording on the passed axis.
+	double GetMaxError(int axis) const { return (axis >= 0 && axis < (int)maxError.size()) ? maxError[axis] : 0.0; }
+
+	// The number of PVT buffer messages (one per axis per point) saved.
+	uint64 GetMessagesSaved(void) const { return (uint64)(inputPoints - outputPoints) * axisCt; }
+
+	// The number of PVT buffer bytes saved on the network.
+	uint64 GetBytesSaved(void) const { return GetMessagesSaved() * PVT_SEGMENT_MESSAGE_BYTES; }
+
+	// The fraction of the PVT bandwidth saved, 0.0 to 1.0.
+	double GetBandwidthSaved(void) const { return inputPoints ? 1.0 - (double)outputPoints / inputPoints : 0.0; }
+
+protected:
+
+	// Load the kept points into the output trajectory and calculate their
+	// velocities.
+	const Error* BuildTrajectory(PvtSoaTrj& out)
+	{
+		keptIndex.clear();
+		keptPoints.clear();
+		keptTimes.clear();
+
+		for (size_t i = 0; i < inputPoints; i++) {
+			if (!keep[i]) continue;
+
+			if (!keptIndex.empty())
+				keptTimes.back() = (uint8)(sampleTime[i] - sampleTime[keptIndex.back()]);
+
+			keptIndex.push_back(i);
+			keptPoints.insert(keptPoints.end(), src + i * axisCt, src + (i + 1) * axisCt);
+			keptTimes.push_back(srcTimes[i]);
+		}
+
+		out.Clear();
+		const Error* err = out.addPvtPoints(keptPoints.data(), keptTimes.data(), keptTimes.size());
+		if (!err) err = out.CalcVelocities();
+		return err;
+	}
+
+	/**
+	 * Compare the cubic of every kept segment with the recorded samples it
+	 * replaces, and keep the worst sample of every segment that is out of
+	 * tolerance.
+	 *
+	 * @return true if any points were added.
+	 */
+	bool KeepWorstPoints(PvtSoaTrj& out)
+	{
+		bool added = false;
+		maxError.assign(axisCt, 0.0);
+
+		const double* pos[PVT_SOA_MAX_AXES];
+		const double* vel[PVT_SOA_MAX_AXES];
+		for (int a = 0; a < axisCt; a++) {
+			pos[a] = out.GetPositions(a);
+			vel[a] = out.GetVelocities(a);
+		}
+
+		for (size_t k = 0; k + 1 < keptIndex.size(); k++) {
+			size_t first = keptIndex[k];
+			size_t last = keptIndex[k + 1];
+			if (last - first < 2) continue;
+
+			double h = (sampleTime[last] - sampleTime[first]) * 0.001;
+			double invSpan = 1.0 / (sampleTime[last] - sampleTime[first]);
+
+			double worst = 1.0;
+			size_t worstIndex = 0;
+
+			for (size_t i = first + 1; i < last; i++) {
+				// cubic Hermite basis at this sample.
+				double s = (sampleTime[i] - sampleTime[first]) * invSpan;
+				double s2 = s * s;
+				double s3 = s2 * s;
+				double h00 = 2.0 * s3 - 3.0 * s2 + 1.0;
+				double h10 = (s3 - 2.0 * s2 + s) * h;
+				double h01 = 3.0 * s2 - 2.0 * s3;
+				double h11 = (s3 - s2) * h;
+
+				double score = 0.0;
+				for (int a = 0; a < axisCt; a++) {
+					double p = h00 * pos[a][k] + h10 * vel[a][k] + h01 * pos[a][k + 1] + h11 * vel[a][k + 1];
+					double e = fabs(p - src[i * axisCt + a]);
+					if (e > maxError[a]) maxError[a] = e;
+					double r = e / tolerance[a];
+					if (r > score) score = r;
+				}
+
+				if (score > worst) {
+					worst = score;
+					worstIndex = i;
+				}
+			}
+
+			if (worstIndex) {
+				keep[worstIndex] = true;
+				added = true;
+			}
+		}
+
+		return added;
+	}
+
+	std::vector<double> tolerance;     // per axis
+	std::vector<double> maxError;      // per axis, from the last check
+
+	// the recording being decimated
+	const double* src;
+	const uint8* srcTimes;
+	size_t inputPoints;
+	size_t outputPoints;
+	int axisCt;
+	int iterations;
+
+	std::vector<uint32> sampleTime;    // ms from the first sample
+	std::vector<bool> keep;            // samples kept so far
+
+	// the kept points, rebuilt on every pass
+	std::vector<size_t> keptIndex;
+	std::vector<double> keptPoints;
+	std::vector<uint8> keptTimes;
+};
+
+CML_NAMESPACE_END()
+
+#endif
@@ -0,0 +1,73 @@
+/*
+
+PvtCsvToTrjFile.cpp
+
+Command line tool that converts a CSV file of PVT positions (the layout
+used by PvtFromCsvFile.cpp, see XyzPoints.csv) into a binary trajectory
+file (see PvtTrjFile.h).
+
+The velocities are calculated once during the conversion and stored in
+the file, so a program that plays the file with the PvtMappedTrj class
+starts streaming immediately, without parsing or calculating anything.
+
+Usage:
+
+	PvtCsvToTrjFile XyzPoints.csv XyzPoints.pvt 10
+
+The last argument is the time between points in milliseconds (1-255).
+
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include "CML.h"
+#include "../PvtTrjFile.h"
+
+// If a namespace has been defined in CML_Settings.h, this
+// macros starts using it. 
+CML_NAMESPACE_USE();
+
+/* local functions */
+static void showerr(const Error* err, const char* str);
+
+int main(int argc, char** argv)
+{
+	if (argc != 4)
+	{
+		printf("Usage: %s <input.csv> <output.pvt> <time between points (ms)>\n", argv[0]);
+		return 1;
+	}
+
+	int timeBetweenPoints = atoi(argv[3]);
+	if (timeBetweenPoints < 1 || timeBetweenPoints > 255)
+	{
+		printf("The time between points must be between 1 and 255 milliseconds\n");
+		return 1;
+	}
+
+	PvtCsvParser parser;
+	const Error* err = PvtTrjFileFromCsv(argv[1], argv[2], (uint8)timeBetweenPoints, &parser);
+	if (err && parser.GetErrorLine())
+		printf("%s line %d: %s\n", argv[1], parser.GetErrorLine(), parser.GetErrorText());
+	showerr(err, "converting the CSV file");
+
+	PvtMappedTrj trj;
+	err = trj.Open(argv[2]);
+	showerr(err, "checking the trajectory file");
+
+	printf("Wrote %llu points on %d axes to %s\n",
+		(unsigned long long)trj.GetPointCount(), trj.GetDim(), argv[2]);
+
+	return 0;
+}
+
+/**************************************************/
+
+static void showerr(const Error* err, const char* str)
+{
+	if (err)
+	{
+		printf("Error %s: %s\n", str, err->toString());
+		exit(1);
+	}
+}
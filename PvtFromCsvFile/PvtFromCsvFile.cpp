@@ -20,8 +20,34 @@ Axis A Positions, Axis B Positions, Axis C Positions
       300       ,      256        ,       289
       300       ,      300        ,       300
 
+A time column may be added to give each row its own time (1-255 ms)
+to the next row. A column titled "Time", or starting with "Time" as in
+"Time (ms)", is used as the time column. Without one, timeBetweenPoints is used for every row.
+
+      Axis A Positions, Axis B Positions, Axis C Positions, Time
+      100             , 150             , 100             , 10
+      200             , 250             , 100             , 25
+
+The file is parsed by the PvtCsvParser class (PvtCsvParser.h). Any 
+number of axis columns is supported, and a row that cannot be parsed
+is reported with its line number.
+
+Every cycle sends the same trajectory, so the solved trajectory is kept
+in a PvtTrjCache (PvtTrjCache.h). Only the first cycle parses the file 
+and calculates the velocities, and the solved trajectory is also saved
+to the current directory so the next run of the program starts with it.
+Editing the CSV file or the move limits below makes a new trajectory.
+
+The trajectory is sent through a PvtTelemetryTrj (PvtTelemetryTrj.h),
+which times CML's refills of the drive's PVT buffer. The buffer margin
+and refill statistics are printed after every move and the refill 
+history of the last move is saved to PvtRefills.csv. Use them to tune
+timeBetweenPoints and thread priorities if the drive reports PVT 
+buffer underflows.
+
 The PVT linkage will attempt to achieve these commanded positions
-using a PVT algorithm in the PvtConstAccelTrj class.
+using a PVT algorithm in the PvtSoaTrj class (PvtSoaTrj.h), which 
+calculates the same velocities as CML's PvtConstAccelTrj class.
 
 The algorithm calculates velocities which will produce continuous 
 accel/decel values. The velocities are calculated using the 
@@ -34,15 +60,14 @@ positions in the CSV file and the time between each PVT point.
 
 #include <cstdio>
 #include <cstdlib>
-#include <fstream>
 #include <iostream>
 #include <string> 
 #include<vector> // for vectors 
-#include <list>
-#include <sstream>
 #include "CML.h"
-
-using std::list;
+#include "../PvtSoaTrj.h"
+#include "../PvtCsvParser.h"
+#include "../PvtTrjCache.h"
+#include "../PvtTelemetryTrj.h"
 
 #if defined( USE_CAN )
 #include "can/can_copley.h"
@@ -71,73 +96,20 @@ uint8 timeBetweenPoints = 10; // 10ms between points
 
 using namespace std;
 
-// load the PVT data from the passed CSV file into the PvtConstAccelTrj class.
-void loadPvtPointsFromFile(PvtConstAccelTrj& pvtConstTrjObj, const char* inputExcelFile) {
-	try {
-		ifstream ifstrObj;
-		string xPos{ NULL };
-		string yPos{ NULL };
-		string zPos{ NULL };
-
-		const Error* err{ 0 };
-		vector<double> tempVec = { 0.0, 0.0, 0.0 };
-		vector<double>* tempVecPntr = &tempVec;
-
-		vector<double> xPosVec;
-		vector<double> yPosVec;
-		vector<double> zPosVec;
-
-		vector<uint8> constantTimeVec;
-		constantTimeVec.push_back(timeBetweenPoints);
-
-		ifstrObj.open(inputExcelFile);
-
-		if (ifstrObj.is_open()) {
-			int count{ 0 };
-			string lineOfData{ NULL };
-			while (!ifstrObj.eof()) {
-
-				// get a line of data from the excel file.
-				getline(ifstrObj, lineOfData);
-
-				// ignore first row, which is just the title row. (X Coordinate, Y Coordinate, Z Coordinate, Time).
-				if (count != 0) {
-					
-					vector<string> allNumsVec;
-					string tempStr;
-					stringstream strStream(lineOfData);
-
-					if (lineOfData != "") {
-						// seperate the line using the commas. The string looks like "1034,120345,123"
-						while (getline(strStream, tempStr, ',')) {
-							allNumsVec.push_back(tempStr);
-						}
-
-						// use the stod method to convert string to double type.
-						tempVec[0] = std::stod(allNumsVec[0]);
-						tempVec[1] = std::stod(allNumsVec[1]);
-						tempVec[2] = std::stod(allNumsVec[2]);
-
-						// add the PVT point to the PvtConstAccelTrj object.
-						err = pvtConstTrjObj.addPvtPoint(tempVecPntr, &constantTimeVec[0]);
-						showerr(err, "adding points to the PVT object");
-					}
-				}
-
-				// used to ignore first row. (Title header)
-				else {
-					count = 1;
-				}
-			}
-		}
+// get the solved trajectory for the passed CSV file from the cache,
+// loading it into a PvtSoaTrj object the first time.
+shared_ptr<PvtSoaTrj> loadPvtPointsFromFile(PvtTrjCache& trjCache, const char* inputExcelFile,
+	const double* limits, int limitCt) {
 
-		ifstrObj.close();
-	}
-	// catch any exception here
-	catch (...) {
-		cout << "\nException occured in loadPvtPointsFromFile.\n";
-		throw;
+	shared_ptr<PvtSoaTrj> pvtTrj;
+
+	const Error* err = trjCache.LoadCsv(inputExcelFile, timeBetweenPoints, limits, limitCt, pvtTrj);
+	if (err && trjCache.GetParser().GetErrorLine()) {
+		printf("%s line %d: %s\n", inputExcelFile, trjCache.GetParser().GetErrorLine(), trjCache.GetParser().GetErrorText());
 	}
+	showerr(err, "loading PVT points from the CSV file");
+
+	return pvtTrj;
 }
 
 int main(void)
@@ -206,12 +178,12 @@ int main(void)
 	// set the limits for the linkage object
 	err = link.SetMoveLimits(pathMaxVel, pathMaxAccel, pathMaxDecel, pathMaxJerk); showerr(err, "Setting Linkage Move Limits");
 
-	// create an instance of the PvtConstAccelTrj class.
-	PvtConstAccelTrj pvtConstTrjObj;
+	// solved trajectories are kept in memory and saved to the current directory.
+	PvtTrjCache trjCache;
+	trjCache.SetCacheDir(".");
 
-	// initialize the object with the number of dimensions in the trajectory.
-	err = pvtConstTrjObj.Init(axisNum);
-	showerr(err, "initializing the PvtConstAccelTrj object");
+	// the move limits are part of the cache key.
+	double moveLimits[] = { pathMaxVel, pathMaxAccel, pathMaxDecel, pathMaxJerk };
 
 	int numberOfCycles{ 1 };
 	while (numberOfCycles != 0) {
@@ -221,27 +193,37 @@ int main(void)
 
 		for (int i = 0; i < numberOfCycles; i++) {
 			
-			loadPvtPointsFromFile(pvtConstTrjObj, "XyzPoints.csv");
+			shared_ptr<PvtSoaTrj> pvtTrj = loadPvtPointsFromFile(trjCache, "XyzPoints.csv", moveLimits, 4);
+			if (pvtTrj->GetDim() != axisNum) {
+				printf("XyzPoints.csv has %d axes, %d expected\n", pvtTrj->GetDim(), axisNum);
+				return 1;
+			}
 
 			Point<3> startingPoint;
-			vector<list<double>>* posPntr = pvtConstTrjObj.getPositionsPntr();
-			startingPoint[0] = (*posPntr)[0].front();
-			startingPoint[1] = (*posPntr)[1].front();
-			startingPoint[2] = (*posPntr)[2].front();
+			startingPoint[0] = pvtTrj->GetPositions(0)[0];
+			startingPoint[1] = pvtTrj->GetPositions(1)[0];
+			startingPoint[2] = pvtTrj->GetPositions(2)[0];
 			link.MoveTo(startingPoint);
 			link.WaitMoveDone(-1);
 
 			printf("Sending trajectory to drives\n");
 
-			// send the trajectory to the linkage.
-			err = link.SendTrajectory(pvtConstTrjObj);
+			// send the trajectory to the linkage, timing the buffer refills.
+			PvtTelemetryTrj telemetry(*pvtTrj);
+			err = link.SendTrajectory(telemetry);
 			showerr(err, "sending trajectory");
 
 			// Set to -1 to wait indefinitely.
 			err = link.WaitMoveDone(-1);
+
+			telemetry.Dump(stdout);
+			telemetry.WriteCsv("PvtRefills.csv");
 		}
 	}
 
+	printf("Trajectory cache: %u memory hits, %u disk hits, %u loaded from CSV\n",
+		trjCache.GetMemoryHits(), trjCache.GetDiskHits(), trjCache.GetMisses());
+
 	printf("Program finished. Hit any key to quit\n");
 	getchar();
 
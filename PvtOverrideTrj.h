@@ -0,0 +1,367 @@
+/*
+
+PvtOverrideTrj.h
+
+The PvtOverrideTrj class adds a feed-rate override to a PVT move that is
+already running. It wraps any LinkTrajectory (PvtSoaTrj, PvtStreamTrj,
+PvtConstAccelTrj, ...) and is passed to Linkage::SendTrajectory() in its
+place.
+
+SetOverride() may be called from any thread while the move runs. A
+factor of 1.0 plays the trajectory as it was built, 0.5 plays it at half
+speed and 2.0 at double speed; the factor is kept between 0.1 and 2.0.
+Every point of the wrapped trajectory is still played, only later or
+sooner.
+
+Every segment is rescaled as CML asks for it: its time is divided by the
+factor and rounded to whole milliseconds, with the rounding carried into
+the next segment so the move time stays exact. The velocities are then
+solved again, like PvtStreamTrj does, over a window of the next
+PVT_OVERRIDE_LOOKAHEAD points with the times they will be sent with, so
+the acceleration stays continuous wherever it was in the wrapped
+trajectory. With a steady factor whose times need no rounding this is
+just the original velocities times the factor, and the path does not
+change; while the factor ramps, the path between the points is
+reshaped slightly to keep the acceleration continuous. A segment that
+would need more than 255 ms once slowed down is split into pieces on
+its cubic.
+
+The factor that is applied does not jump to a new setting. It moves
+towards it by at most SetOverrideRamp() per second of motion (0.5, or
+50% a second, by default), so the velocity of successive points changes
+gradually and a change of override does not produce a jerk spike.
+
+The drive plays the points already queued in its PVT buffer before any
+rescaled points, so an override change takes effect after the time
+that is buffered. Use a small MaximumBufferPointsToUse() on the wrapped
+trajectory, or wrap a PvtAdaptiveTrj, for a quicker response.
+
+Usage:
+
+	PvtOverrideTrj feed(trj);
+	err = link.SendTrajectory(feed);
+	...
+	feed.SetOverride(0.25);       // from an operator thread
+	...
+	err = link.WaitMoveDone(-1);
+
+*/
+
+#ifndef PVT_OVERRIDE_TRJ_H
+#define PVT_OVERRIDE_TRJ_H
+
+#include <atomic>
+#include <cmath>
+#include "CML.h"
+#include "PvtSoaTrj.h"
+
+CML_NAMESPACE_START()
+
+// Range of the feed-rate override factor.
+#define PVT_OVERRIDE_MIN 0.1
+#define PVT_OVERRIDE_MAX 2.0
+
+// Points read ahead of the current one to solve its velocity.
+#define PVT_OVERRIDE_LOOKAHEAD 8
+
+class PvtOverrideTrj : public LinkTrajectory
+{
+public:
+
+	/**
+	 * @param wrapped The trajectory to rescale.
+	 * @param factor  The override to start the move with.
+	 */
+	PvtOverrideTrj(LinkTrajectory& wrapped, double factor = 1.0) : trj(wrapped), target(1.0), appliedOut(1.0),
+		rampPerSecond(0.5), axisCt(0), applied(1.0), nextFactor(1.0), segMs(0), carryMs(0.0), subCount(0),
+		subIndex(0), first(0), winCt(0), ended(false), done(true), fetchErr(0)
+	{
+		SetOverride(factor);
+	}
+
+	virtual ~PvtOverrideTrj() {}
+
+	// Set the override factor. Safe to call from any thread while the move runs.
+	void SetOverride(double factor)
+	{
+		if (!(factor >= PVT_OVERRIDE_MIN)) factor = PVT_OVERRIDE_MIN;
+		if (factor > PVT_OVERRIDE_MAX) factor = PVT_OVERRIDE_MAX;
+		target.store(factor);
+	}
+
+	// The override factor most recently set.
+	double GetOverride(void) const { return target.load(); }
+
+	// The override factor applied to the last segment sent.
+	double GetAppliedOverride(void) const { return appliedOut.load(); }
+
+	// The largest change of the applied factor per second of motion.
+	void SetOverrideRamp(double perSecond) { rampPerSecond = (perSecond > 0.0) ? perSecond : 0.5; }
+
+	virtual int GetDim(void) { return trj.GetDim(); }
+	virtual bool UseVelocityInfo(int axis) { return trj.UseVelocityInfo(axis); }
+	virtual int MaximumBufferPointsToUse(void) { return trj.MaximumBufferPointsToUse(); }
+
+	// Called by the linkage before the first segment. The move starts at
+	// the current setting; only later changes are ramped.
+	virtual const Error* StartNew(void)
+	{
+		const Error* err = trj.StartNew();
+		if (err) return err;
+
+		axisCt = trj.GetDim();
+		if (axisCt < 1 || axisCt > PVT_SOA_MAX_AXES) return &PvtTrjError::BadAxisCount;
+
+		applied = nextFactor = target.load();
+		appliedOut.store(applied);
+		carryMs = 0.0;
+		subCount = 0;
+		subIndex = 0;
+		first = 0;
+		winCt = 0;
+		ended = false;
+		done = false;
+		fetchErr = 0;
+
+		Fill();
+		if (!winCt) return fetchErr;
+
+		for (int a = 0; a < axisCt; a++)
+			curVel[a] = Pt(0).vel[a] * applied;
+		return 0;
+	}
+
+	virtual void Finish(void)
+	{
+		done = true;
+		trj.Finish();
+	}
+
+	virtual const Error* NextSegment(uunit pos[], uunit vel[], uint8& time)
+	{
+		if (done) return &PvtTrjError::NoPoints;
+
+		const SourcePoint& cur = Pt(0);
+
+		// the last point ends the move.
+		if (!cur.time) {
+			for (int a = 0; a < axisCt; a++) {
+				pos[a] = (uunit)cur.pos[a];
+				vel[a] = (uunit)curVel[a];
+			}
+			time = 0;
+			done = true;
+			return 0;
+		}
+
+		// an error reading ahead (a starved stream for example) is
+		// returned once the points before it have been sent.
+		if (winCt < 2) return fetchErr ? fetchErr : &PvtTrjError::NoPoints;
+
+		// a new source segment: take the factor chosen for it when the
+		// last one started, solve its time and the velocity at its end,
+		// and work out how many pieces it needs to fit in 255 ms each.
+		if (!subIndex) {
+			applied = nextFactor;
+			appliedOut.store(applied);
+			SolveWindow();
+			subCount = (segMs + 254) / 255;
+		}
+
+		// the pieces are whole milliseconds adding up to the segment time.
+		int base = segMs / subCount, extra = segMs % subCount;
+		int startMs = subIndex * base + ((subIndex < extra) ? subIndex : extra);
+		time = (uint8)(base + ((subIndex < extra) ? 1 : 0));
+
+		// the point at the start of this piece, on the rescaled cubic.
+		const SourcePoint& end = Pt(1);
+		double s = (double)startMs / segMs;
+		double h = segMs * 0.001;
+		double s2 = s * s, s3 = s2 * s;
+		double h00 = 2.0 * s3 - 3.0 * s2 + 1.0, h10 = (s3 - 2.0 * s2 + s) * h;
+		double h01 = 3.0 * s2 - 2.0 * s3, h11 = (s3 - s2) * h;
+		double d00 = (6.0 * s2 - 6.0 * s) / h, d10 = 3.0 * s2 - 4.0 * s + 1.0;
+		double d01 = (6.0 * s - 6.0 * s2) / h, d11 = 3.0 * s2 - 2.0 * s;
+		for (int a = 0; a < axisCt; a++) {
+			double p = h00 * cur.pos[a] + h10 * curVel[a] + h01 * end.pos[a] + h11 * nextVel[a];
+			double v = d00 * cur.pos[a] + d10 * curVel[a] + d01 * end.pos[a] + d11 * nextVel[a];
+			pos[a] = (uunit)p;
+			vel[a] = (uunit)v;
+		}
+
+		if (++subIndex >= subCount) {
+			subIndex = 0;
+			for (int a = 0; a < axisCt; a++)
+				curVel[a] = nextVel[a];
+			first = (first + 1) % WINDOW;
+			winCt--;
+			Fill();
+		}
+		return 0;
+	}
+
+protected:
+
+	enum { WINDOW = PVT_OVERRIDE_LOOKAHEAD + 1 };
+
+	struct SourcePoint
+	{
+		double pos[PVT_SOA_MAX_AXES];
+		double vel[PVT_SOA_MAX_AXES];
+		uint8 time;
+	};
+
+	// Point j of the window; point 0 starts the current segment.
+	SourcePoint& Pt(int j) { return window[(first + j) % WINDOW]; }
+
+	// Read the wrapped trajectory until the window is full, it has ended
+	// or reading fails.
+	void Fill(void)
+	{
+		while (winCt < WINDOW && !ended && !fetchErr) {
+			SourcePoint& pt = Pt(winCt);
+			uunit p[PVT_SOA_MAX_AXES], v[PVT_SOA_MAX_AXES];
+			fetchErr = trj.NextSegment(p, v, pt.time);
+			if (fetchErr) break;
+
+			for (int a = 0; a < axisCt; a++) {
+				pt.pos[a] = (double)p[a];
+				pt.vel[a] = (double)v[a];
+			}
+			winCt++;
+			if (!pt.time) ended = true;
+		}
+	}
+
+	// The whole milliseconds a segment of timeMs source milliseconds
+	// takes at factor f, carrying the rounding into the next segment.
+	static int WholeMs(double timeMs, double f, double& carry)
+	{
+		double ms = timeMs / f + carry;
+		double whole = floor(ms + 0.5);
+		if (whole < 1.0) whole = 1.0;
+		carry = ms - whole;
+		return (int)whole;
+	}
+
+	// The factor after a segment of timeMs source milliseconds played
+	// at factor f, moving towards want.
+	double Ramp(double f, double timeMs, double want) const
+	{
+		double step = rampPerSecond * timeMs * 0.001 / f;
+		if (want > f + step) return f + step;
+		if (want < f - step) return f - step;
+		return want;
+	}
+
+	/**
+	 * Solve the time of the current segment and the velocity at its end
+	 * over the window, with the segment times rescaled by the factors
+	 * the ramp will reach on them and rounded to whole milliseconds as
+	 * they will be sent. The velocity at its start (already sent) is
+	 * fixed, and the window ends with the source velocity of its last
+	 * point rescaled.
+	 *
+	 * Every point keeps the source's acceleration jump (zero where the
+	 * source velocities were solved for continuous acceleration), scaled
+	 * by the factors either side of it. With one factor throughout, and
+	 * times that need no rounding, this gives exactly the source
+	 * velocities times that factor, so the path is only reshaped between
+	 * the points while the factor is changing. The results are left in
+	 * segMs, carryMs, nextVel[] and nextFactor.
+	 */
+	void SolveWindow(void)
+	{
+		int m = winCt - 1;      // last point of the window
+		double want = target.load();
+
+		// factor and inverse times (1/s), source and as sent, of each
+		// segment of the window. f becomes the factor the rounded time
+		// gives.
+		double f[WINDOW], invH[WINDOW], invS[WINDOW];
+		double factor = applied, carry = carryMs;
+		for (int j = 0; j < m; j++) {
+			if (j) factor = Ramp(factor, Pt(j - 1).time, want);
+			if (j == 1) nextFactor = factor;
+
+			int ms = WholeMs(Pt(j).time, factor, carry);
+			if (!j) {
+				segMs = ms;
+				carryMs = carry;
+			}
+			invS[j] = 1000.0 / Pt(j).time;
+			invH[j] = 1000.0 / ms;
+			f[j] = invH[j] / invS[j];
+		}
+		if (m < 2) nextFactor = Ramp(applied, Pt(0).time, want);
+
+		// factor the window. Row k is the equation for point k+1.
+		int u = m - 1;
+		double lower[WINDOW], upper[WINDOW], invPivot[WINDOW], rhs[WINDOW];
+		double prevUpper = 0.0;
+		for (int k = 0; k < u; k++) {
+			lower[k] = (k > 0) ? invH[k] : 0.0;
+			double pivot = 2.0 * (invH[k] + invH[k + 1]) - lower[k] * prevUpper;
+			invPivot[k] = 1.0 / pivot;
+			upper[k] = invH[k + 1] * invPivot[k];
+			prevUpper = upper[k];
+		}
+
+		for (int a = 0; a < axisCt; a++) {
+			double endVel = Pt(m).vel[a] * f[m - 1];
+			if (!u) {
+				nextVel[a] = endVel;
+				continue;
+			}
+
+			double prev = 0.0;
+			for (int k = 0; k < u; k++) {
+				const SourcePoint& p0 = Pt(k);
+				const SourcePoint& p1 = Pt(k + 1);
+				const SourcePoint& p2 = Pt(k + 2);
+				double d0 = p1.pos[a] - p0.pos[a], d1 = p2.pos[a] - p1.pos[a];
+
+				// half the source's acceleration jump at the point.
+				double jump = invS[k] * p0.vel[a] + 2.0 * (invS[k] + invS[k + 1]) * p1.vel[a] + invS[k + 1] * p2.vel[a]
+					- 3.0 * (d0 * invS[k] * invS[k] + d1 * invS[k + 1] * invS[k + 1]);
+
+				double r = 3.0 * (d0 * invH[k] * invH[k] + d1 * invH[k + 1] * invH[k + 1]) + f[k] * f[k + 1] * jump;
+				if (k == 0) r -= invH[0] * curVel[a];
+				if (k == u - 1) r -= invH[u] * endVel;
+				prev = (r - lower[k] * prev) * invPivot[k];
+				rhs[k] = prev;
+			}
+
+			for (int k = u - 1; k > 0; k--)
+				rhs[k - 1] -= upper[k - 1] * rhs[k];
+
+			nextVel[a] = rhs[0];
+		}
+	}
+
+	LinkTrajectory& trj;
+	std::atomic<double> target;       // factor set by SetOverride()
+	std::atomic<double> appliedOut;   // copy of applied for other threads
+	double rampPerSecond;
+
+	// used only by the thread that calls NextSegment()
+	int axisCt;
+	double applied;                   // factor used for the current segment
+	double nextFactor;                // factor chosen for the next segment
+	int segMs;                        // rescaled time of the current segment
+	double carryMs;                   // rounding carried to the next segment
+	int subCount;                     // pieces the current segment is split into
+	int subIndex;                     // next piece to send
+	double curVel[PVT_SOA_MAX_AXES];  // rescaled velocity at the segment start
+	double nextVel[PVT_SOA_MAX_AXES]; // rescaled velocity at the segment end
+	SourcePoint window[WINDOW];       // source points read ahead
+	int first;                        // window slot of the current point
+	int winCt;                        // points in the window
+	bool ended;                       // the last source point has been read
+	bool done;
+	const Error* fetchErr;            // error from reading ahead
+};
+
+CML_NAMESPACE_END()
+
+#endif
@@ -0,0 +1,469 @@
+/*
+
+PvtRetimer.h
+
+The PvtRetimer class chooses the time of every PVT segment for a list
+of positions, instead of using one hand-picked time between points.
+
+The examples space their points with a fixed time (10, 15, 50 or 250
+ms) that has to be safe for the fastest part of the path, so the rest
+of the path runs slower than it needs to. The retimer gives each
+segment the shortest whole number of milliseconds (1 to 255) for
+which the PVT path stays inside the same limits that are passed to
+Linkage::SetMoveLimits():
+
+- velocity:     the largest speed along the segment,
+- acceleration: the acceleration at the ends of the segment (the
+                acceleration of a PVT cubic is linear, so its ends are
+                the extremes) when it is in the direction of motion,
+- deceleration: the same, when it is against the direction of motion,
+- jerk:         the (constant) jerk of the segment.
+
+Like the linkage, the limits apply to the vector of all axes, not to
+each axis on its own.
+
+The jerk limits in the examples are sized for S-curve moves and are
+far below the jerk of a PVT cubic at any practical spacing, so
+retiming against them gives very long segments. Pass 0 to skip the
+jerk check.
+
+The velocities of PVT points depend on the times of the neighbouring
+segments, so the times are found iteratively. Every segment starts at
+the time needed to cover its length at the velocity limit. Then the
+velocities are calculated (see PvtSoaTrj) and every segment that breaks
+a limit is stretched by the ratio needed to bring it back inside (the
+ratio for the velocity, the square root of it for acceleration and the
+cube root for jerk). This repeats until no segment breaks a limit.
+Segments that end up well inside the limits are then shortened and the
+stretching is repeated, for a few rounds, keeping the set of times
+with the fewest segments over the limits and, of those, the shortest
+move. The result is a good fit rather than a proven optimum.
+
+Repeated positions (dwells) have no length, so there is nothing to fit
+them to. They keep the time they were recorded with, so the path pauses
+for as long as it did before, and only the moves are made faster.
+Passing no recorded times collapses every dwell to 1 ms instead, which
+changes the motion and should only be done on purpose.
+
+A segment can still break a limit if it would need more than 255 ms;
+GetViolations() counts them.
+
+Usage:
+
+	PvtRetimer retimer;
+	retimer.SetLimits(maxVel, maxAccel, maxDecel, maxJerk);
+
+	PvtSoaTrj trj;
+	err = retimer.Retime(positions, times, pointCount, axisCount, trj);
+	printf("move time %u ms\n", retimer.GetTotalTime());
+
+*/
+
+#ifndef PVT_RETIMER_H
+#define PVT_RETIMER_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "CML.h"
+#include "PvtSoaTrj.h"
+
+CML_NAMESPACE_START()
+
+class PvtRetimer
+{
+public:
+
+	PvtRetimer() : maxVel(0), maxAccel(0), maxDecel(0), maxJerk(0), maxIterations(200),
+		maxRounds(8), iterations(0), violations(0), totalTime(0) {}
+
+	/**
+	 * Set the limits the retimed path must stay within, in the same units
+	 * as Linkage::SetMoveLimits(). A limit of zero is not checked, except
+	 * for the velocity which must be set.
+	 *
+	 * @param vel   Velocity limit.
+	 * @param acc   Acceleration limit.
+	 * @param dec   Deceleration limit.
+	 * @param jrk   Jerk limit.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* SetLimits(double vel, double acc, double dec, double jrk)
+	{
+		if (!(vel > 0.0) || acc < 0.0 || dec < 0.0 || jrk < 0.0)
+			return &PvtTrjError::BadPointData;
+
+		maxVel = vel;
+		maxAccel = acc;
+		maxDecel = dec;
+		maxJerk = jrk;
+		return 0;
+	}
+
+	// Limit the number of solve / stretch passes.
+	void SetMaxIterations(int passes) { maxIterations = (passes > 0) ? passes : 1; }
+
+	/**
+	 * Find the segment times for a list of positions and load the result
+	 * into a PvtSoaTrj object. The trajectory is initialized with axisNum
+	 * axes and its velocities are already calculated when this returns.
+	 *
+	 * @param pointPositions Positions stored point by point, axisNum
+	 *                       values per point: { A0, B0, A1, B1, ... }.
+	 * @param pointTimes     The recorded time (ms) of each segment. Dwells
+	 *                       keep this time. NULL to give dwells 1 ms.
+	 * @param pointCt        The number of points.
+	 * @param axisNum        The number of axes.
+	 * @param out            The trajectory to fill.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Retime(const double* pointPositions, const uint8* pointTimes, size_t pointCt, int axisNum,
+		PvtSoaTrj& out)
+	{
+		if (axisNum < 1 || axisNum > PVT_SOA_MAX_AXES) return &PvtTrjError::BadAxisCount;
+		if (!pointCt) return &PvtTrjError::NoPoints;
+		if (!pointPositions || !(maxVel > 0.0)) return &PvtTrjError::BadPointData;
+
+		const Error* err = out.Init(axisNum);
+		if (err) return err;
+
+		axisCt = axisNum;
+		iterations = 0;
+
+		// start with the time needed to cover each segment at the velocity
+		// limit, and dwells at their recorded time, which they are never
+		// shortened below. The time of the last point is never sent.
+		times.assign(pointCt, 1);
+		minTimes.assign(pointCt, 1);
+		for (size_t i = 0; i + 1 < pointCt; i++) {
+			double len = Distance(pointPositions + i * axisCt, pointPositions + (i + 1) * axisCt);
+			if (len == 0.0 && pointTimes && pointTimes[i])
+				minTimes[i] = pointTimes[i];
+			times[i] = ClampTime(ceil(len / maxVel * 1000.0 - 1e-9));
+			if (times[i] < minTimes[i]) times[i] = minTimes[i];
+		}
+
+		// stretch until every segment is inside the limits, then shrink the
+		// segments that have room to spare and stretch again. Keep the set
+		// of times with the fewest violations, then the shortest.
+		std::vector<uint8> bestTimes;
+		uint32 bestTotal = 0xffffffff;
+		uint32 bestViolations = 0;
+
+		for (int round = 0; round < maxRounds; round++) {
+			err = SolveAndStretch(pointPositions, pointCt, out);
+			if (err) return err;
+
+			uint32 total = 0;
+			for (size_t i = 0; i + 1 < pointCt; i++)
+				total += times[i];
+
+			bool better = bestTimes.empty() || violations < bestViolations ||
+				(violations == bestViolations && total < bestTotal);
+			if (!better) break;
+			bestTotal = total;
+			bestTimes = times;
+			bestViolations = violations;
+
+			if (!ShrinkSegments(out)) break;
+		}
+
+		times = bestTimes;
+		totalTime = bestTotal;
+		violations = bestViolations;
+
+		out.Clear();
+		err = out.addPvtPoints(pointPositions, times.data(), pointCt);
+		if (!err) err = out.CalcVelocities();
+		return err;
+	}
+
+	/**
+	 * Count the segments of an existing trajectory that break the limits,
+	 * for example to check a hand-picked time between points. The
+	 * velocities are calculated if needed.
+	 */
+	uint32 CountViolations(PvtSoaTrj& trj)
+	{
+		if (!trj.GetPointCount() || trj.GetDim() < 1) return 0;
+		if (!trj.HasVelocities() && trj.CalcVelocities()) return 0;
+
+		axisCt = trj.GetDim();
+		size_t n = trj.GetPointCount();
+		const uint8* t = trj.GetTimes();
+		const double* pos[PVT_SOA_MAX_AXES];
+		const double* vel[PVT_SOA_MAX_AXES];
+		for (int a = 0; a < axisCt; a++) {
+			pos[a] = trj.GetPositions(a);
+			vel[a] = trj.GetVelocities(a);
+		}
+
+		uint32 count = 0;
+		for (size_t i = 0; i + 1 < n; i++) {
+			if (SegmentRatio(pos, vel, i, t[i] * 0.001) > 1.0 + 1e-9) count++;
+		}
+		return count;
+	}
+
+	// The segment times found by the last Retime() call.
+	const std::vector<uint8>& GetTimes(void) const { return times; }
+
+	// The total move time (ms) found by the last Retime() call.
+	uint32 GetTotalTime(void) const { return totalTime; }
+
+	// The number of solve / stretch passes the last Retime() call took.
+	int GetIterations(void) const { return iterations; }
+
+	// The number of segments that still break a limit, because they would
+	// need more than 255 ms or the iteration limit was reached.
+	uint32 GetViolations(void) const { return violations; }
+
+protected:
+
+	// Solve the velocities and stretch the segments that break a limit
+	// until none do.
+	const Error* SolveAndStretch(const double* pointPositions, size_t pointCt, PvtSoaTrj& out)
+	{
+		while (true) {
+			iterations++;
+
+			out.Clear();
+			const Error* err = out.addPvtPoints(pointPositions, times.data(), pointCt);
+			if (!err) err = out.CalcVelocities();
+			if (err) return err;
+
+			if (!StretchSegments(out, iterations < maxIterations) || iterations >= maxIterations)
+				return 0;
+		}
+	}
+
+	// Shorten every segment that is well inside the limits by the ratio
+	// that would put it on the limit, but not below its minimum time.
+	// Returns true if any time changed.
+	bool ShrinkSegments(PvtSoaTrj& out)
+	{
+		bool changed = false;
+
+		size_t n = out.GetPointCount();
+		const double* pos[PVT_SOA_MAX_AXES];
+		const double* vel[PVT_SOA_MAX_AXES];
+		for (int a = 0; a < axisCt; a++) {
+			pos[a] = out.GetPositions(a);
+			vel[a] = out.GetVelocities(a);
+		}
+
+		for (size_t i = 0; i + 1 < n; i++) {
+			double ratio = SegmentRatio(pos, vel, i, times[i] * 0.001);
+			if (ratio > 0.97) continue;
+
+			uint8 t = ClampTime(ceil(times[i] * ratio - 1e-9));
+			if (t < minTimes[i]) t = minTimes[i];
+			if (t < times[i]) {
+				times[i] = t;
+				changed = true;
+			}
+		}
+
+		return changed;
+	}
+
+	static uint8 ClampTime(double ms)
+	{
+		if (ms < 1.0) return 1;
+		if (ms > 255.0) return 255;
+		return (uint8)ms;
+	}
+
+	double Distance(const double* p0, const double* p1) const
+	{
+		double sum = 0.0;
+		for (int a = 0; a < axisCt; a++)
+			sum += (p1[a] - p0[a]) * (p1[a] - p0[a]);
+		return sqrt(sum);
+	}
+
+	/**
+	 * Check every segment against the limits and stretch the ones that are
+	 * outside them.
+	 *
+	 * @param stretch false to only count the violations.
+	 * @return true if any segment time was changed.
+	 */
+	bool StretchSegments(PvtSoaTrj& out, bool stretch)
+	{
+		bool changed = false;
+		violations = 0;
+
+		size_t n = out.GetPointCount();
+		const double* pos[PVT_SOA_MAX_AXES];
+		const double* vel[PVT_SOA_MAX_AXES];
+		for (int a = 0; a < axisCt; a++) {
+			pos[a] = out.GetPositions(a);
+			vel[a] = out.GetVelocities(a);
+		}
+
+		for (size_t i = 0; i + 1 < n; i++) {
+			double ratio = SegmentRatio(pos, vel, i, times[i] * 0.001);
+			if (ratio <= 1.0 + 1e-9) continue;
+
+			if (stretch && times[i] < 255) {
+				double t = ceil(times[i] * ratio - 1e-9);
+				if (t < times[i] + 1.0) t = times[i] + 1.0;
+				times[i] = ClampTime(t);
+				changed = true;
+			}
+			else {
+				violations++;
+			}
+		}
+
+		return changed;
+	}
+
+	static double Cubic(const double g[4], double s)
+	{
+		return ((g[3] * s + g[2]) * s + g[1]) * s + g[0];
+	}
+
+	/**
+	 * Find the roots of g[0] + g[1]*s + g[2]*s^2 + g[3]*s^3 between 0 and
+	 * 1. The turning points of the cubic split [0,1] into pieces on which
+	 * it is monotonic, and a piece whose ends differ in sign holds one
+	 * root, found by bisection.
+	 *
+	 * @return The number of roots stored in roots (at most 3).
+	 */
+	static int CubicRoots(const double g[4], double roots[3])
+	{
+		// turning points, the roots of 3*g[3]*s^2 + 2*g[2]*s + g[1].
+		double qa = 3.0 * g[3], qb = 2.0 * g[2], qc = g[1];
+		double split[4] = { 0.0 };
+		int splitCt = 1;
+		if (qa != 0.0) {
+			double disc = qb * qb - 4.0 * qa * qc;
+			if (disc > 0.0) {
+				double root = sqrt(disc);
+				double t0 = (-qb - root) / (2.0 * qa), t1 = (-qb + root) / (2.0 * qa);
+				if (t0 > t1) { double t = t0; t0 = t1; t1 = t; }
+				if (t0 > 0.0 && t0 < 1.0) split[splitCt++] = t0;
+				if (t1 > 0.0 && t1 < 1.0) split[splitCt++] = t1;
+			}
+		}
+		else if (qb != 0.0) {
+			double t = -qc / qb;
+			if (t > 0.0 && t < 1.0) split[splitCt++] = t;
+		}
+		split[splitCt] = 1.0;
+
+		int rootCt = 0;
+		for (int k = 0; k < splitCt; k++) {
+			double lo = split[k], hi = split[k + 1];
+			double glo = Cubic(g, lo), ghi = Cubic(g, hi);
+			if ((glo > 0.0) == (ghi > 0.0)) continue;
+
+			for (int n = 0; n < 50; n++) {
+				double mid = 0.5 * (lo + hi);
+				double gmid = Cubic(g, mid);
+				if ((gmid > 0.0) == (glo > 0.0)) { lo = mid; glo = gmid; }
+				else hi = mid;
+			}
+			roots[rootCt++] = 0.5 * (lo + hi);
+		}
+		return rootCt;
+	}
+
+	/**
+	 * Return the factor segment i must be stretched by to meet the limits,
+	 * or a value of 1 or less if it already does.
+	 *
+	 * The segment is p(s) = c0 + c1*s + c2*s^2 + c3*s^3 with s from 0 to 1
+	 * over h seconds, so velocity is p'(s)/h, acceleration p''(s)/h^2 and
+	 * jerk p'''(s)/h^3.
+	 */
+	double SegmentRatio(const double* const pos[], const double* const vel[], size_t i, double h)
+	{
+		double c1[PVT_SOA_MAX_AXES], c2[PVT_SOA_MAX_AXES], c3[PVT_SOA_MAX_AXES];
+		for (int a = 0; a < axisCt; a++) {
+			double dp = pos[a][i + 1] - pos[a][i];
+			c1[a] = h * vel[a][i];
+			c2[a] = 3.0 * dp - h * (2.0 * vel[a][i] + vel[a][i + 1]);
+			c3[a] = -2.0 * dp + h * (vel[a][i] + vel[a][i + 1]);
+		}
+
+		// velocity, at the ends and wherever the speed peaks in between.
+		// With v(s) = c1 + 2*c2*s + 3*c3*s^2 on every axis, the speed
+		// squared peaks where the cubic g(s) = sum of v*v'/2 is zero.
+		double g[4] = { 0.0, 0.0, 0.0, 0.0 };
+		for (int a = 0; a < axisCt; a++) {
+			double b = 2.0 * c2[a], c = 3.0 * c3[a];
+			g[0] += c1[a] * b;
+			g[1] += 2.0 * c1[a] * c + b * b;
+			g[2] += 3.0 * b * c;
+			g[3] += 2.0 * c * c;
+		}
+
+		double at[5] = { 0.0, 1.0 };
+		int atCt = 2 + CubicRoots(g, at + 2);
+
+		double peakVel = 0.0;
+		for (int k = 0; k < atCt; k++) {
+			double s = at[k];
+			double sum = 0.0;
+			for (int a = 0; a < axisCt; a++) {
+				double v = (c1[a] + 2.0 * c2[a] * s + 3.0 * c3[a] * s * s) / h;
+				sum += v * v;
+			}
+			if (sum > peakVel) peakVel = sum;
+		}
+		double ratio = sqrt(peakVel) / maxVel;
+
+		// acceleration and deceleration, at both ends.
+		for (int end = 0; end < 2; end++) {
+			double aa = 0.0, av = 0.0;
+			for (int a = 0; a < axisCt; a++) {
+				double v = end ? (c1[a] + 2.0 * c2[a] + 3.0 * c3[a]) / h : c1[a] / h;
+				double acc = end ? (2.0 * c2[a] + 6.0 * c3[a]) / (h * h) : 2.0 * c2[a] / (h * h);
+				aa += acc * acc;
+				av += acc * v;
+			}
+
+			double limit = (av >= 0.0) ? maxAccel : maxDecel;
+			if (limit > 0.0) {
+				double r = sqrt(sqrt(aa) / limit);
+				if (r > ratio) ratio = r;
+			}
+		}
+
+		// jerk
+		if (maxJerk > 0.0) {
+			double jj = 0.0;
+			for (int a = 0; a < axisCt; a++) {
+				double j = 6.0 * c3[a] / (h * h * h);
+				jj += j * j;
+			}
+			double r = cbrt(sqrt(jj) / maxJerk);
+			if (r > ratio) ratio = r;
+		}
+
+		return ratio;
+	}
+
+	double maxVel;
+	double maxAccel;
+	double maxDecel;
+	double maxJerk;
+	int maxIterations;
+	int maxRounds;
+
+	int axisCt;
+	int iterations;
+	uint32 violations;
+	uint32 totalTime;
+
+	std::vector<uint8> times;
+	std::vector<uint8> minTimes;    // recorded time of dwells, else 1
+};
+
+CML_NAMESPACE_END()
+
+#endif
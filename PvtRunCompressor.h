@@ -0,0 +1,345 @@
+/*
+
+PvtRunCompressor.h
+
+The PvtRunCompressor class removes the points of a PVT trajectory that
+only repeat a dwell or a constant velocity, without changing the
+motion those parts describe.
+
+Sampled trajectories often hold the axes still for a while, or move
+them at a constant speed, for many points in a row. The positions in
+StartPvtPositions.h, for example, dwell for 36 to 40 points of 50 ms
+at each end of the stroke. Every one of those points costs a PVT
+buffer message per axis on the network and a refill on the host,
+because a point can hold at most 255 ms.
+
+The compressor looks for runs of two or more segments with the same
+time and the same change in position on every axis (within
+SetTolerance()):
+
+- a dwell, where the change is zero, and
+- a constant velocity run, where it is not.
+
+Each run is replaced by its first and last point plus the fewest
+points in between that keep every segment at 255 ms or less, spread
+evenly over the run. The points of a run have their velocity pinned
+to the run's velocity (zero for a dwell), so the cubic of every segment
+in the run is a straight line and the run is played exactly as sampled.
+All other points are kept as they are, and their velocities are solved
+like PvtSoaTrj does between the pinned points. A constant velocity run
+never includes the first or last point, since the move starts and ends
+at rest, and never the first point of a dwell. The single segment that
+joins two runs goes straight from one velocity to the other.
+
+The result can be written to a PvtSoaTrj, or read back point by point
+and added to a PvtStreamTrj with the pinned velocities (see
+PvtStreamTrj.h).
+
+Usage:
+
+	PvtRunCompressor compressor;
+	PvtSoaTrj trj;
+	err = compressor.Compress(positions, 50, pointCount, axisCount, trj);
+	printf("%.1f to 1 fewer points\n", compressor.GetReduction());
+
+*/
+
+#ifndef PVT_RUN_COMPRESSOR_H
+#define PVT_RUN_COMPRESSOR_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "CML.h"
+#include "PvtSoaTrj.h"
+
+CML_NAMESPACE_START()
+
+class PvtRunCompressor
+{
+public:
+
+	PvtRunCompressor() : tolerance(1e-6), axisCt(0), inputPoints(0), dwellRuns(0), linearRuns(0) {}
+
+	// Changes in position closer than this (position units) are taken as equal.
+	void SetTolerance(double tol) { tolerance = (tol >= 0.0) ? tol : 0.0; }
+
+	/**
+	 * Find the dwells and constant velocity runs of a trajectory and build
+	 * the compressed point list. Read it back with GetPointCount(),
+	 * GetPosition(), GetTime() and GetPinnedVelocity().
+	 *
+	 * @param pointPositions Positions stored point by point, axisNum values
+	 *                       per point: { A0, B0, A1, B1, ... }.
+	 * @param pointTimes     One time (ms) per point, the time to the next point.
+	 * @param pointCt        The number of points.
+	 * @param axisNum        The number of axes.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Compress(const double* pointPositions, const uint8* pointTimes, size_t pointCt, int axisNum)
+	{
+		if (axisNum < 1 || axisNum > PVT_SOA_MAX_AXES) return &PvtTrjError::BadAxisCount;
+		if (!pointCt) return &PvtTrjError::NoPoints;
+		if (!pointPositions || !pointTimes) return &PvtTrjError::BadPointData;
+
+		for (size_t i = 0; i + 1 < pointCt; i++) {
+			if (pointTimes[i] == 0) return &PvtTrjError::BadPointTime;
+		}
+
+		src = pointPositions;
+		axisCt = axisNum;
+		inputPoints = pointCt;
+		dwellRuns = 0;
+		linearRuns = 0;
+
+		outPos.clear();
+		outVel.clear();
+		outTimes.clear();
+		outPinned.clear();
+
+		size_t i = 0;
+		while (i < pointCt) {
+			size_t end = (i + 1 < pointCt) ? RunEnd(pointTimes, i) : i;
+			if (end >= i + 2) {
+				AddRun(pointTimes[i], i, end);
+				outTimes.back() = (end + 1 < pointCt) ? pointTimes[end] : 0;
+				i = end + 1;
+			}
+			else {
+				AddPoint(Src(i), (i + 1 < pointCt) ? pointTimes[i] : 0, 0);
+				i++;
+			}
+		}
+
+		// the move starts and ends at rest.
+		SetPinned(0, 0);
+		SetPinned(outTimes.size() - 1, 0);
+		return 0;
+	}
+
+	// Compress a trajectory with the same time between every point.
+	const Error* Compress(const double* pointPositions, uint8 pointTime, size_t pointCt, int axisNum)
+	{
+		std::vector<uint8> pointTimes(pointCt, pointTime);
+		return Compress(pointPositions, pointTimes.data(), pointCt, axisNum);
+	}
+
+	/**
+	 * Compress a trajectory into a PvtSoaTrj object, with the velocities
+	 * of all of the points already set.
+	 *
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Compress(const double* pointPositions, const uint8* pointTimes, size_t pointCt, int axisNum, PvtSoaTrj& out)
+	{
+		const Error* err = Compress(pointPositions, pointTimes, pointCt, axisNum);
+		if (!err) err = out.Init(axisNum);
+		if (err) return err;
+
+		size_t n = outTimes.size();
+		std::vector<std::vector<double> > pos(axisCt, std::vector<double>(n)), vel(axisCt, std::vector<double>(n));
+		const double* posPtr[PVT_SOA_MAX_AXES];
+		const double* velPtr[PVT_SOA_MAX_AXES];
+		for (int a = 0; a < axisCt; a++) {
+			for (size_t i = 0; i < n; i++)
+				pos[a][i] = outPos[i * axisCt + a];
+			SolveAxis(pos[a].data(), vel[a].data(), a);
+			posPtr[a] = pos[a].data();
+			velPtr[a] = vel[a].data();
+		}
+		return out.SetSolvedPoints(posPtr, velPtr, outTimes.data(), n);
+	}
+
+	// Compress a trajectory with the same time between every point into a PvtSoaTrj object.
+	const Error* Compress(const double* pointPositions, uint8 pointTime, size_t pointCt, int axisNum, PvtSoaTrj& out)
+	{
+		std::vector<uint8> pointTimes(pointCt, pointTime);
+		return Compress(pointPositions, pointTimes.data(), pointCt, axisNum, out);
+	}
+
+	// The number of points in the compressed trajectory.
+	size_t GetPointCount(void) const { return outTimes.size(); }
+
+	// The positions of compressed point i, one per axis.
+	const double* GetPosition(size_t i) const { return &outPos[i * axisCt]; }
+
+	// The time (ms) from compressed point i to the next. Zero for the last point.
+	uint8 GetTime(size_t i) const { return outTimes[i]; }
+
+	// The velocities of compressed point i if they are pinned, or NULL.
+	const double* GetPinnedVelocity(size_t i) const { return outPinned[i] ? &outVel[i * axisCt] : 0; }
+
+	// The number of points passed to the last Compress() call.
+	size_t GetInputPoints(void) const { return inputPoints; }
+
+	// The number of points kept by the last Compress() call.
+	size_t GetOutputPoints(void) const { return outTimes.size(); }
+
+	// The number of dwells found by the last Compress() call.
+	int GetDwellRuns(void) const { return dwellRuns; }
+
+	// The number of constant velocity runs found by the last Compress() call.
+	int GetLinearRuns(void) const { return linearRuns; }
+
+	// Input points per output point, 1.0 if nothing was removed.
+	double GetReduction(void) const { return outTimes.size() ? (double)inputPoints / outTimes.size() : 1.0; }
+
+	// The fraction of the PVT bandwidth saved, 0.0 to 1.0.
+	double GetBandwidthSaved(void) const { return inputPoints ? 1.0 - (double)outTimes.size() / inputPoints : 0.0; }
+
+	// The number of PVT buffer bytes saved on the network.
+	uint64 GetBytesSaved(void) const
+	{
+		return (uint64)(inputPoints - outTimes.size()) * axisCt * PVT_SEGMENT_MESSAGE_BYTES;
+	}
+
+protected:
+
+	const double* Src(size_t i) const { return src + i * axisCt; }
+
+	bool SamePoint(const double* p0, const double* p1) const
+	{
+		for (int a = 0; a < axisCt; a++) {
+			if (fabs(p1[a] - p0[a]) > tolerance) return false;
+		}
+		return true;
+	}
+
+	/**
+	 * Return the index of the last point of the run that starts at point
+	 * i: the segments after i that have the same time and the same change
+	 * in position as segment i.
+	 */
+	size_t RunEnd(const uint8* t, size_t i) const
+	{
+		size_t end = i + 1;
+		while (end + 1 < inputPoints && t[end] == t[i]) {
+			bool same = true;
+			for (int a = 0; a < axisCt && same; a++) {
+				double d0 = Src(i + 1)[a] - Src(i)[a];
+				double d1 = Src(end + 1)[a] - Src(end)[a];
+				same = fabs(d1 - d0) <= tolerance;
+			}
+			if (!same) break;
+			end++;
+		}
+
+		// a constant velocity run must not touch the ends of the move,
+		// which are at rest, or the first point of a dwell, which is
+		// left for the dwell so the axes are at rest for all of it.
+		if (!SamePoint(Src(i), Src(i + 1))) {
+			if (i == 0) return i;
+			if (end == inputPoints - 1 || SamePoint(Src(end), Src(end + 1))) end--;
+		}
+		return end;
+	}
+
+	// Replace the run from point first to point last with the fewest
+	// points that keep every segment at 255 ms or less.
+	void AddRun(uint8 t, size_t first, size_t last)
+	{
+		double vel[PVT_SOA_MAX_AXES];
+		bool dwell = SamePoint(Src(first), Src(last));
+		for (int a = 0; a < axisCt; a++)
+			vel[a] = (Src(first + 1)[a] - Src(first)[a]) * 1000.0 / t;
+		if (dwell) dwellRuns++;
+		else linearRuns++;
+
+		uint32 totalMs = (uint32)(last - first) * t;
+		uint32 pieces = (totalMs + 254) / 255;
+
+		double pos[PVT_SOA_MAX_AXES];
+		uint32 elapsed = 0;
+		for (uint32 k = 0; k < pieces; k++) {
+			uint32 ms = totalMs / pieces + ((k < totalMs % pieces) ? 1 : 0);
+			for (int a = 0; a < axisCt; a++)
+				pos[a] = Src(first)[a] + vel[a] * elapsed * 0.001;
+			AddPoint(pos, (uint8)ms, vel);
+			elapsed += ms;
+		}
+
+		// the last point of the run. The caller sets the time of the
+		// segment after it.
+		AddPoint(Src(last), 0, vel);
+	}
+
+	void AddPoint(const double* pos, uint8 time, const double* vel)
+	{
+		outPos.insert(outPos.end(), pos, pos + axisCt);
+		for (int a = 0; a < axisCt; a++)
+			outVel.push_back(vel ? vel[a] : 0.0);
+		outTimes.push_back(time);
+		outPinned.push_back(vel ? 1 : 0);
+	}
+
+	void SetPinned(size_t i, double vel)
+	{
+		for (int a = 0; a < axisCt; a++)
+			outVel[i * axisCt + a] = vel;
+		outPinned[i] = 1;
+	}
+
+	/**
+	 * Solve the velocities of one axis of the compressed points. Each span
+	 * between two pinned points is a clamped cubic spline with the pinned
+	 * velocities at its ends (see PvtSoaTrj::BuildFactors()).
+	 */
+	void SolveAxis(const double* p, double* v, int axis)
+	{
+		size_t n = outTimes.size();
+		invH.resize(n);
+		upper.resize(n);
+		for (size_t i = 0; i + 1 < n; i++)
+			invH[i] = 1000.0 / outTimes[i];
+
+		size_t first = 0;
+		v[0] = outVel[axis];
+		while (first + 1 < n) {
+			size_t last = first + 1;
+			while (!outPinned[last]) last++;
+			v[last] = outVel[last * axisCt + axis];
+
+			// forward sweep over the free points first+1 .. last-1.
+			double prevUpper = 0.0;
+			for (size_t i = first + 1; i < last; i++) {
+				double lower = (i > first + 1) ? invH[i - 1] : 0.0;
+				double invPivot = 1.0 / (2.0 * (invH[i - 1] + invH[i]) - lower * prevUpper);
+				double rhs = 3.0 * ((p[i] - p[i - 1]) * invH[i - 1] * invH[i - 1] + (p[i + 1] - p[i]) * invH[i] * invH[i]);
+				if (i == first + 1) rhs -= invH[i - 1] * v[first];
+				if (i + 1 == last) rhs -= invH[i] * v[last];
+				v[i] = (rhs - ((i > first + 1) ? lower * v[i - 1] : 0.0)) * invPivot;
+				upper[i] = (i + 1 < last) ? invH[i] * invPivot : 0.0;
+				prevUpper = upper[i];
+			}
+
+			// back substitution.
+			for (size_t i = last - 1; i > first + 1; i--)
+				v[i - 1] -= upper[i - 1] * v[i];
+
+			first = last;
+		}
+	}
+
+	double tolerance;
+
+	// the trajectory being compressed
+	const double* src;
+	int axisCt;
+	size_t inputPoints;
+	int dwellRuns;
+	int linearRuns;
+
+	// the compressed points
+	std::vector<double> outPos;      // axisCt values per point
+	std::vector<double> outVel;      // axisCt values per point, used if pinned
+	std::vector<uint8> outTimes;
+	std::vector<uint8> outPinned;
+
+	// solver scratch space
+	std::vector<double> invH;
+	std::vector<double> upper;
+};
+
+CML_NAMESPACE_END()
+
+#endif
@@ -0,0 +1,396 @@
+/*
+
+PvtSoaTrj.h
+
+The PvtSoaTrj class is a drop-in alternative to CML's PvtConstAccelTrj
+class for large PVT streams (tens of thousands of points and more).
+
+PvtConstAccelTrj stores the positions of each axis in a linked list, so
+every addPvtPoint() call allocates one list node per axis. PvtSoaTrj
+stores the trajectory as a structure of arrays instead: one contiguous
+buffer of positions per axis, one buffer of velocities per axis and a
+single buffer of segment times shared by all axes. Points can still be
+added one at a time with addPvtPoint(), or a whole block of points can
+be appended with a single call to addPvtPoints().
+
+The velocities are calculated the same way PvtConstAccelTrj does it:
+the trajectory starts and ends at rest and the velocity of every other
+point is chosen so that acceleration is continuous across each point
+(a clamped cubic spline through the positions). The linear system this
+produces only depends on the segment times, so it is factored once and
+then solved for every axis with a single forward and backward sweep.
+By default the axes are solved several at a time in SIMD registers
+(see PvtBatchSolver.h); UseBatchSolver(false) solves them one by one.
+
+Usage:
+
+	PvtSoaTrj trj;
+	err = trj.Init(2);
+
+	// positions are stored point by point: { A0, B0, A1, B1, A2, B2, ... }
+	err = trj.addPvtPoints(positions, times, pointCount);
+
+	err = link.SendTrajectory(trj);
+
+*/
+
+#ifndef PVT_SOA_TRJ_H
+#define PVT_SOA_TRJ_H
+
+#include <cstddef>
+#include <vector>
+#include "CML.h"
+#include "PvtBatchSolver.h"
+
+CML_NAMESPACE_START()
+
+// Errors returned by the PVT trajectory helpers in this repository.
+class PvtTrjError : public Error
+{
+public:
+	static const PvtTrjError BadAxisCount;
+	static const PvtTrjError BadPointTime;
+	static const PvtTrjError BadPointData;
+	static const PvtTrjError NoPoints;
+	static const PvtTrjError StreamUnderflow;
+	static const PvtTrjError StreamTimeout;
+	static const PvtTrjError FileOpen;
+	static const PvtTrjError FileFormat;
+	static const PvtTrjError LimitExceeded;
+
+protected:
+	PvtTrjError(uint16 id, const char* desc) : Error(id, desc) {}
+};
+
+inline const PvtTrjError PvtTrjError::BadAxisCount(0x9100, "The number of axes passed is out of range");
+inline const PvtTrjError PvtTrjError::BadPointTime(0x9101, "PVT segment times must be between 1 and 255 milliseconds");
+inline const PvtTrjError PvtTrjError::BadPointData(0x9102, "The PVT point data passed is invalid");
+inline const PvtTrjError PvtTrjError::NoPoints(0x9103, "The trajectory does not contain any PVT points");
+inline const PvtTrjError PvtTrjError::StreamUnderflow(0x9104, "The PVT stream ran out of points before it was ended");
+inline const PvtTrjError PvtTrjError::StreamTimeout(0x9105, "Timed out waiting for room in the PVT stream");
+inline const PvtTrjError PvtTrjError::FileOpen(0x9106, "Unable to open or map the trajectory file");
+inline const PvtTrjError PvtTrjError::FileFormat(0x9107, "The trajectory file is not in a supported format");
+inline const PvtTrjError PvtTrjError::LimitExceeded(0x9108, "The trajectory exceeds the move or position limits");
+
+// Linkages support up to 32 axes of coordinated motion.
+#define PVT_SOA_MAX_AXES 32
+
+// Size of one PVT buffer message sent to a drive for each axis of a point.
+#define PVT_SEGMENT_MESSAGE_BYTES 8
+
+class PvtSoaTrj : public LinkTrajectory
+{
+public:
+
+	// Default constructor. Init() must be called before adding points.
+	PvtSoaTrj() : axisCt(0), nextPoint(0), velocitiesValid(false), useBatchSolver(true), reusable(false) {}
+
+	virtual ~PvtSoaTrj() {}
+
+	/**
+	 * Set the number of axes in the trajectory and clear any points.
+	 *
+	 * @param axisNum The number of dimensions (1 to 32).
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Init(int axisNum)
+	{
+		if (axisNum < 1 || axisNum > PVT_SOA_MAX_AXES)
+			return &PvtTrjError::BadAxisCount;
+
+		axisCt = axisNum;
+		positions.assign(axisCt, std::vector<double>());
+		velocities.assign(axisCt, std::vector<double>());
+		Clear();
+		return 0;
+	}
+
+	// Remove all of the points from the trajectory.
+	void Clear(void)
+	{
+		for (int i = 0; i < axisCt; i++) {
+			positions[i].clear();
+			velocities[i].clear();
+		}
+		times.clear();
+		nextPoint = 0;
+		velocitiesValid = false;
+	}
+
+	// Pre-allocate room for the passed number of points on every axis.
+	void Reserve(size_t pointCt)
+	{
+		for (int i = 0; i < axisCt; i++) {
+			positions[i].reserve(pointCt);
+			velocities[i].reserve(pointCt);
+		}
+		times.reserve(pointCt);
+	}
+
+	/**
+	 * Add a single PVT point. This has the same signature as
+	 * PvtConstAccelTrj::addPvtPoint() so existing code can switch over
+	 * without changes.
+	 *
+	 * @param position Pointer to a vector holding one position per axis.
+	 * @param time     Pointer to the time (ms) from this point to the next.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* addPvtPoint(std::vector<double>* position, uint8* time)
+	{
+		if (!position || !time || (int)position->size() != axisCt)
+			return &PvtTrjError::BadPointData;
+
+		return addPvtPoints(position->data(), time, 1);
+	}
+
+	/**
+	 * Append a block of PVT points with a single call.
+	 *
+	 * @param pointPositions Positions stored point by point, axisCt values
+	 *                       per point: { A0, B0, A1, B1, ... }.
+	 * @param pointTimes     One time (ms) per point. The time of a point is
+	 *                       the time taken to travel to the next point.
+	 * @param pointCt        The number of points to append.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* addPvtPoints(const double* pointPositions, const uint8* pointTimes, size_t pointCt)
+	{
+		if (!axisCt) return &PvtTrjError::BadAxisCount;
+		if (!pointCt) return 0;
+		if (!pointPositions || !pointTimes) return &PvtTrjError::BadPointData;
+
+		for (size_t i = 0; i < pointCt; i++) {
+			if (pointTimes[i] == 0) return &PvtTrjError::BadPointTime;
+		}
+
+		size_t oldCt = times.size();
+		times.insert(times.end(), pointTimes, pointTimes + pointCt);
+
+		// de-interleave the passed points into the per-axis buffers.
+		for (int a = 0; a < axisCt; a++) {
+			std::vector<double>& axisPos = positions[a];
+			axisPos.resize(oldCt + pointCt);
+			double* dst = axisPos.data() + oldCt;
+			const double* src = pointPositions + a;
+			for (size_t i = 0; i < pointCt; i++)
+				dst[i] = src[i * axisCt];
+		}
+
+		velocitiesValid = false;
+		return 0;
+	}
+
+	// Append a block of points that all use the same time between points.
+	const Error* addPvtPoints(const double* pointPositions, uint8 pointTime, size_t pointCt)
+	{
+		std::vector<uint8> pointTimes(pointCt, pointTime);
+		return addPvtPoints(pointPositions, pointTimes.data(), pointCt);
+	}
+
+	/**
+	 * Replace the contents of the trajectory with points whose velocities
+	 * have already been calculated, for example ones read back from a
+	 * trajectory file. The velocities are not calculated again.
+	 *
+	 * @param pointPositions Per-axis position buffers, pointCt values each.
+	 * @param pointVelocities Per-axis velocity buffers, pointCt values each.
+	 * @param pointTimes     One time (ms) per point.
+	 * @param pointCt        The number of points.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* SetSolvedPoints(const double* const pointPositions[], const double* const pointVelocities[],
+		const uint8* pointTimes, size_t pointCt)
+	{
+		if (!axisCt) return &PvtTrjError::BadAxisCount;
+		if (!pointCt) return &PvtTrjError::NoPoints;
+		if (!pointPositions || !pointVelocities || !pointTimes) return &PvtTrjError::BadPointData;
+
+		for (size_t i = 0; i + 1 < pointCt; i++) {
+			if (pointTimes[i] == 0) return &PvtTrjError::BadPointTime;
+		}
+
+		for (int a = 0; a < axisCt; a++) {
+			positions[a].assign(pointPositions[a], pointPositions[a] + pointCt);
+			velocities[a].assign(pointVelocities[a], pointVelocities[a] + pointCt);
+		}
+		times.assign(pointTimes, pointTimes + pointCt);
+		nextPoint = 0;
+		velocitiesValid = true;
+		return 0;
+	}
+
+	/**
+	 * Keep the points once the trajectory has been sent, so the same
+	 * object can be passed to Linkage::SendTrajectory() again without
+	 * reloading it. Each send starts from the first point and the
+	 * velocities are only calculated once.
+	 */
+	void SetReusable(bool reuse) { reusable = reuse; }
+
+	// True if the velocities of the points have been calculated.
+	bool HasVelocities(void) const { return velocitiesValid; }
+
+	// Select the SIMD batch solver (default) or the axis by axis solver.
+	void UseBatchSolver(bool useBatch) { useBatchSolver = useBatch; velocitiesValid = false; }
+
+	// The number of points in the trajectory that have not been sent yet.
+	size_t GetPointCount(void) const { return times.size() - nextPoint; }
+
+	// Contiguous positions of the passed axis, starting at the next point to send.
+	const double* GetPositions(int axis) const { return positions[axis].data() + nextPoint; }
+
+	// Contiguous velocities of the passed axis. Only valid after CalcVelocities().
+	const double* GetVelocities(int axis) const { return velocities[axis].data() + nextPoint; }
+
+	// Segment times (ms), starting at the next point to send.
+	const uint8* GetTimes(void) const { return times.data() + nextPoint; }
+
+	/**
+	 * Calculate the velocity of every point that has not been sent yet.
+	 * This is done automatically by StartNew() when the trajectory is
+	 * passed to Linkage::SendTrajectory().
+	 *
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* CalcVelocities(void)
+	{
+		size_t n = GetPointCount();
+		if (!n) return &PvtTrjError::NoPoints;
+
+		BuildFactors(GetTimes(), n);
+
+		for (int a = 0; a < axisCt; a++)
+			velocities[a].resize(times.size());
+
+		if (useBatchSolver) {
+			const double* axisPos[PVT_SOA_MAX_AXES];
+			double* axisVel[PVT_SOA_MAX_AXES];
+			for (int a = 0; a < axisCt; a++) {
+				axisPos[a] = GetPositions(a);
+				axisVel[a] = velocities[a].data() + nextPoint;
+			}
+			batchSolver.Solve(axisPos, axisVel, axisCt, n,
+				invH.data(), lower.data(), upper.data(), invPivot.data());
+		}
+		else {
+			for (int a = 0; a < axisCt; a++)
+				SolveAxis(GetPositions(a), velocities[a].data() + nextPoint, n);
+		}
+
+		velocitiesValid = true;
+		return 0;
+	}
+
+	virtual int GetDim(void) { return axisCt; }
+
+	// Called by the linkage before the first segment is requested.
+	virtual const Error* StartNew(void)
+	{
+		if (reusable) nextPoint = 0;
+		if (!GetPointCount()) return &PvtTrjError::NoPoints;
+		if (!velocitiesValid) return CalcVelocities();
+		return 0;
+	}
+
+	// Called by the linkage once the trajectory is finished. Sent points
+	// are dropped so the object can be refilled and sent again, the same
+	// way PvtConstAccelTrj behaves. A reusable trajectory is rewound to
+	// its first point instead.
+	virtual void Finish(void)
+	{
+		if (reusable) nextPoint = 0;
+		else if (nextPoint >= times.size()) Clear();
+	}
+
+	/**
+	 * Return the next PVT segment to the linkage. The last point of the
+	 * trajectory is returned with a time of zero to end the move.
+	 */
+	virtual const Error* NextSegment(uunit pos[], uunit vel[], uint8& time)
+	{
+		if (nextPoint >= times.size()) return &PvtTrjError::NoPoints;
+
+		for (int a = 0; a < axisCt; a++) {
+			pos[a] = (uunit)positions[a][nextPoint];
+			vel[a] = (uunit)velocities[a][nextPoint];
+		}
+
+		time = (nextPoint + 1 < times.size()) ? times[nextPoint] : 0;
+		nextPoint++;
+		return 0;
+	}
+
+protected:
+
+	/**
+	 * Factor the tridiagonal system for the passed segment times.
+	 *
+	 * For every interior point i, continuous acceleration requires:
+	 *   v[i-1]/h[i-1] + 2*v[i]*(1/h[i-1] + 1/h[i]) + v[i+1]/h[i]
+	 *      = 3*(dp[i-1]/h[i-1]^2 + dp[i]/h[i]^2)
+	 * with v[0] = v[n-1] = 0. The matrix only depends on the times, so
+	 * the Thomas algorithm coefficients are computed once here and shared
+	 * by every axis.
+	 */
+	void BuildFactors(const uint8* t, size_t n)
+	{
+		invH.resize(n);
+		lower.resize(n);
+		upper.resize(n);
+		invPivot.resize(n);
+
+		for (size_t i = 0; i + 1 < n; i++)
+			invH[i] = 1000.0 / t[i];
+
+		double prevUpper = 0.0;
+		for (size_t i = 1; i + 1 < n; i++) {
+			lower[i] = (i > 1) ? invH[i - 1] : 0.0;
+			double pivot = 2.0 * (invH[i - 1] + invH[i]) - lower[i] * prevUpper;
+			invPivot[i] = 1.0 / pivot;
+			upper[i] = (i + 2 < n) ? invH[i] * invPivot[i] : 0.0;
+			prevUpper = upper[i];
+		}
+	}
+
+	// Solve for the velocities of a single axis using the shared factors.
+	void SolveAxis(const double* p, double* v, size_t n)
+	{
+		v[0] = 0.0;
+		v[n - 1] = 0.0;
+		if (n < 3) return;
+
+		// forward sweep. v[] holds the modified right hand side.
+		double prev = 0.0;
+		for (size_t i = 1; i + 1 < n; i++) {
+			double d0 = (p[i] - p[i - 1]) * invH[i - 1] * invH[i - 1];
+			double d1 = (p[i + 1] - p[i]) * invH[i] * invH[i];
+			prev = (3.0 * (d0 + d1) - lower[i] * prev) * invPivot[i];
+			v[i] = prev;
+		}
+
+		// back substitution.
+		for (size_t i = n - 2; i > 1; i--)
+			v[i - 1] -= upper[i - 1] * v[i];
+	}
+
+	int axisCt;
+	std::vector<std::vector<double>> positions;   // one contiguous buffer per axis
+	std::vector<std::vector<double>> velocities;  // one contiguous buffer per axis
+	std::vector<uint8> times;                // shared by all axes
+	size_t nextPoint;                   // index of the next point to send
+	bool velocitiesValid;
+	bool useBatchSolver;
+	bool reusable;                      // keep the points after they are sent
+	PvtBatchSolver batchSolver;
+
+	// Thomas algorithm factors shared by all axes (indexed by point).
+	std::vector<double> invH;
+	std::vector<double> lower;
+	std::vector<double> upper;
+	std::vector<double> invPivot;
+};
+
+CML_NAMESPACE_END()
+
+#endif
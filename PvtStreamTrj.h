@@ -0,0 +1,470 @@
+/*
+
+PvtStreamTrj.h
+
+The PvtStreamTrj class is a PVT trajectory for streams that are
+produced while the move is running, or that never end at all
+(conveyor tracking, teleoperation, etc.).
+
+PvtConstAccelTrj and PvtSoaTrj need the whole point set before the
+continuous-acceleration velocities can be calculated. PvtStreamTrj
+calculates them incrementally instead. When the linkage asks for the
+next segment, the velocity of that point is solved over a short window
+of lookahead points that follow it. The influence of points beyond the
+window on the velocity of the current point drops by a factor of about
+four per point, so a window of 8 points gives practically the same
+velocities as solving the whole trajectory.
+
+The points are kept in a fixed-size ring buffer, so a stream uses the
+same amount of memory no matter how long it runs. addPvtPoint() blocks
+while the ring buffer is full, and the latency between producing a
+point and the drive executing it is bounded by the lookahead window
+plus the number of points the linkage is allowed to keep in the drive
+(see SetMaxDrivePoints()).
+
+Usage:
+
+	PvtStreamTrj stream;
+	err = stream.Init(2);
+
+	// producer thread
+	err = stream.addPvtPoint(pos, 10);
+	...
+	stream.EndStream();   // the last point added is the end of the move
+
+	// main thread
+	err = link.SendTrajectory(stream);
+
+Chaining: whole trajectories (PvtConstAccelTrj, PvtSoaTrj, Path or any
+other LinkTrajectory) can be appended to a stream that is already
+running with AppendTrajectory(). Their positions and times are queued
+behind the points already in the stream and the velocities across the
+join are solved like any other point, so queued trajectories run as
+one continuous move instead of stopping at the end of each one. If a
+trajectory starts where the stream currently ends, the shared point is
+only played once.
+
+Pinned points: a point can be added with its velocity already set
+(addPvtPoint(pos, time, vel)), for example the points of a dwell or of
+a constant velocity run (see PvtRunCompressor.h). The velocity of a
+pinned point is sent as it was given, and the points between two pinned
+points are solved with those velocities at the ends of the window.
+
+	stream.Init(2, 8, 1024);
+	err = stream.AppendTrajectory(firstTrj);
+	err = link.SendTrajectory(stream);
+	err = stream.AppendTrajectory(secondTrj);   // while the first one runs
+	stream.EndStream();
+
+NextSegment() is called by CML while it refills the drive's PVT
+buffer. If the producer falls behind, NextSegment() waits up to the
+starve timeout for more points and then returns an error, which ends
+the move. Keep the producer at least one lookahead window ahead.
+
+*/
+
+#ifndef PVT_STREAM_TRJ_H
+#define PVT_STREAM_TRJ_H
+
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include "CML.h"
+#include "PvtSoaTrj.h"
+
+CML_NAMESPACE_START()
+
+class PvtStreamTrj : public LinkTrajectory
+{
+public:
+
+	// Default constructor. Init() must be called before adding points.
+	PvtStreamTrj() : axisCt(0), lookahead(0), capacity(0), maxDrivePoints(0x7fffffff),
+		starveTimeout(100), addTimeout(-1) { Reset(); }
+
+	virtual ~PvtStreamTrj() {}
+
+	/**
+	 * Set up the stream. All memory used by the stream is allocated here.
+	 *
+	 * @param axisNum         The number of dimensions (1 to 32).
+	 * @param lookaheadPoints The number of points following a point that
+	 *                        are used to calculate its velocity.
+	 * @param bufferPoints    The size of the ring buffer in points. Must be
+	 *                        larger than the lookahead window.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Init(int axisNum, int lookaheadPoints = 8, int bufferPoints = 64)
+	{
+		if (axisNum < 1 || axisNum > PVT_SOA_MAX_AXES)
+			return &PvtTrjError::BadAxisCount;
+		if (lookaheadPoints < 1 || bufferPoints < lookaheadPoints + 2)
+			return &PvtTrjError::BadPointData;
+
+		std::lock_guard<std::mutex> lock(streamMutex);
+
+		axisCt = axisNum;
+		lookahead = lookaheadPoints;
+		capacity = bufferPoints;
+
+		ringPos.assign((size_t)capacity * axisCt, 0.0);
+		ringVel.assign((size_t)capacity * axisCt, 0.0);
+		ringTime.assign(capacity, 0);
+		ringPinned.assign(capacity, 0);
+		lastVel.assign(axisCt, 0.0);
+
+		// window solver scratch space
+		winLower.assign(lookahead + 1, 0.0);
+		winUpper.assign(lookahead + 1, 0.0);
+		winInvPivot.assign(lookahead + 1, 0.0);
+		winInvH.assign(lookahead + 1, 0.0);
+		winRhs.assign(lookahead + 1, 0.0);
+
+		Reset();
+		return 0;
+	}
+
+	// Limit how many points the linkage keeps queued in the drive. Fewer
+	// points means lower latency from addPvtPoint() to motion.
+	void SetMaxDrivePoints(int points) { maxDrivePoints = points; }
+
+	// Time (ms) NextSegment() will wait for the producer before failing.
+	void SetStarveTimeout(int32 timeout) { starveTimeout = timeout; }
+
+	// Time (ms) addPvtPoint() will wait for room in the ring buffer.
+	// A negative value waits forever.
+	void SetAddTimeout(int32 timeout) { addTimeout = timeout; }
+
+	/**
+	 * Add a point to the end of the stream. Blocks while the ring buffer
+	 * is full.
+	 *
+	 * @param position One position per axis.
+	 * @param time     The time (ms) from this point to the next.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* addPvtPoint(const double* position, uint8 time)
+	{
+		return addPvtPoint(position, time, 0);
+	}
+
+	/**
+	 * Add a point whose velocity is already known. The velocity is sent
+	 * as given instead of being solved.
+	 *
+	 * @param position One position per axis.
+	 * @param time     The time (ms) from this point to the next.
+	 * @param velocity One velocity per axis (units per second), or NULL
+	 *                 to solve the velocity like any other point.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* addPvtPoint(const double* position, uint8 time, const double* velocity)
+	{
+		if (!axisCt) return &PvtTrjError::BadAxisCount;
+		if (!position) return &PvtTrjError::BadPointData;
+		if (!time) return &PvtTrjError::BadPointTime;
+
+		std::unique_lock<std::mutex> lock(streamMutex);
+
+		auto hasRoom = [this] { return addedCt - firstKept < (int64)capacity; };
+		if (addTimeout < 0)
+			spaceCond.wait(lock, hasRoom);
+		else if (!spaceCond.wait_for(lock, std::chrono::milliseconds(addTimeout), hasRoom))
+			return &PvtTrjError::StreamTimeout;
+
+		if (ended) return &PvtTrjError::BadPointData;
+
+		size_t slot = (size_t)(addedCt % capacity);
+		for (int a = 0; a < axisCt; a++) {
+			ringPos[slot * axisCt + a] = position[a];
+			ringVel[slot * axisCt + a] = velocity ? velocity[a] : 0.0;
+		}
+		ringTime[slot] = time;
+		ringPinned[slot] = velocity ? 1 : 0;
+		addedCt++;
+
+		lock.unlock();
+		dataCond.notify_one();
+		return 0;
+	}
+
+	// Same signature as PvtConstAccelTrj::addPvtPoint().
+	const Error* addPvtPoint(std::vector<double>* position, uint8* time)
+	{
+		if (!position || !time || (int)position->size() != axisCt)
+			return &PvtTrjError::BadPointData;
+
+		return addPvtPoint(position->data(), *time);
+	}
+
+	/**
+	 * Append all of the points of another trajectory to the stream. The
+	 * trajectory is played through StartNew() / NextSegment() / Finish()
+	 * the same way the linkage would play it, and only its positions and
+	 * times are kept. If its first point is the point the stream currently
+	 * ends on, that point is not added twice. Blocks while the ring buffer
+	 * is full.
+	 *
+	 * @param trj The trajectory to append. It must have the same number
+	 *            of dimensions as the stream.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* AppendTrajectory(LinkTrajectory& trj)
+	{
+		if (!axisCt) return &PvtTrjError::BadAxisCount;
+		if (trj.GetDim() != axisCt) return &PvtTrjError::BadAxisCount;
+
+		const Error* err = trj.StartNew();
+		if (err) return err;
+
+		uunit pos[PVT_SOA_MAX_AXES], vel[PVT_SOA_MAX_AXES];
+		double point[PVT_SOA_MAX_AXES];
+		uint8 time = 0;
+		uint8 lastTime = 1;
+		bool first = true;
+
+		while (true) {
+			err = trj.NextSegment(pos, vel, time);
+			if (err) break;
+
+			for (int a = 0; a < axisCt; a++)
+				point[a] = (double)pos[a];
+
+			// the last point of a trajectory has no time. It keeps the time
+			// of the segment before it until the next trajectory joins on.
+			uint8 pointTime = time ? time : lastTime;
+
+			if (!first || !JoinLastPoint(point, pointTime)) {
+				err = addPvtPoint(point, pointTime);
+				if (err) break;
+			}
+
+			first = false;
+			if (!time) break;
+			lastTime = time;
+		}
+
+		trj.Finish();
+		return err;
+	}
+
+	// Mark the last point added as the end of the stream. The move comes
+	// to rest at that point.
+	void EndStream(void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(streamMutex);
+			ended = true;
+		}
+		dataCond.notify_all();
+	}
+
+	// The number of points added that have not been sent yet.
+	int GetQueuedPoints(void)
+	{
+		std::lock_guard<std::mutex> lock(streamMutex);
+		return (int)(addedCt - sentCt);
+	}
+
+	virtual int GetDim(void) { return axisCt; }
+
+	virtual int MaximumBufferPointsToUse(void) { return maxDrivePoints; }
+
+	/**
+	 * Return the next segment to the linkage, solving its velocity over
+	 * the lookahead window. The final point is returned with a time of
+	 * zero, after which the stream is reset so it can be reused.
+	 */
+	virtual const Error* NextSegment(uunit pos[], uunit vel[], uint8& time)
+	{
+		std::unique_lock<std::mutex> lock(streamMutex);
+
+		// wait until the whole window is available or the stream has ended.
+		auto windowReady = [this] { return ended || addedCt > sentCt + lookahead; };
+		if (!dataCond.wait_for(lock, std::chrono::milliseconds(starveTimeout), windowReady))
+			return &PvtTrjError::StreamUnderflow;
+
+		if (addedCt <= sentCt)
+			return &PvtTrjError::NoPoints;
+
+		int64 e = sentCt;
+		int64 last = addedCt - 1;
+		bool isLast = ended && (e == last);
+
+		// the stream starts and ends at rest.
+		if (e == 0 || isLast) {
+			for (int a = 0; a < axisCt; a++) lastVel[a] = 0.0;
+		}
+		else if (ringPinned[(size_t)(e % capacity)]) {
+			for (int a = 0; a < axisCt; a++) lastVel[a] = VelAt(e, a);
+		}
+		else {
+			SolveWindow(e, ended ? last : -1);
+		}
+
+		size_t slot = (size_t)(e % capacity);
+		for (int a = 0; a < axisCt; a++) {
+			pos[a] = (uunit)ringPos[slot * axisCt + a];
+			vel[a] = (uunit)lastVel[a];
+		}
+		time = isLast ? 0 : ringTime[slot];
+
+		sentCt++;
+
+		// keep the point just sent, it is needed to solve the next one.
+		firstKept = sentCt - 1;
+
+		if (isLast) Reset();
+
+		lock.unlock();
+		spaceCond.notify_all();
+		return 0;
+	}
+
+protected:
+
+	/**
+	 * If the passed point is the point the stream currently ends on, give
+	 * that point the passed time and return true. The last point added is
+	 * never sent before more points arrive or the stream ends, so its time
+	 * can still be changed.
+	 */
+	bool JoinLastPoint(const double* position, uint8 time)
+	{
+		std::lock_guard<std::mutex> lock(streamMutex);
+
+		if (ended || addedCt <= sentCt) return false;
+
+		int64 last = addedCt - 1;
+		for (int a = 0; a < axisCt; a++) {
+			if (fabs(PosAt(last, a) - position[a]) > 1e-6) return false;
+		}
+
+		ringTime[(size_t)(last % capacity)] = time;
+		return true;
+	}
+
+	// Clear the stream so it can be used again. The mutex must be held.
+	void Reset(void)
+	{
+		addedCt = 0;
+		sentCt = 0;
+		firstKept = 0;
+		ended = false;
+		for (size_t a = 0; a < lastVel.size(); a++) lastVel[a] = 0.0;
+	}
+
+	double PosAt(int64 index, int axis) const
+	{
+		return ringPos[(size_t)(index % capacity) * axisCt + axis];
+	}
+
+	double VelAt(int64 index, int axis) const
+	{
+		return ringVel[(size_t)(index % capacity) * axisCt + axis];
+	}
+
+	/**
+	 * Solve the velocity of point e. The velocity of point e-1 (already
+	 * sent) is fixed. If the end of the stream or a pinned point falls
+	 * inside the window, the window ends there with that point's exact
+	 * velocity, otherwise the velocity at the end of the window is
+	 * estimated from the last two positions in the window. The result is
+	 * left in lastVel[].
+	 *
+	 * @param e    Index of the point to solve.
+	 * @param last Index of the final point, or -1 if the stream has not ended.
+	 */
+	void SolveWindow(int64 e, int64 last)
+	{
+		int64 m = e + lookahead;
+		bool exactEnd = (last >= 0 && m >= last);
+		if (exactEnd) m = last;
+
+		// the last point of the stream is at rest even if it was pinned.
+		int64 pinned = -1;
+		for (int64 i = e + 1; i <= m && !(exactEnd && i == last); i++) {
+			if (ringPinned[(size_t)(i % capacity)]) {
+				pinned = m = i;
+				break;
+			}
+		}
+
+		int u = (int)(m - e);   // number of unknown velocities
+
+		for (int k = 0; k <= u; k++)
+			winInvH[k] = 1000.0 / ringTime[(size_t)((e - 1 + k) % capacity)];
+
+		// factor the window. Row k is the equation for point e+k.
+		double prevUpper = 0.0;
+		for (int k = 0; k < u; k++) {
+			winLower[k] = (k > 0) ? winInvH[k] : 0.0;
+			double pivot = 2.0 * (winInvH[k] + winInvH[k + 1]) - winLower[k] * prevUpper;
+			winInvPivot[k] = 1.0 / pivot;
+			winUpper[k] = winInvH[k + 1] * winInvPivot[k];
+			prevUpper = winUpper[k];
+		}
+
+		for (int a = 0; a < axisCt; a++) {
+			double endVel = 0.0;
+			if (pinned >= 0)
+				endVel = VelAt(pinned, a);
+			else if (!exactEnd)
+				endVel = (PosAt(m, a) - PosAt(m - 1, a)) * winInvH[u];
+
+			double prev = 0.0;
+			for (int k = 0; k < u; k++) {
+				int64 i = e + k;
+				double d0 = (PosAt(i, a) - PosAt(i - 1, a)) * winInvH[k] * winInvH[k];
+				double d1 = (PosAt(i + 1, a) - PosAt(i, a)) * winInvH[k + 1] * winInvH[k + 1];
+				double rhs = 3.0 * (d0 + d1);
+				if (k == 0) rhs -= winInvH[0] * lastVel[a];
+				if (k == u - 1) rhs -= winInvH[u] * endVel;
+				prev = (rhs - winLower[k] * prev) * winInvPivot[k];
+				winRhs[k] = prev;
+			}
+
+			for (int k = u - 1; k > 0; k--)
+				winRhs[k - 1] -= winUpper[k - 1] * winRhs[k];
+
+			lastVel[a] = winRhs[0];
+		}
+	}
+
+	int axisCt;
+	int lookahead;
+	int capacity;
+	int maxDrivePoints;
+	int32 starveTimeout;
+	int32 addTimeout;
+
+	std::mutex streamMutex;
+	std::condition_variable dataCond;    // signalled when points are added
+	std::condition_variable spaceCond;   // signalled when points are sent
+
+	// ring buffer of points, capacity points of axisCt positions each.
+	std::vector<double> ringPos;
+	std::vector<double> ringVel;       // velocities of pinned points
+	std::vector<uint8> ringTime;
+	std::vector<uint8> ringPinned;     // 1 if the point's velocity was given
+
+	int64 addedCt;     // total points added
+	int64 sentCt;      // total points sent to the linkage
+	int64 firstKept;   // oldest point still needed in the ring buffer
+	bool ended;
+
+	std::vector<double> lastVel;   // velocity of the last point sent, per axis
+
+	// window solver scratch space
+	std::vector<double> winLower;
+	std::vector<double> winUpper;
+	std::vector<double> winInvPivot;
+	std::vector<double> winInvH;
+	std::vector<double> winRhs;
+};
+
+CML_NAMESPACE_END()
+
+#endif
@@ -0,0 +1,341 @@
+/*
+
+PvtTelemetryTrj.h
+
+The PvtTelemetryTrj class makes the PVT refill traffic of a linkage move
+visible. It wraps any LinkTrajectory (PvtConstAccelTrj, PvtSoaTrj,
+PvtStreamTrj, Path, ...) and is passed to Linkage::SendTrajectory() in
+its place. Every call CML makes to NextSegment() is passed through to
+the wrapped trajectory and timed.
+
+CML calls NextSegment() in bursts: once to fill the drive's PVT buffer
+before the move starts, and then each time the drive reports that it
+has room for more points. Calls less than SetBatchGap() apart (1 ms by
+default) are counted as one refill batch. For every batch the class
+records:
+
+- the refill interval, the time since the previous batch started,
+- the batch size, the number of points sent in the batch,
+- the buffer margin, the time (ms) of motion still queued in the drive
+  when the batch started: the total time of the segments sent so far
+  minus the time since the move started,
+- the buffer depth, the number of points still queued in the drive,
+  worked out the same way.
+
+The margin and depth are estimates made on the host from the segment
+times, not values read back from the drive. A margin close to zero
+means the drive nearly ran out of points; a negative margin means the
+refill came after the drive should already have run out. The move is
+taken to start when the first (filling) batch ends, which is what
+SendTrajectory(trj, true) does. If the move is started later (by a
+digital input for example) call MarkMotionStart() when it starts.
+
+All of the values can be read while the move runs (GetStats()) and
+printed or saved once it is done (Dump(), WriteCsv()), to tune
+timeBetweenPoints, MaximumBufferPointsToUse() and thread priorities.
+
+Usage:
+
+	PvtTelemetryTrj telemetry(trj);
+	err = link.SendTrajectory(telemetry);
+	err = link.WaitMoveDone(-1);
+	telemetry.Dump(stdout);
+
+*/
+
+#ifndef PVT_TELEMETRY_TRJ_H
+#define PVT_TELEMETRY_TRJ_H
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+#include "CML.h"
+#include "TelemetryHistogram.h"
+
+// Most points the depth estimate tracks when the wrapped trajectory
+// puts no limit on the points queued in the drive.
+#define PVT_TELEMETRY_MAX_DEPTH 256
+
+CML_NAMESPACE_START()
+
+// A snapshot of the refill telemetry of a move.
+struct PvtTelemetryStats
+{
+	uint32 batches;           // refill batches, including the initial fill
+	uint32 points;            // points sent
+	uint32 lateRefills;       // batches that started with a negative margin
+	double minMarginMs;       // smallest margin seen at the start of a batch
+	double lastMarginMs;      // margin at the start of the last batch
+	int lastDepth;            // points queued in the drive at the start of the last batch
+	double maxIntervalMs;     // longest time between two batches
+};
+
+// One refill batch, as kept for WriteCsv().
+struct PvtRefillSample
+{
+	double timeMs;            // start of the batch, from the start of the move
+	double intervalMs;        // time since the previous batch started
+	double marginMs;          // queued motion when the batch started
+	int depth;                // points queued in the drive when the batch started
+	int batchSize;            // points sent in the batch
+};
+
+class PvtTelemetryTrj : public LinkTrajectory
+{
+public:
+
+	typedef std::chrono::steady_clock Clock;
+
+	/**
+	 * @param wrapped    The trajectory to pass the calls on to.
+	 * @param maxSamples The number of refill batches kept for WriteCsv().
+	 *                   Older batches are dropped once it is full.
+	 */
+	PvtTelemetryTrj(LinkTrajectory& wrapped, size_t maxSamples = 4096) : trj(wrapped), batchGapUs(1000),
+		sampleCapacity(maxSamples)
+	{
+		intervalHist.SetLogBuckets(0.5, 4096.0);     // ms
+		marginHist.SetLinearBuckets(-50.0, 500.0, 10.0);  // ms
+		batchHist.SetLinearBuckets(1.0, 32.0, 1.0);  // points
+		samples.reserve(sampleCapacity);
+		Reset();
+	}
+
+	virtual ~PvtTelemetryTrj() {}
+
+	// Calls to NextSegment() less than this far apart (us) are one batch.
+	void SetBatchGap(int32 us) { batchGapUs = us; }
+
+	// Mark the moment the move starts, if it is not started by
+	// SendTrajectory() itself.
+	void MarkMotionStart(void)
+	{
+		std::lock_guard<std::mutex> lock(telemetryMutex);
+		motionStart = Clock::now();
+		motionStarted = true;
+	}
+
+	// Read the current telemetry. Safe to call while the move is running.
+	PvtTelemetryStats GetStats(void)
+	{
+		std::lock_guard<std::mutex> lock(telemetryMutex);
+		return stats;
+	}
+
+	// Print the summary and histograms of the last move.
+	void Dump(FILE* fp)
+	{
+		std::lock_guard<std::mutex> lock(telemetryMutex);
+
+		fprintf(fp, "PVT refill telemetry: %u points in %u batches, %u late refills\n",
+			stats.points, stats.batches, stats.lateRefills);
+		if (stats.batches > 1)
+			fprintf(fp, "Smallest buffer margin %.1f ms, longest refill interval %.1f ms\n",
+				stats.minMarginMs, stats.maxIntervalMs);
+
+		intervalHist.Print(fp, "Refill interval", "ms");
+		marginHist.Print(fp, "Buffer margin at refill", "ms");
+		batchHist.Print(fp, "Points per refill", "points");
+	}
+
+	/**
+	 * Write the refill batches of the last move to a CSV file, one row
+	 * per batch.
+	 *
+	 * @return true if the file was written.
+	 */
+	bool WriteCsv(const char* fileName)
+	{
+		std::lock_guard<std::mutex> lock(telemetryMutex);
+
+		FILE* fp = fopen(fileName, "w");
+		if (!fp) return false;
+
+		fprintf(fp, "Time (ms),Interval (ms),Margin (ms),Depth (points),Batch size\n");
+		size_t n = samples.size();
+		size_t first = (samplesWritten > n) ? samplesWritten % n : 0;
+		for (size_t k = 0; k < n; k++) {
+			const PvtRefillSample& s = samples[(first + k) % n];
+			fprintf(fp, "%.3f,%.3f,%.3f,%d,%d\n", s.timeMs, s.intervalMs, s.marginMs, s.depth, s.batchSize);
+		}
+
+		return fclose(fp) == 0;
+	}
+
+	virtual int GetDim(void) { return trj.GetDim(); }
+	virtual bool UseVelocityInfo(int axis) { return trj.UseVelocityInfo(axis); }
+	virtual int MaximumBufferPointsToUse(void) { return trj.MaximumBufferPointsToUse(); }
+
+	// Called by the linkage before the first segment. Starts a new record
+	// and sizes the ring of queued segments, so that NextSegment() does
+	// not allocate.
+	virtual const Error* StartNew(void)
+	{
+		int depth = trj.MaximumBufferPointsToUse();
+		if (depth < 1 || depth > PVT_TELEMETRY_MAX_DEPTH) depth = PVT_TELEMETRY_MAX_DEPTH;
+		{
+			std::lock_guard<std::mutex> lock(telemetryMutex);
+			if (segmentEnds.size() < (size_t)depth) segmentEnds.resize(depth);
+			Reset();
+		}
+		return trj.StartNew();
+	}
+
+	virtual void Finish(void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(telemetryMutex);
+			CloseBatch();
+		}
+		trj.Finish();
+	}
+
+	virtual const Error* NextSegment(uunit pos[], uunit vel[], uint8& time)
+	{
+		Clock::time_point now = Clock::now();
+		{
+			std::lock_guard<std::mutex> lock(telemetryMutex);
+			if (!batchSize || Micros(lastCall, now) > batchGapUs)
+				StartBatch(now);
+			lastCall = now;
+		}
+
+		const Error* err = trj.NextSegment(pos, vel, time);
+		if (err) return err;
+
+		std::lock_guard<std::mutex> lock(telemetryMutex);
+		batchSize++;
+		stats.points++;
+		queuedMs += time;
+
+		// the ring holds as many points as the drive may, so if it is
+		// full the oldest segment has been played.
+		size_t ringSize = segmentEnds.size();
+		if (!ringSize) return 0;
+		if (endCt == ringSize) {
+			firstEnd = (firstEnd + 1) % ringSize;
+			endCt--;
+		}
+		segmentEnds[(firstEnd + endCt) % ringSize] = queuedMs;
+		endCt++;
+		return 0;
+	}
+
+protected:
+
+	static double Micros(Clock::time_point from, Clock::time_point to)
+	{
+		return std::chrono::duration<double, std::micro>(to - from).count();
+	}
+
+	// Called at the start of every refill batch once the move is running,
+	// for classes that act on the telemetry. The mutex is held.
+	virtual void OnRefill(const PvtRefillSample& sample) { (void)sample; }
+
+	// Clear the record for a new move. The mutex must be held.
+	void Reset(void)
+	{
+		PvtTelemetryStats empty = { 0, 0, 0, 0.0, 0.0, 0, 0.0 };
+		stats = empty;
+		motionStarted = false;
+		batchSize = 0;
+		queuedMs = 0.0;
+		firstEnd = 0;
+		endCt = 0;
+		samples.clear();
+		samplesWritten = 0;
+		intervalHist.Clear();
+		marginHist.Clear();
+		batchHist.Clear();
+	}
+
+	// Record the batch that just ended. The mutex must be held.
+	void CloseBatch(void)
+	{
+		if (!batchSize) return;
+
+		batchHist.Record(batchSize);
+		if (sampleCapacity && samplesWritten)
+			samples[(samplesWritten - 1) % sampleCapacity].batchSize = batchSize;
+		batchSize = 0;
+	}
+
+	// A call to NextSegment() starts a new batch. The mutex must be held.
+	void StartBatch(Clock::time_point now)
+	{
+		bool initialFill = (stats.batches == 0);
+		CloseBatch();
+
+		// the move starts when the initial fill is done.
+		if (!initialFill && !motionStarted) {
+			motionStart = lastCall;
+			motionStarted = true;
+		}
+
+		PvtRefillSample s = { 0.0, 0.0, 0.0, 0, 0 };
+		if (motionStarted) {
+			double elapsedMs = Micros(motionStart, now) * 0.001;
+
+			// drop the segments the drive has already played.
+			while (endCt && segmentEnds[firstEnd] <= elapsedMs) {
+				firstEnd = (firstEnd + 1) % segmentEnds.size();
+				endCt--;
+			}
+
+			s.timeMs = elapsedMs;
+			s.marginMs = queuedMs - elapsedMs;
+			s.depth = (int)endCt;
+			s.intervalMs = Micros(batchStart, now) * 0.001;
+
+			if (stats.batches == 1 || s.marginMs < stats.minMarginMs) stats.minMarginMs = s.marginMs;
+			if (s.intervalMs > stats.maxIntervalMs) stats.maxIntervalMs = s.intervalMs;
+			if (s.marginMs < 0.0) stats.lateRefills++;
+			stats.lastMarginMs = s.marginMs;
+			stats.lastDepth = s.depth;
+
+			intervalHist.Record(s.intervalMs);
+			marginHist.Record(s.marginMs);
+
+			OnRefill(s);
+		}
+
+		if (sampleCapacity) {
+			if (samples.size() < sampleCapacity) samples.push_back(s);
+			else samples[samplesWritten % sampleCapacity] = s;
+			samplesWritten++;
+		}
+
+		stats.batches++;
+		batchStart = now;
+	}
+
+	LinkTrajectory& trj;
+	int32 batchGapUs;
+
+	std::mutex telemetryMutex;
+	PvtTelemetryStats stats;
+
+	Clock::time_point motionStart;
+	Clock::time_point batchStart;
+	Clock::time_point lastCall;
+	bool motionStarted;
+
+	int batchSize;                    // points sent in the current batch
+	double queuedMs;                  // total time of the segments sent
+	std::vector<double> segmentEnds;  // ring of the end times (ms) of the segments not played yet
+	size_t firstEnd;                  // oldest entry of segmentEnds
+	size_t endCt;                     // entries in segmentEnds
+
+	size_t sampleCapacity;
+	size_t samplesWritten;
+	std::vector<PvtRefillSample> samples;  // ring of the latest batches
+
+	TelemetryHistogram intervalHist;
+	TelemetryHistogram marginHist;
+	TelemetryHistogram batchHist;
+};
+
+CML_NAMESPACE_END()
+
+#endif
@@ -0,0 +1,309 @@
+/*
+
+PvtTrjCache.h
+
+The PvtTrjCache class keeps fully solved PVT trajectories (positions,
+velocities and times) so a program that sends the same trajectory over
+and over does not parse the CSV file and calculate the velocities on
+every cycle.
+
+Each trajectory is identified by a 64 bit hash of the CSV file contents
+combined with the settings it was built with: the default time between
+points and any limits the caller passes (for example the linkage move
+limits). Editing the file or changing a setting gives a new key, so a
+stale trajectory is never played.
+
+- Memory: the most recently used trajectories are kept in memory
+  (SetMaxEntries(), 8 by default). A hit returns the same PvtSoaTrj
+  object, already solved and rewound to its first point.
+- Disk (optional): if SetCacheDir() is called, every trajectory that
+  is solved is also written as a trajectory file (PvtTrjFile.h) named
+  after its key. A later run finds it there and skips parsing and
+  solving even though the memory cache starts empty.
+
+The size and modification time of each file are remembered together
+with its hash, so a file that has not changed since the last call is
+not even read again. A file that is rewritten with the same size within
+the same second is not noticed; call Clear() after such an edit.
+
+Usage:
+
+	PvtTrjCache trjCache;
+	trjCache.SetCacheDir(".");
+
+	double limits[] = { maxVel, maxAccel, maxDecel, maxJerk };
+	std::shared_ptr<PvtSoaTrj> trj;
+	err = trjCache.LoadCsv("XyzPoints.csv", 10, limits, 4, trj);
+	err = link.SendTrajectory(*trj);
+
+The cache is not thread safe. Trajectories returned by the cache are
+shared, so they must not be modified.
+
+*/
+
+#ifndef PVT_TRJ_CACHE_H
+#define PVT_TRJ_CACHE_H
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "CML.h"
+#include "PvtSoaTrj.h"
+#include "PvtCsvParser.h"
+#include "PvtTrjFile.h"
+
+CML_NAMESPACE_START()
+
+class PvtTrjCache
+{
+public:
+
+	PvtTrjCache() : maxEntries(8), useCount(0), memoryHits(0), diskHits(0), misses(0) {}
+
+	// Directory used to persist solved trajectories. An empty string (the
+	// default) keeps them in memory only.
+	void SetCacheDir(const char* dir) { cacheDir = dir ? dir : ""; }
+
+	// The number of trajectories kept in memory.
+	void SetMaxEntries(size_t entries) { maxEntries = entries ? entries : 1; }
+
+	/**
+	 * Return the solved trajectory for a CSV file, parsing and solving it
+	 * only if it is not already in the cache.
+	 *
+	 * @param fileName          Name of the CSV file (see PvtCsvParser.h).
+	 * @param timeBetweenPoints Time (ms) between rows if the file has no
+	 *                          time column.
+	 * @param limits            Other settings that the trajectory depends
+	 *                          on, part of the key. May be NULL.
+	 * @param limitCt           The number of values in limits.
+	 * @param trj               Set to the cached trajectory.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* LoadCsv(const char* fileName, uint8 timeBetweenPoints, const double* limits, int limitCt,
+		std::shared_ptr<PvtSoaTrj>& trj)
+	{
+		trj.reset();
+
+		uint64 contentHash;
+		const Error* err = HashFile(fileName, contentHash);
+		if (err) return err;
+
+		uint64 key = HashBytes(&timeBetweenPoints, sizeof(timeBetweenPoints), contentHash);
+		if (limits && limitCt > 0)
+			key = HashBytes(limits, sizeof(double) * limitCt, key);
+
+		// memory
+		std::map<uint64, Entry>::iterator it = entries.find(key);
+		if (it != entries.end()) {
+			it->second.lastUse = ++useCount;
+			memoryHits++;
+			trj = it->second.trj;
+			return 0;
+		}
+
+		// disk
+		std::shared_ptr<PvtSoaTrj> newTrj = std::make_shared<PvtSoaTrj>();
+		std::string trjFileName = GetTrjFileName(key);
+		if (!trjFileName.empty() && !LoadTrjFile(trjFileName.c_str(), *newTrj)) {
+			diskHits++;
+		}
+		else {
+			// parse and solve. The file was just read to hash it, so the
+			// parser works on that copy.
+			if (fileData.empty()) {
+				err = ReadFile(fileName);
+				if (err) return err;
+			}
+
+			err = parser.ParseBuffer(fileData.data(), fileData.size(), timeBetweenPoints);
+			if (!err) err = newTrj->Init(parser.GetAxisCount());
+			if (!err) err = newTrj->addPvtPoints(parser.GetPoints().data(), parser.GetTimes().data(), parser.GetTimes().size());
+			if (!err) err = newTrj->CalcVelocities();
+			if (err) return err;
+
+			misses++;
+
+			// failing to persist the trajectory only costs time on the next
+			// run, so it is not reported as an error.
+			if (!trjFileName.empty()) SaveTrjFile(trjFileName, *newTrj);
+		}
+
+		fileData.clear();
+		newTrj->SetReusable(true);
+		Insert(key, newTrj);
+		trj = newTrj;
+		return 0;
+	}
+
+	// Drop every trajectory held in memory. Files on disk are kept.
+	void Clear(void)
+	{
+		entries.clear();
+		fileHashes.clear();
+	}
+
+	// The parser used for the last CSV file. If LoadCsv() fails to parse a
+	// file, GetParser().GetErrorLine() and GetErrorText() give the reason.
+	const PvtCsvParser& GetParser(void) const { return parser; }
+
+	uint32 GetMemoryHits(void) const { return memoryHits; }
+	uint32 GetDiskHits(void) const { return diskHits; }
+	uint32 GetMisses(void) const { return misses; }
+
+	// 64 bit FNV-1a hash of a block of bytes, continuing from a previous hash.
+	static uint64 HashBytes(const void* data, size_t length, uint64 hash = 0xcbf29ce484222325ULL)
+	{
+		const uint8* p = (const uint8*)data;
+		for (size_t i = 0; i < length; i++) {
+			hash ^= p[i];
+			hash *= 0x100000001b3ULL;
+		}
+		return hash;
+	}
+
+protected:
+
+	struct Entry
+	{
+		std::shared_ptr<PvtSoaTrj> trj;
+		uint64 lastUse;
+	};
+
+	// What was known about a CSV file the last time it was hashed.
+	struct FileInfo
+	{
+		int64 size;
+		int64 modified;
+		uint64 hash;
+	};
+
+	/**
+	 * Hash the contents of a file. If its size and modification time match
+	 * the last call the remembered hash is used, otherwise the file is
+	 * read into fileData and hashed.
+	 */
+	const Error* HashFile(const char* fileName, uint64& hash)
+	{
+		fileData.clear();
+
+		struct stat st;
+		if (stat(fileName, &st) != 0) return &PvtTrjError::FileOpen;
+
+		FileInfo& info = fileHashes[fileName];
+		if (info.size == (int64)st.st_size && info.modified == (int64)st.st_mtime && info.hash) {
+			hash = info.hash;
+			return 0;
+		}
+
+		const Error* err = ReadFile(fileName);
+		if (err) return err;
+
+		hash = HashBytes(fileData.data(), fileData.size());
+		info.size = (int64)st.st_size;
+		info.modified = (int64)st.st_mtime;
+		info.hash = hash;
+		return 0;
+	}
+
+	const Error* ReadFile(const char* fileName)
+	{
+		std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+		if (!file.is_open()) return &PvtTrjError::FileOpen;
+
+		std::streamoff size = file.tellg();
+		file.seekg(0);
+		fileData.resize((size_t)size);
+		if (size && !file.read(fileData.data(), size)) return &PvtTrjError::FileOpen;
+		return 0;
+	}
+
+	std::string GetTrjFileName(uint64 key) const
+	{
+		if (cacheDir.empty()) return std::string();
+
+		char name[32];
+		snprintf(name, sizeof(name), "pvtcache-%016llx.pvt", (unsigned long long)key);
+
+		std::string path = cacheDir;
+		if (path[path.size() - 1] != '/' && path[path.size() - 1] != '\\') path += '/';
+		return path + name;
+	}
+
+	// Read a persisted trajectory back into a PvtSoaTrj object.
+	const Error* LoadTrjFile(const char* trjFileName, PvtSoaTrj& trj)
+	{
+		PvtMappedTrj mapped;
+		const Error* err = mapped.Open(trjFileName);
+		if (err) return err;
+
+		// the cache only writes millisecond time bases.
+		if (mapped.GetHeader()->timeBaseUs != 1000) return &PvtTrjError::FileFormat;
+
+		const double* pos[PVT_SOA_MAX_AXES];
+		const double* vel[PVT_SOA_MAX_AXES];
+		for (int a = 0; a < mapped.GetDim(); a++) {
+			pos[a] = mapped.GetPositions(a);
+			vel[a] = mapped.GetVelocities(a);
+		}
+
+		err = trj.Init(mapped.GetDim());
+		if (!err) err = trj.SetSolvedPoints(pos, vel, mapped.GetTimes(), (size_t)mapped.GetPointCount());
+		return err;
+	}
+
+	// Write the trajectory under a temporary name first so a reader never
+	// sees a partly written file.
+	void SaveTrjFile(const std::string& trjFileName, PvtSoaTrj& trj)
+	{
+		std::string tmpName = trjFileName + ".tmp";
+		if (PvtTrjFileWrite(tmpName.c_str(), trj)) {
+			remove(tmpName.c_str());
+			return;
+		}
+
+		remove(trjFileName.c_str());
+		if (rename(tmpName.c_str(), trjFileName.c_str()) != 0)
+			remove(tmpName.c_str());
+	}
+
+	// Add a trajectory to the memory cache, dropping the least recently
+	// used one if the cache is full.
+	void Insert(uint64 key, const std::shared_ptr<PvtSoaTrj>& trj)
+	{
+		while (entries.size() >= maxEntries) {
+			std::map<uint64, Entry>::iterator oldest = entries.begin();
+			for (std::map<uint64, Entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+				if (it->second.lastUse < oldest->second.lastUse) oldest = it;
+			}
+			entries.erase(oldest);
+		}
+
+		Entry& e = entries[key];
+		e.trj = trj;
+		e.lastUse = ++useCount;
+	}
+
+	std::string cacheDir;
+	size_t maxEntries;
+	uint64 useCount;
+
+	std::map<uint64, Entry> entries;
+	std::map<std::string, FileInfo> fileHashes;
+
+	PvtCsvParser parser;
+	std::vector<char> fileData;
+
+	uint32 memoryHits;
+	uint32 diskHits;
+	uint32 misses;
+};
+
+CML_NAMESPACE_END()
+
+#endif
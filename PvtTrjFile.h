@@ -0,0 +1,369 @@
+/*
+
+PvtTrjFile.h
+
+A binary file format for solved PVT trajectories, and a trajectory
+class that plays such a file straight out of memory-mapped storage.
+
+Parsing a large CSV file and calculating its velocities every time a
+program starts can take seconds. A trajectory file holds the positions,
+the calculated velocities and the segment times in the exact layout
+the PvtMappedTrj class reads them in, so opening one is a single mmap()
+(MapViewOfFile() on Windows) and the linkage reads the points directly
+from the mapped pages without copying them.
+
+File layout (version 1, all values little-endian). The points are read
+straight from the mapping without conversion, so files are only written
+and opened on little-endian machines; elsewhere both fail with
+PvtTrjError::FileFormat.
+
+	offset 0    PvtTrjFileHeader (64 bytes)
+	posOffset   axisCt position columns, double[pointCt] each
+	velOffset   axisCt velocity columns, double[pointCt] each
+	timeOffset  time column, uint8[pointCt]
+
+Consecutive columns are columnStride bytes apart. Every column starts
+on a 64 byte boundary. The time of a point is the time taken to travel
+to the next point, in units of timeBaseUs microseconds.
+
+Usage:
+
+	// convert once
+	err = PvtTrjFileFromCsv("XyzPoints.csv", "XyzPoints.pvt", 10);
+
+	// play it back
+	PvtMappedTrj trj;
+	err = trj.Open("XyzPoints.pvt");
+	err = link.SendTrajectory(trj);
+
+*/
+
+#ifndef PVT_TRJ_FILE_H
+#define PVT_TRJ_FILE_H
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "CML.h"
+#include "PvtSoaTrj.h"
+#include "PvtCsvParser.h"
+
+#if defined( WIN32 )
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CML_NAMESPACE_START()
+
+#define PVT_TRJ_FILE_VERSION   1
+#define PVT_TRJ_FILE_ALIGN     64
+
+// Position units stored in the trajectory file.
+enum PVT_TRJ_UNITS
+{
+	PVT_UNITS_COUNTS = 0,      // encoder counts
+	PVT_UNITS_USER = 1         // CML user units (CML_ENABLE_USER_UNITS)
+};
+
+// Fixed size header at the start of every trajectory file.
+struct PvtTrjFileHeader
+{
+	char   magic[4];        // "CPVT"
+	uint16 version;         // PVT_TRJ_FILE_VERSION
+	uint16 headerSize;      // sizeof(PvtTrjFileHeader)
+	uint16 axisCt;          // number of axes
+	uint16 units;           // PVT_TRJ_UNITS
+	uint32 timeBaseUs;      // microseconds per time column tick
+	uint64 pointCt;         // number of points
+	uint64 posOffset;       // offset of the first position column
+	uint64 velOffset;       // offset of the first velocity column
+	uint64 timeOffset;      // offset of the time column
+	uint64 columnStride;    // bytes between consecutive axis columns
+	uint8  reserved[8];
+};
+
+static_assert(sizeof(PvtTrjFileHeader) == 64, "PvtTrjFileHeader must be 64 bytes");
+
+// True if this machine stores values in the byte order of the file.
+static inline bool PvtTrjFileByteOrderOk(void)
+{
+	const uint16 one = 1;
+	return *(const uint8*)&one == 1;
+}
+
+// Round the passed size up to the column alignment.
+static inline uint64 PvtTrjFileAlign(uint64 size)
+{
+	return (size + PVT_TRJ_FILE_ALIGN - 1) & ~(uint64)(PVT_TRJ_FILE_ALIGN - 1);
+}
+
+/**
+ * Write the points that have not been sent yet from a PvtSoaTrj object
+ * to a trajectory file. The velocities are calculated first if needed.
+ *
+ * @param fileName Name of the file to create.
+ * @param trj      The trajectory to save.
+ * @param units    The units of the positions (PVT_TRJ_UNITS).
+ * @return NULL on success, or an error object on failure.
+ */
+static inline const Error* PvtTrjFileWrite(const char* fileName, PvtSoaTrj& trj, uint16 units = PVT_UNITS_COUNTS)
+{
+	if (!trj.GetPointCount()) return &PvtTrjError::NoPoints;
+	if (!PvtTrjFileByteOrderOk()) return &PvtTrjError::FileFormat;
+	if (!trj.HasVelocities()) {
+		const Error* err = trj.CalcVelocities();
+		if (err) return err;
+	}
+
+	uint64 pointCt = trj.GetPointCount();
+	int axisCt = trj.GetDim();
+
+	PvtTrjFileHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, "CPVT", 4);
+	hdr.version = PVT_TRJ_FILE_VERSION;
+	hdr.headerSize = sizeof(PvtTrjFileHeader);
+	hdr.axisCt = (uint16)axisCt;
+	hdr.units = units;
+	hdr.timeBaseUs = 1000;
+	hdr.pointCt = pointCt;
+	hdr.columnStride = PvtTrjFileAlign(pointCt * sizeof(double));
+	hdr.posOffset = PvtTrjFileAlign(sizeof(PvtTrjFileHeader));
+	hdr.velOffset = hdr.posOffset + hdr.columnStride * axisCt;
+	hdr.timeOffset = hdr.velOffset + hdr.columnStride * axisCt;
+
+	FILE* fp = fopen(fileName, "wb");
+	if (!fp) return &PvtTrjError::FileOpen;
+
+	static const uint8 padding[PVT_TRJ_FILE_ALIGN] = { 0 };
+	size_t columnPad = (size_t)(hdr.columnStride - pointCt * sizeof(double));
+	bool ok = true;
+
+	ok = ok && fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+	ok = ok && fwrite(padding, 1, (size_t)(hdr.posOffset - sizeof(hdr)), fp) == (size_t)(hdr.posOffset - sizeof(hdr));
+
+	for (int a = 0; ok && a < axisCt; a++) {
+		ok = fwrite(trj.GetPositions(a), sizeof(double), (size_t)pointCt, fp) == pointCt;
+		ok = ok && fwrite(padding, 1, columnPad, fp) == columnPad;
+	}
+	for (int a = 0; ok && a < axisCt; a++) {
+		ok = fwrite(trj.GetVelocities(a), sizeof(double), (size_t)pointCt, fp) == pointCt;
+		ok = ok && fwrite(padding, 1, columnPad, fp) == columnPad;
+	}
+	ok = ok && fwrite(trj.GetTimes(), 1, (size_t)pointCt, fp) == pointCt;
+
+	if (fclose(fp) != 0) ok = false;
+	return ok ? 0 : &PvtTrjError::FileOpen;
+}
+
+/**
+ * Convert a CSV file in the layout used by PvtFromCsvFile.cpp into a
+ * trajectory file. See PvtCsvParser.h for the CSV layout.
+ *
+ * @param csvFileName       Name of the CSV file to read.
+ * @param trjFileName       Name of the trajectory file to create.
+ * @param timeBetweenPoints Time (ms) between rows if the file has no
+ *                          time column.
+ * @param parser            If not NULL, the parser to use; after a CSV
+ *                          error its GetErrorLine() and GetErrorText()
+ *                          say what was wrong.
+ * @return NULL on success, or an error object on failure.
+ */
+static inline const Error* PvtTrjFileFromCsv(const char* csvFileName, const char* trjFileName, uint8 timeBetweenPoints,
+	PvtCsvParser* parser = 0)
+{
+	PvtCsvParser ownParser;
+	PvtSoaTrj trj;
+
+	if (!parser) parser = &ownParser;
+	const Error* err = parser->ParseFile(csvFileName, trj, timeBetweenPoints);
+	if (err) return err;
+
+	return PvtTrjFileWrite(trjFileName, trj);
+}
+
+// Plays a trajectory file directly from memory-mapped storage.
+class PvtMappedTrj : public LinkTrajectory
+{
+public:
+
+	PvtMappedTrj() : base(0), mapSize(0), hdr(0), nextPoint(0)
+#if defined( WIN32 )
+		, fileHandle(INVALID_HANDLE_VALUE), mapHandle(NULL)
+#endif
+	{}
+
+	virtual ~PvtMappedTrj() { Close(); }
+
+	/**
+	 * Map a trajectory file and check its header. No point data is read
+	 * here, the pages are read on demand as the linkage plays them.
+	 *
+	 * @param fileName Name of the trajectory file.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Open(const char* fileName)
+	{
+		Close();
+
+#if defined( WIN32 )
+		fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (fileHandle == INVALID_HANDLE_VALUE) return &PvtTrjError::FileOpen;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(fileHandle, &size)) { Close(); return &PvtTrjError::FileOpen; }
+		mapSize = (size_t)size.QuadPart;
+
+		mapHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!mapHandle) { Close(); return &PvtTrjError::FileOpen; }
+
+		base = (const uint8*)MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0);
+		if (!base) { Close(); return &PvtTrjError::FileOpen; }
+#else
+		int fd = open(fileName, O_RDONLY);
+		if (fd < 0) return &PvtTrjError::FileOpen;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(PvtTrjFileHeader)) {
+			close(fd);
+			return &PvtTrjError::FileOpen;
+		}
+		mapSize = (size_t)st.st_size;
+
+		void* addr = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (addr == MAP_FAILED) { mapSize = 0; return &PvtTrjError::FileOpen; }
+
+		madvise(addr, mapSize, MADV_SEQUENTIAL);
+		base = (const uint8*)addr;
+#endif
+
+		const Error* err = CheckHeader();
+		if (err) Close();
+		return err;
+	}
+
+	// Unmap the file.
+	void Close(void)
+	{
+#if defined( WIN32 )
+		if (base) UnmapViewOfFile(base);
+		if (mapHandle) CloseHandle(mapHandle);
+		if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+		mapHandle = NULL;
+		fileHandle = INVALID_HANDLE_VALUE;
+#else
+		if (base) munmap((void*)base, mapSize);
+#endif
+		base = 0;
+		hdr = 0;
+		mapSize = 0;
+		nextPoint = 0;
+	}
+
+	// The header of the open file, or NULL if no file is open.
+	const PvtTrjFileHeader* GetHeader(void) const { return hdr; }
+
+	uint64 GetPointCount(void) const { return hdr ? hdr->pointCt : 0; }
+
+	// The mapped position column of the passed axis.
+	const double* GetPositions(int axis) const
+	{
+		return (const double*)(base + hdr->posOffset + hdr->columnStride * axis);
+	}
+
+	// The mapped velocity column of the passed axis.
+	const double* GetVelocities(int axis) const
+	{
+		return (const double*)(base + hdr->velOffset + hdr->columnStride * axis);
+	}
+
+	// The mapped time column.
+	const uint8* GetTimes(void) const { return base + hdr->timeOffset; }
+
+	virtual int GetDim(void) { return hdr ? hdr->axisCt : 0; }
+
+	// Playback always starts at the first point, so the same file can be
+	// sent to the linkage any number of times.
+	virtual const Error* StartNew(void)
+	{
+		if (!hdr || !hdr->pointCt) return &PvtTrjError::NoPoints;
+		nextPoint = 0;
+		return 0;
+	}
+
+	virtual const Error* NextSegment(uunit pos[], uunit vel[], uint8& time)
+	{
+		if (!hdr || nextPoint >= hdr->pointCt) return &PvtTrjError::NoPoints;
+
+		size_t i = (size_t)nextPoint;
+		for (int a = 0; a < hdr->axisCt; a++) {
+			pos[a] = (uunit)GetPositions(a)[i];
+			vel[a] = (uunit)GetVelocities(a)[i];
+		}
+
+		if (nextPoint + 1 < hdr->pointCt) {
+			uint32 ms = (uint32)((GetTimes()[i] * (uint64)hdr->timeBaseUs + 500) / 1000);
+			if (ms < 1 || ms > 255) return &PvtTrjError::BadPointTime;
+			time = (uint8)ms;
+		}
+		else {
+			time = 0;
+		}
+
+		nextPoint++;
+		return 0;
+	}
+
+protected:
+
+	// Validate the header against the size of the mapped file.
+	const Error* CheckHeader(void)
+	{
+		if (mapSize < sizeof(PvtTrjFileHeader)) return &PvtTrjError::FileFormat;
+		if (!PvtTrjFileByteOrderOk()) return &PvtTrjError::FileFormat;
+
+		const PvtTrjFileHeader* h = (const PvtTrjFileHeader*)base;
+		if (memcmp(h->magic, "CPVT", 4) != 0) return &PvtTrjError::FileFormat;
+		if (h->version != PVT_TRJ_FILE_VERSION) return &PvtTrjError::FileFormat;
+		if (h->headerSize != sizeof(PvtTrjFileHeader)) return &PvtTrjError::FileFormat;
+		if (h->axisCt < 1 || h->axisCt > PVT_SOA_MAX_AXES) return &PvtTrjError::FileFormat;
+		if (!h->timeBaseUs) return &PvtTrjError::FileFormat;
+		// the header is not trusted, so the sizes are bounded by the file
+		// before they are multiplied, and each end is checked by
+		// subtracting from the file size, so nothing can wrap.
+		if (h->pointCt > mapSize / sizeof(double)) return &PvtTrjError::FileFormat;
+		if (h->columnStride > mapSize / h->axisCt) return &PvtTrjError::FileFormat;
+		if (h->columnStride < h->pointCt * sizeof(double)) return &PvtTrjError::FileFormat;
+		if ((h->posOffset | h->velOffset | h->columnStride) % sizeof(double)) return &PvtTrjError::FileFormat;
+
+		uint64 columns = h->columnStride * h->axisCt;
+		if (h->posOffset > mapSize || columns > mapSize - h->posOffset) return &PvtTrjError::FileFormat;
+		if (h->velOffset > mapSize || columns > mapSize - h->velOffset) return &PvtTrjError::FileFormat;
+		if (h->timeOffset > mapSize || h->pointCt > mapSize - h->timeOffset) return &PvtTrjError::FileFormat;
+
+		hdr = h;
+		return 0;
+	}
+
+	const uint8* base;
+	size_t mapSize;
+	const PvtTrjFileHeader* hdr;
+	uint64 nextPoint;
+
+#if defined( WIN32 )
+	HANDLE fileHandle;
+	HANDLE mapHandle;
+#endif
+};
+
+CML_NAMESPACE_END()
+
+#endif
@@ -0,0 +1,536 @@
+/*
+
+PvtValidator.h
+
+The PvtValidator class checks a whole PVT trajectory against the move
+limits and the software position limits before any of it is sent.
+
+Once a PVT move has started, a point that breaks a limit is only found
+when the drive faults on it (a following error, a software limit or a
+tripped position window), with the axes already in motion. Validating
+the trajectory up front turns that into an error returned before
+Linkage::SendTrajectory() is called.
+
+Every segment is checked against:
+
+- time:         every segment but the last must have a time of 1 to
+                255 ms (a time of zero ends the move early),
+- positions:    the software position limits of each axis, set with
+                SetPositionLimits(). The check uses the control points
+                of the segment's cubic (the cubic never leaves their
+                range), so it never misses a crossing but may flag a
+                segment that only comes close to a limit,
+- velocity, acceleration, deceleration and jerk: the same limits that
+                are passed to Linkage::SetMoveLimits(), on the vector of
+                all axes, measured the same way PvtRetimer does it (see
+                PvtRetimer.h). A limit of zero is not checked.
+
+The points are checked straight from the per-axis buffers of a
+PvtSoaTrj in a single sweep. Several segments are handled at once in
+SIMD registers (see PvtBatchSolver.h): the terms of every axis are
+summed in the registers and only the per-segment results are stored,
+a block of a few hundred segments at a time, before they are compared
+with the limits. A million point, three axis trajectory is checked in
+tens of milliseconds.
+
+PvtConstAccelTrj and Path objects do not keep their points in buffers,
+so they are first copied into a PvtSoaTrj with Capture(). The copy plays
+the same segments as the original and is the object that should be
+sent once it has been validated.
+
+Usage:
+
+	PvtValidator validator;
+	validator.SetMoveLimits(maxVel, maxAccel, maxDecel, maxJerk);
+	validator.SetPositionLimits(0, -100000, 100000);
+
+	err = validator.Validate(trj);
+	if (err) validator.Print(stdout);
+	else err = link.SendTrajectory(trj);
+
+*/
+
+#ifndef PVT_VALIDATOR_H
+#define PVT_VALIDATOR_H
+
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+#include "CML.h"
+#include "PvtBatchSolver.h"
+#include "PvtSoaTrj.h"
+
+CML_NAMESPACE_START()
+
+// The limits checked by PvtValidator.
+enum PvtLimitKind
+{
+	PVT_LIMIT_TIME,
+	PVT_LIMIT_POSITION,
+	PVT_LIMIT_VELOCITY,
+	PVT_LIMIT_ACCEL,
+	PVT_LIMIT_DECEL,
+	PVT_LIMIT_JERK,
+	PVT_LIMIT_KINDS
+};
+
+// The result of checking one kind of limit.
+struct PvtLimitResult
+{
+	uint64 segments;          // segments that break the limit
+	size_t firstSegment;      // index of the first one (its starting point)
+	int firstAxis;            // for positions, the axis of the first one
+	double worst;             // largest value / limit, or for positions the
+	                          // largest distance past a limit
+};
+
+class PvtValidator
+{
+public:
+
+	// Segments checked per block. The per-segment results of a block stay in cache.
+	enum { BLOCK_SEGMENTS = 512 };
+
+	PvtValidator() : maxVel(0), maxAccel(0), maxDecel(0), maxJerk(0), allowance(0), axisCt(0), segmentsChecked(0), segmentsOver(0)
+	{
+		ClearPositionLimits();
+		ClearResults();
+	}
+
+	/**
+	 * Set the vector limits, in the units used by
+	 * Linkage::SetMoveLimits(). A limit of zero is not checked.
+	 *
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* SetMoveLimits(double vel, double acc, double dec, double jrk)
+	{
+		if (vel < 0.0 || acc < 0.0 || dec < 0.0 || jrk < 0.0) return &PvtTrjError::BadPointData;
+
+		maxVel = vel;
+		maxAccel = acc;
+		maxDecel = dec;
+		maxJerk = jrk;
+		return 0;
+	}
+
+	/**
+	 * Set the software position limits of one axis.
+	 *
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* SetPositionLimits(int axis, double minPos, double maxPos)
+	{
+		if (axis < 0 || axis >= PVT_SOA_MAX_AXES) return &PvtTrjError::BadAxisCount;
+		if (!(minPos <= maxPos)) return &PvtTrjError::BadPointData;
+
+		minPosition[axis] = minPos;
+		maxPosition[axis] = maxPos;
+		return 0;
+	}
+
+	// Stop checking the position limits of all axes.
+	void ClearPositionLimits(void)
+	{
+		minPosition.assign(PVT_SOA_MAX_AXES, -DBL_MAX);
+		maxPosition.assign(PVT_SOA_MAX_AXES, DBL_MAX);
+	}
+
+	// Let the move limits be exceeded by this fraction (0.05 is 5%) before
+	// a segment is flagged. The default is 0.
+	void SetAllowance(double fraction) { allowance = (fraction > 0.0) ? fraction : 0.0; }
+
+	/**
+	 * Copy any trajectory into a PvtSoaTrj so it can be validated. The
+	 * source is played from StartNew() to its last point, the same way the
+	 * linkage plays it, and keeps the velocities it produces. Send the copy
+	 * instead of the source.
+	 *
+	 * @return NULL on success, or an error object on failure.
+	 */
+	static const Error* Capture(LinkTrajectory& trj, PvtSoaTrj& out)
+	{
+		int axisNum = trj.GetDim();
+		const Error* err = out.Init(axisNum);
+		if (err) return err;
+
+		err = trj.StartNew();
+		if (err) return err;
+
+		std::vector<std::vector<double> > pos(axisNum), vel(axisNum);
+		std::vector<uint8> times;
+		uunit p[PVT_SOA_MAX_AXES], v[PVT_SOA_MAX_AXES];
+		uint8 time = 0;
+
+		while (!(err = trj.NextSegment(p, v, time))) {
+			for (int a = 0; a < axisNum; a++) {
+				pos[a].push_back((double)p[a]);
+				vel[a].push_back((double)v[a]);
+			}
+			times.push_back(time);
+			if (!time) break;
+		}
+		trj.Finish();
+
+		// the source ends with an error if it has no final zero time point.
+		if (times.empty()) return err ? err : &PvtTrjError::NoPoints;
+
+		const double* posPtr[PVT_SOA_MAX_AXES];
+		const double* velPtr[PVT_SOA_MAX_AXES];
+		for (int a = 0; a < axisNum; a++) {
+			posPtr[a] = pos[a].data();
+			velPtr[a] = vel[a].data();
+		}
+		return out.SetSolvedPoints(posPtr, velPtr, times.data(), times.size());
+	}
+
+	/**
+	 * Check the points of a PvtSoaTrj that have not been sent yet. The
+	 * velocities are calculated first if they have not been.
+	 *
+	 * @return NULL if no limit is broken, PvtTrjError::BadPointTime if a
+	 *         segment time is zero, PvtTrjError::LimitExceeded if any other
+	 *         limit is broken, or another error object on failure.
+	 */
+	const Error* Validate(PvtSoaTrj& trj)
+	{
+		if (!trj.HasVelocities()) {
+			const Error* err = trj.CalcVelocities();
+			if (err) return err;
+		}
+
+		const double* pos[PVT_SOA_MAX_AXES];
+		const double* vel[PVT_SOA_MAX_AXES];
+		for (int a = 0; a < trj.GetDim(); a++) {
+			pos[a] = trj.GetPositions(a);
+			vel[a] = trj.GetVelocities(a);
+		}
+		return Validate(pos, vel, trj.GetTimes(), trj.GetPointCount(), trj.GetDim());
+	}
+
+	/**
+	 * Check solved points held in per-axis buffers.
+	 *
+	 * @param pointPositions Per-axis position buffers, pointCt values each.
+	 * @param pointVelocities Per-axis velocity buffers (units per second).
+	 * @param pointTimes     One time (ms) per point, the time to the next point.
+	 * @param pointCt        The number of points.
+	 * @param axisNum        The number of axes.
+	 * @return See Validate(PvtSoaTrj&).
+	 */
+	const Error* Validate(const double* const pointPositions[], const double* const pointVelocities[],
+		const uint8* pointTimes, size_t pointCt, int axisNum)
+	{
+		if (axisNum < 1 || axisNum > PVT_SOA_MAX_AXES) return &PvtTrjError::BadAxisCount;
+		if (!pointCt) return &PvtTrjError::NoPoints;
+		if (!pointPositions || !pointVelocities || !pointTimes) return &PvtTrjError::BadPointData;
+
+		axisCt = axisNum;
+		ClearResults();
+
+		// a single point only has a position to check.
+		if (pointCt == 1) {
+			for (int a = 0; a < axisCt; a++) {
+				double p = pointPositions[a][0];
+				double over = fmax(minPosition[a] - p, p - maxPosition[a]);
+				if (over > 0.0) {
+					Flag(PVT_LIMIT_POSITION, 0, over);
+					results[PVT_LIMIT_POSITION].firstAxis = a;
+					segmentsOver = 1;
+					break;
+				}
+			}
+			return Outcome();
+		}
+
+		size_t segmentCt = pointCt - 1;
+		blockTime.resize(2 * (BLOCK_SEGMENTS + PvtBatchSolver::LANES));
+		blockRows.resize(ROW_COUNT * (BLOCK_SEGMENTS + PvtBatchSolver::LANES));
+
+		for (size_t first = 0; first < segmentCt; first += BLOCK_SEGMENTS) {
+			size_t count = segmentCt - first;
+			if (count > BLOCK_SEGMENTS) count = BLOCK_SEGMENTS;
+			CheckBlock(pointPositions, pointVelocities, pointTimes, first, count);
+		}
+		segmentsChecked = segmentCt;
+
+		if (results[PVT_LIMIT_POSITION].segments)
+			results[PVT_LIMIT_POSITION].firstAxis = FirstPositionAxis(pointPositions, pointVelocities,
+				pointTimes, results[PVT_LIMIT_POSITION].firstSegment);
+
+		return Outcome();
+	}
+
+	// The result of the last Validate() call for one kind of limit.
+	const PvtLimitResult& GetResult(PvtLimitKind kind) const { return results[kind]; }
+
+	// The number of segments that broke any limit in the last Validate() call.
+	uint64 GetViolations(void) const { return segmentsOver; }
+
+	// The number of segments checked by the last Validate() call.
+	size_t GetSegmentsChecked(void) const { return segmentsChecked; }
+
+	// Print the result of the last Validate() call.
+	void Print(FILE* fp) const
+	{
+		static const char* names[PVT_LIMIT_KINDS] = { "time", "position", "velocity", "acceleration", "deceleration", "jerk" };
+
+		fprintf(fp, "PVT validation: %zu segments checked, %llu over a limit\n", segmentsChecked,
+			(unsigned long long)GetViolations());
+
+		for (int k = 0; k < PVT_LIMIT_KINDS; k++) {
+			const PvtLimitResult& r = results[k];
+			if (!r.segments) continue;
+
+			if (k == PVT_LIMIT_TIME)
+				fprintf(fp, "  %-12s %10llu segments, first at point %zu\n", names[k],
+					(unsigned long long)r.segments, r.firstSegment);
+			else if (k == PVT_LIMIT_POSITION)
+				fprintf(fp, "  %-12s %10llu segments, first at point %zu (axis %d), up to %.1f past the limit\n", names[k],
+					(unsigned long long)r.segments, r.firstSegment, r.firstAxis, r.worst);
+			else
+				fprintf(fp, "  %-12s %10llu segments, first at point %zu, up to %.2fx the limit\n", names[k],
+					(unsigned long long)r.segments, r.firstSegment, r.worst);
+		}
+	}
+
+protected:
+
+	// Rows of per-segment values kept for a block.
+	enum
+	{
+		ROW_SPEED,                // largest squared speed, sampled at s = 0, 1/8, ... 1
+		ROW_ACCEL0,               // squared acceleration at the start
+		ROW_ACCEL1,               // squared acceleration at the end
+		ROW_POWER0,               // acceleration . velocity at the start
+		ROW_POWER1,               // acceleration . velocity at the end
+		ROW_JERK,                 // squared jerk
+		ROW_POSITION,             // largest distance past a position limit
+		ROW_COUNT
+	};
+
+	void ClearResults(void)
+	{
+		for (int k = 0; k < PVT_LIMIT_KINDS; k++) {
+			results[k].segments = 0;
+			results[k].firstSegment = 0;
+			results[k].firstAxis = -1;
+			results[k].worst = 0.0;
+		}
+		segmentsChecked = 0;
+		segmentsOver = 0;
+	}
+
+	// Record a segment that breaks a limit. Returns true.
+	bool Flag(PvtLimitKind kind, size_t segment, double value)
+	{
+		PvtLimitResult& r = results[kind];
+		if (!r.segments++) r.firstSegment = segment;
+		if (value > r.worst) r.worst = value;
+		return true;
+	}
+
+	const Error* Outcome(void) const
+	{
+		if (results[PVT_LIMIT_TIME].segments) return &PvtTrjError::BadPointTime;
+		if (segmentsOver) return &PvtTrjError::LimitExceeded;
+		return 0;
+	}
+
+	// Check count segments starting at segment first.
+	void CheckBlock(const double* const pos[], const double* const vel[], const uint8* times, size_t first, size_t count)
+	{
+		const size_t stride = BLOCK_SEGMENTS + PvtBatchSolver::LANES;
+		const int W = PvtBatchSolver::LANES;
+
+		// segment times (s) and their inverses. Zero times are flagged and
+		// given 1 s so they do not turn the sums into NaNs.
+		double* h = blockTime.data();
+		double* invH = h + stride;
+		for (size_t j = 0; j < count; j++) {
+			uint8 t = times[first + j];
+			if (!t && Flag(PVT_LIMIT_TIME, first + j, 0.0)) segmentsOver++;
+			h[j] = t ? t * 0.001 : 1.0;
+			invH[j] = t ? 1000.0 / t : 1.0;
+		}
+		for (size_t j = count; j < count + W; j++) {
+			h[j] = 1.0;
+			invH[j] = 1.0;
+		}
+
+		// one sweep over the block, W segments at a time. The last partial
+		// group is copied into padded buffers so it runs through the same code.
+		const double* p[PVT_SOA_MAX_AXES];
+		const double* v[PVT_SOA_MAX_AXES];
+		for (int a = 0; a < axisCt; a++) {
+			p[a] = pos[a] + first;
+			v[a] = vel[a] + first;
+		}
+
+		size_t full = (count / W) * W;
+		for (size_t j = 0; j < full; j += W)
+			SweepLanes(p, v, j, j);
+
+		if (full < count) {
+			size_t left = count - full;
+			for (int a = 0; a < axisCt; a++) {
+				for (size_t k = 0; k <= (size_t)W; k++) {
+					size_t src = (k <= left) ? full + k : full + left;
+					tailPos[a][k] = p[a][src];
+					tailVel[a][k] = v[a][src];
+				}
+				p[a] = tailPos[a];
+				v[a] = tailVel[a];
+			}
+			SweepLanes(p, v, 0, full);
+		}
+
+		// compare the block with the limits.
+		double scale = 1.0 + allowance;
+		double vel2 = maxVel * maxVel * scale * scale;
+		const double* row = blockRows.data();
+		for (size_t j = 0; j < count; j++) {
+			size_t seg = first + j;
+			if (!times[seg]) continue;
+
+			bool over = false;
+			double posOver = row[ROW_POSITION * stride + j];
+			if (posOver > 0.0) over = Flag(PVT_LIMIT_POSITION, seg, posOver);
+
+			double speed2 = row[ROW_SPEED * stride + j];
+			if (maxVel > 0.0 && speed2 > vel2) over = Flag(PVT_LIMIT_VELOCITY, seg, sqrt(speed2) / maxVel);
+
+			// the acceleration is linear along the segment, so its ends are
+			// the extremes. Each end is an acceleration or a deceleration.
+			double ratio[2] = { 0.0, 0.0 };
+			for (int end = 0; end < 2; end++) {
+				double aa = row[(ROW_ACCEL0 + end) * stride + j];
+				int kind = (row[(ROW_POWER0 + end) * stride + j] >= 0.0) ? 0 : 1;
+				double limit = kind ? maxDecel : maxAccel;
+				if (limit > 0.0 && aa > limit * limit * scale * scale) {
+					double r = sqrt(aa) / limit;
+					if (r > ratio[kind]) ratio[kind] = r;
+				}
+			}
+			if (ratio[0] > 0.0) over = Flag(PVT_LIMIT_ACCEL, seg, ratio[0]);
+			if (ratio[1] > 0.0) over = Flag(PVT_LIMIT_DECEL, seg, ratio[1]);
+
+			double jj = row[ROW_JERK * stride + j];
+			if (maxJerk > 0.0 && jj > maxJerk * maxJerk * scale * scale) over = Flag(PVT_LIMIT_JERK, seg, sqrt(jj) / maxJerk);
+
+			if (over) segmentsOver++;
+		}
+	}
+
+	/**
+	 * Work out the block rows of PvtBatchSolver::LANES segments, starting at
+	 * segment j of the block, from the points starting at index src of p
+	 * and v. The sums over the axes are kept in registers and only the
+	 * results are stored.
+	 */
+	void SweepLanes(const double* const p[], const double* const v[], size_t src, size_t j)
+	{
+		using namespace PvtBatchDetail;
+		const size_t stride = BLOCK_SEGMENTS + PvtBatchSolver::LANES;
+
+		PvtLanes h = LanesLoad(blockTime.data() + j);
+		PvtLanes invH = LanesLoad(blockTime.data() + stride + j);
+		PvtLanes third = LanesMul(h, LanesSet(1.0 / 3.0));
+		PvtLanes three = LanesSet(3.0);
+
+		PvtLanes zero = LanesSet(0.0);
+		PvtLanes speed[9];
+		for (int k = 0; k <= 8; k++) speed[k] = zero;
+		PvtLanes acc0 = zero, acc1 = zero, pow0 = zero, pow1 = zero, jerk2 = zero;
+		PvtLanes posOver = LanesSet(-DBL_MAX);
+
+		for (int a = 0; a < axisCt; a++) {
+			PvtLanes p0 = LanesLoad(p[a] + src);
+			PvtLanes p1 = LanesLoad(p[a] + src + 1);
+			PvtLanes v0 = LanesLoad(v[a] + src);
+			PvtLanes v1 = LanesLoad(v[a] + src + 1);
+
+			// the cubic as v(s) = v0 + 2 c2 s + 3 c3 s^2 over s = 0 to 1.
+			PvtLanes d = LanesMul(LanesSub(p1, p0), invH);
+			PvtLanes c2 = LanesSub(LanesSub(LanesMul(three, d), LanesAdd(v0, v0)), v1);
+			PvtLanes c3 = LanesSub(LanesAdd(v0, v1), LanesAdd(d, d));
+			PvtLanes twoC2 = LanesAdd(c2, c2);
+			PvtLanes threeC3 = LanesMul(three, c3);
+
+			for (int k = 0; k <= 8; k++) {
+				PvtLanes s = LanesSet(k * 0.125);
+				PvtLanes vs = LanesAdd(v0, LanesMul(s, LanesAdd(twoC2, LanesMul(s, threeC3))));
+				speed[k] = LanesAdd(speed[k], LanesMul(vs, vs));
+			}
+
+			PvtLanes a0 = LanesMul(twoC2, invH);
+			PvtLanes a1 = LanesMul(LanesAdd(twoC2, LanesAdd(threeC3, threeC3)), invH);
+			PvtLanes jk = LanesMul(LanesAdd(threeC3, threeC3), LanesMul(invH, invH));
+			acc0 = LanesAdd(acc0, LanesMul(a0, a0));
+			acc1 = LanesAdd(acc1, LanesMul(a1, a1));
+			pow0 = LanesAdd(pow0, LanesMul(a0, v0));
+			pow1 = LanesAdd(pow1, LanesMul(a1, v1));
+			jerk2 = LanesAdd(jerk2, LanesMul(jk, jk));
+
+			// the Bezier control points of the cubic bound its positions.
+			PvtLanes b1 = LanesAdd(p0, LanesMul(v0, third));
+			PvtLanes b2 = LanesSub(p1, LanesMul(v1, third));
+			PvtLanes lo = LanesMin(LanesMin(p0, b1), LanesMin(b2, p1));
+			PvtLanes hi = LanesMax(LanesMax(p0, b1), LanesMax(b2, p1));
+			posOver = LanesMax(posOver, LanesMax(LanesSub(LanesSet(minPosition[a]), lo),
+				LanesSub(hi, LanesSet(maxPosition[a]))));
+		}
+
+		PvtLanes peak = speed[0];
+		for (int k = 1; k <= 8; k++) peak = LanesMax(peak, speed[k]);
+
+		double* row = blockRows.data() + j;
+		LanesStore(row + ROW_SPEED * stride, peak);
+		LanesStore(row + ROW_ACCEL0 * stride, acc0);
+		LanesStore(row + ROW_ACCEL1 * stride, acc1);
+		LanesStore(row + ROW_POWER0 * stride, pow0);
+		LanesStore(row + ROW_POWER1 * stride, pow1);
+		LanesStore(row + ROW_JERK * stride, jerk2);
+		LanesStore(row + ROW_POSITION * stride, posOver);
+	}
+
+	// Find the first axis past a position limit on the passed segment.
+	int FirstPositionAxis(const double* const pos[], const double* const vel[], const uint8* times, size_t seg) const
+	{
+		double third = times[seg] * 0.001 / 3.0;
+		for (int a = 0; a < axisCt; a++) {
+			double p0 = pos[a][seg], p1 = pos[a][seg + 1];
+			double b1 = p0 + vel[a][seg] * third;
+			double b2 = p1 - vel[a][seg + 1] * third;
+			double lo = fmin(fmin(p0, b1), fmin(b2, p1));
+			double hi = fmax(fmax(p0, b1), fmax(b2, p1));
+			if (lo < minPosition[a] || hi > maxPosition[a]) return a;
+		}
+		return -1;
+	}
+
+	double maxVel;
+	double maxAccel;
+	double maxDecel;
+	double maxJerk;
+	double allowance;
+	std::vector<double> minPosition;   // per axis
+	std::vector<double> maxPosition;   // per axis
+
+	int axisCt;
+	size_t segmentsChecked;
+	uint64 segmentsOver;
+	PvtLimitResult results[PVT_LIMIT_KINDS];
+
+	// working buffers for one block
+	std::vector<double> blockTime;     // segment times, then their inverses
+	std::vector<double> blockRows;     // ROW_COUNT rows of per-segment values
+	double tailPos[PVT_SOA_MAX_AXES][2 * PvtBatchSolver::LANES];
+	double tailVel[PVT_SOA_MAX_AXES][2 * PvtBatchSolver::LANES];
+};
+
+CML_NAMESPACE_END()
+
+#endif
@@ -16,13 +16,39 @@ position, current, and digital input data on three nodes.
 After the TxPDO's have been initialized, the program will wait 
 for the user to press any key to begin teach mode. When teach mode
 begins, the positions on all three axes are being recorded and 
-transferred to a PvtConstAccelTrj object. 
+transferred to a PvtSoaTrj object. 
 
 When the user is done teaching, they will press any key to end 
-teach mode. The PvtConstAccelTrj object will cease recording
+teach mode. The PvtSoaTrj object will cease recording
 position data and will be passed as an argument to the linkage
 object for execution.
 
+Long teach sessions produce a large number of points, so the recorded
+positions are loaded into a PvtSoaTrj object (PvtSoaTrj.h) with a 
+single call to addPvtPoints() rather than one addPvtPoint() call per
+point. PvtSoaTrj stores each axis in one contiguous buffer and 
+calculates the same continuous-acceleration velocities as the 
+PvtConstAccelTrj class.
+
+Most of a recording is redundant (slow or straight motion sampled every
+SYNC period), so the recorded points are first passed through a 
+PvtDecimator (PvtDecimator.h). It keeps only the points needed for the
+PVT path to stay within positionTolerance of every recorded sample,
+with variable times between them, and reports how much of the PVT 
+network traffic this saved.
+
+Recording a position means growing a vector under a mutex, which can
+allocate, so it is not done on the receive thread. The TxPDO is a
+DeferredTpdo (TpdoExecutor.h): Received() only captures the position,
+and the positions are recorded on a worker thread owned by a
+TpdoExecutor. The latency and queue depth of each axis' TxPDO are
+printed when teaching stops.
+
+The taught motion is played back through a PvtOverrideTrj 
+(PvtOverrideTrj.h), so the operator can slow it down for inspection or
+speed it up while it runs: type + or - and press Enter to change the 
+feed-rate override by 10%.
+
 */
 
 #include <stdio.h>
@@ -31,8 +57,20 @@ object for execution.
 #include <vector>
 #include <list>
 #include <mutex>
+#include <thread>
 #include "CML.h"
 #include "ecat/ecat_winudp.h"
+#include "PvtSoaTrj.h"
+#include "PvtDecimator.h"
+#include "PvtOverrideTrj.h"
+#include "TpdoExecutor.h"
+
+#if defined( WIN32 )
+#  include <conio.h>
+#else
+#  include <poll.h>
+#  include <unistd.h>
+#endif
 
 using std::cout;
 using std::endl;
@@ -50,6 +88,7 @@ CML_NAMESPACE_USE();
 
 /* local functions */
 static void showerr( const Error *err, const char *str );
+static int readConsole( char *buf, int size );
 void appendLastPosition(vector<double>& vector, size_t number);
 
 #define numberOfAxes 2
@@ -60,7 +99,7 @@ void appendLastPosition(vector<double>& vector, size_t number);
 // This PDO will be used to send the motor position,
 // actual current, and digital input states from the
 // drive to the master.
-class TpdoActPosActCurrent: public TPDO
+class TpdoActPosActCurrent: public DeferredTpdo<double>
 {
 
 public:
@@ -78,8 +117,12 @@ public:
    // listen for it.
    const Error *Init( Amp &ampObj, int slot);
 
-   // This function is called when the PDO is received
-   virtual void Received(void);
+   // Called on the receive thread when the PDO is received, to copy
+   // the position while teaching.
+   virtual bool Capture(double& position);
+
+   // Called on the executor's worker thread to record the position.
+   virtual void Process(const double& position);
 
 private:
 
@@ -97,6 +140,7 @@ private:
 /* local data */
 int32 canBPS = 1000000;             // CAN network bit rate (1MB)
 Amp ampArray[numberOfAxes];
+TpdoExecutor tpdoExecutor;
 TpdoActPosActCurrent tpdo[numberOfAxes];
 
 /**************************************************
@@ -106,6 +150,7 @@ TpdoActPosActCurrent tpdo[numberOfAxes];
 int main( void )
 {
     uint8 timeBetweenPoints{ 15 }; // 15 milliseconds between points
+    double positionTolerance{ 5.0 }; // largest allowed path error (encoder counts)
 
     // The libraries define one global object of type
     // CopleyMotionLibraries named cml.
@@ -131,6 +176,10 @@ int main( void )
     int node = -1;
 
     printf("\nDoing init\n");
+
+    // one worker thread records the positions of every axis.
+    err = tpdoExecutor.Start(1);
+    showerr(err, "Starting the TPDO executor");
     
     // Step 1: initialize the nodes on the EtherCAT network
     // Step 2: set the nodes to pre-op mode.
@@ -171,6 +220,9 @@ int main( void )
 
        //showerr(err, "Initting tpdo");
 
+       err = tpdo[i].SetExecutor(&tpdoExecutor);
+       showerr(err, "Attaching the TPDO executor");
+
        err = ampArray[i].StartNode();
        
        while (err) {
@@ -209,6 +261,13 @@ int main( void )
         tpdo[i].isTeaching = false;
     }
 
+    // let the worker record the positions still queued.
+    for (int i = 0; i < numberOfAxes; i++) {
+        if (!tpdo[i].WaitIdle(1000))
+            cout << "Axis " << i + 1 << " positions were still being recorded." << endl;
+        tpdo[i].Dump(stdout, i ? "TxPDO axis B" : "TxPDO axis A");
+    }
+
     cout << "Recording stopped. Move will now begin." << endl;
 
     for (int i = 0; i < numberOfAxes; i++) {
@@ -252,20 +311,32 @@ int main( void )
     }
 
     // load the PVT points using 15 ms between points.
-    PvtConstAccelTrj pvtConstAccelTrjObj;
+    PvtSoaTrj pvtTrj;
        
     // initialize it with the number of axes.
-    pvtConstAccelTrjObj.Init(numberOfAxes);
-       
-    // load all the PVT points into the PVT object.
-    for (size_t i = 0; i < sizeForAllAxes; i++) {
-        vector<double> singlePointVec;
-
-        for (int j = 0; j < numberOfAxes; j++) {
-            singlePointVec.push_back(tpdo[j].positionsVector[i]);
+    err = pvtTrj.Init(numberOfAxes);
+    showerr(err, "Initializing the PVT object");
+
+    // interleave the recorded positions point by point: { A0, B0, A1, B1, ... }
+    vector<double> recordedPoints(sizeForAllAxes * numberOfAxes);
+    for (int j = 0; j < numberOfAxes; j++) {
+        for (size_t i = 0; i < sizeForAllAxes; i++) {
+            recordedPoints[i * numberOfAxes + j] = tpdo[j].positionsVector[i];
         }
+    }
+
+    // load the PVT points needed to stay within the tolerance into the PVT object.
+    PvtDecimator decimator;
+    err = decimator.SetTolerance(positionTolerance);
+    showerr(err, "Setting the decimation tolerance");
+    err = decimator.Decimate(recordedPoints.data(), timeBetweenPoints, sizeForAllAxes, numberOfAxes, pvtTrj);
+    showerr(err, "Decimating the PVT points");
 
-        pvtConstAccelTrjObj.addPvtPoint(&singlePointVec, &timeBetweenPoints); // load into PVT object.
+    printf("Kept %zu of %zu recorded points, %.1f%% less PVT traffic (%llu bytes)\n",
+        decimator.GetOutputPoints(), decimator.GetInputPoints(), decimator.GetBandwidthSaved() * 100.0,
+        (unsigned long long)decimator.GetBytesSaved());
+    for (int i = 0; i < numberOfAxes; i++) {
+        printf("Axis %d largest path error: %.2f counts\n", i + 1, decimator.GetMaxError(i));
     }
 
     Point<numberOfAxes> startingPosition;
@@ -280,11 +351,8 @@ int main( void )
 
 
     // retrieve the starting position for the PVT move.
-    list<double>::iterator iterList;
-    vector<list<double>>* posVecPntr = pvtConstAccelTrjObj.getPositionsPntr();
     for (int i = 0; i < numberOfAxes; i++) {
-        iterList = (*posVecPntr)[i].begin();
-        startingPosition[i] = *iterList;
+        startingPosition[i] = pvtTrj.GetPositions(i)[0];
     }
 
     // move to the starting position before beginning the PVT move.
@@ -295,14 +363,39 @@ int main( void )
     linkageObj.WaitMoveDone(-1);
     showerr(err, "Waiting for move to starting position to finish");
 
-    // send the PVT points (trajectory) to the linkage object.
-    err = linkageObj.SendTrajectory(pvtConstAccelTrjObj, true); // true = start the move immediately.
+    // send the PVT points (trajectory) to the linkage object through the
+    // feed-rate override.
+    PvtOverrideTrj feedRate(pvtTrj);
+    err = linkageObj.SendTrajectory(feedRate, true); // true = start the move immediately.
     showerr(err, "Starting the linkage move");
 
-    // Wait for the move to finish. Set to -1 to wait indefinitely.
-    err = linkageObj.WaitMoveDone(-1);
+    // change the override from the console while the move runs. The
+    // console is only read between waits, without blocking, so nothing is
+    // left reading it once the move is done.
+    cout << "Type + or - and press Enter to change the speed by 10%." << endl;
+    while (true) {
+        err = linkageObj.WaitMoveDone(100);
+        if (err != &ThreadError::Timeout) break;
+
+        char keys[64];
+        int keyCt = readConsole(keys, sizeof(keys));
+        for (int i = 0; i < keyCt; i++) {
+            if (keys[i] == '+') feedRate.SetOverride(feedRate.GetOverride() + 0.1);
+            else if (keys[i] == '-') feedRate.SetOverride(feedRate.GetOverride() - 0.1);
+            else continue;
+            printf("Feed rate override %.0f%%\n", feedRate.GetOverride() * 100.0);
+        }
+    }
     showerr(err, "Waiting for the move to complete");
 
+    // stop the TxPDOs and take them off the executor before the globals
+    // are destroyed.
+    for (int i = 0; i < numberOfAxes; i++) {
+        err = ampArray[i].PreOpNode();
+        showerr(err, "Stopping the node");
+        tpdo[i].SetExecutor(0);
+    }
+
     return 0;
 }
 
@@ -318,6 +411,27 @@ static void showerr( const Error *err, const char *str )
    }
 }
 
+/**
+ * Read whatever has been typed on the console, without waiting.
+ * @return The number of characters read into buf.
+ */
+static int readConsole( char *buf, int size )
+{
+   int n = 0;
+#if defined( WIN32 )
+   while( n < size && _kbhit() )
+      buf[n++] = (char)_getch();
+#else
+   struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+   if( poll( &pfd, 1, 0 ) > 0 && (pfd.revents & POLLIN) )
+   {
+      ssize_t got = read( STDIN_FILENO, buf, size );
+      if( got > 0 ) n = (int)got;
+   }
+#endif
+   return n;
+}
+
 /**
  * Transmit PDO handling.
  * Each amplifier is being configured to send out a CAN message
@@ -365,25 +479,33 @@ const Error *TpdoActPosActCurrent::Init( Amp &ampObj, int slotNumber)
  *
  * Keep in mind that this function is called from the same thread that receives all
  * CANopen messages.  Keep any processing here short and don't try to do any SDO access.
- * Often it's best to simply post a semaphore here and have another thread handle the data.
+ * The recording is done by Process(), on the TpdoExecutor's worker thread.
  *
  */
-void TpdoActPosActCurrent::Received( void )
+bool TpdoActPosActCurrent::Capture( double& position )
 {
    //printf( "PDO received - position: %-9d current: %-5d \r", actualPosition.Read(), actualCurrent.Read() );
 
-   if (isTeaching) {
-       
-       // protect the access to the pvt object.
-       tpdoMutex.lock();
+   if (!isTeaching) return false;
 
-       // push the new position on the vector
-       positionsVector.push_back(actualPosition.Read()); // the position read from the drive.
-       
-       // unlock the mutex.
-       tpdoMutex.unlock();
-   }
+   position = actualPosition.Read(); // the position read from the drive.
+   return true;
+}
+
+/**
+ * Record one position captured while teaching. Called on the worker
+ * thread, in the order the PDOs were received.
+ */
+void TpdoActPosActCurrent::Process( const double& position )
+{
+   // protect the access to the pvt object.
+   tpdoMutex.lock();
+
+   // push the new position on the vector
+   positionsVector.push_back(position);
 
+   // unlock the mutex.
+   tpdoMutex.unlock();
 }
 
 // Append the position vector's last element.
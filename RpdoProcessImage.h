@@ -0,0 +1,110 @@
+/*
+
+RpdoProcessImage.h
+
+The RpdoProcessImage class sends every RPDO of a cyclic program with a
+single call per cycle.
+
+The RPDO classes in the examples write their mapped variables and
+transmit in the same Send() call, and each call looks up the network
+with a RefObjLocker<Network> before transmitting. A program with one
+RPDO per axis pays for that lookup once per axis every cycle, and the
+RPDOs of one cycle go out as the loop gets to them.
+
+An RpdoProcessImage holds the RPDOs of the program. Each cycle the
+program writes the mapped variables (Pmap::Write()) of all of them and
+then calls Commit(), which transmits all of the RPDOs back to back on
+the network pinned by Init() (see PinnedNetwork.h), without looking it
+up at all. On EtherCAT a transmitted RPDO is copied into the output
+process image, which the network sends in its next frame.
+
+Commit() is not atomic. Each RPDO is transmitted on its own, so the
+network thread can send a frame between two of them, and the outputs
+of one cycle can then be split over two frames. Committing right after
+the cycle wake up (as an EcatCyclicTask's WriteOutputs() does) makes
+that unlikely, not impossible. If one RPDO fails the rest are still
+sent, so no more of the image is left stale than has to be.
+
+The RPDOs are added once, before the cyclic thread starts; Commit()
+does not allocate.
+
+Usage:
+
+	RpdoProcessImage image;
+	image.Init(node);
+	image.Add(ctrlPDO[0]);
+	image.Add(ctrlPDO[1]);
+	...
+	// every cycle
+	ctrlPDO[0].pos.Write(p0);
+	ctrlPDO[1].pos.Write(p1);
+	err = image.Commit();
+
+*/
+
+#ifndef RPDO_PROCESS_IMAGE_H
+#define RPDO_PROCESS_IMAGE_H
+
+#include <cstddef>
+#include <vector>
+#include "CML.h"
+#include "PinnedNetwork.h"
+
+CML_NAMESPACE_START()
+
+class RpdoProcessImage
+{
+public:
+
+	RpdoProcessImage() {}
+
+	virtual ~RpdoProcessImage() {}
+
+	/**
+	 * Set the network the RPDOs are sent on.
+	 *
+	 * @param node Any node on the network.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Init(Node& node)
+	{
+		pdos.clear();
+		return network.Pin(node);
+	}
+
+	// Add an RPDO to the image. Call before the cyclic thread starts.
+	void Add(RPDO& pdo) { pdos.push_back(&pdo); }
+
+	// The number of RPDOs sent by each Commit().
+	size_t GetCount(void) const { return pdos.size(); }
+
+	/**
+	 * Transmit every RPDO in the image with the values last written to
+	 * their mapped variables. An RPDO that fails does not stop the rest
+	 * being sent.
+	 *
+	 * @return NULL on success, or the error of the first RPDO that
+	 *         failed.
+	 */
+	const Error* Commit(void)
+	{
+		Network* net = network.Get();
+		if (!net) return &NodeError::NetworkUnavailable;
+
+		const Error* first = 0;
+		for (size_t i = 0; i < pdos.size(); i++) {
+			const Error* err = pdos[i]->Transmit(*net);
+			if (err && !first) first = err;
+		}
+		return first;
+	}
+
+protected:
+
+	PinnedNetwork network;
+	std::vector<RPDO*> pdos;
+};
+
+CML_NAMESPACE_END()
+
+#endif
@@ -0,0 +1,45 @@
+/*
+
+StartPvtPositions.h
+
+The positions (encoder counts) traversed by the PVT stream in
+StartPvtUsingDigitalInput.cpp. They are kept in their own header so
+PvtBenchmark.cpp can retime the same path. The last position is equal
+to the first so the move ends where it started.
+
+*/
+
+#ifndef START_PVT_POSITIONS_H
+#define START_PVT_POSITIONS_H
+
+static const double positionsArr[407] = { -9558.1607,-9849.06,-11270.5,-14722.4,-19392.7,-24063,-27515,-28936.3,-29139.4107,-27633.1607,-26126.9107,-24620.6607,-23114.4107,-21608.1607,
+-20101.9107,-18595.6607,-17089.4107,-15583.1607,-14076.9107,-12570.6607,-11064.4107,-9558.1607,-8051.9107,-6545.6607,-5039.4107,-3533.1607,-2026.9107,-520.6607,985.589275,
+2491.839275,3998.089275,5504.339275,7010.589275,8516.839275,10023.08928,11529.33928,13035.58928,14541.83928,16048.08928,17554.33928,19060.58928,20566.83928,22073.08928,
+23579.33928,25085.58928,26591.83928,28098.08928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,
+29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,
+29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,
+29604.33928,29604.33928,28098.08928,26591.83928,25085.58928,23579.33928,22073.08928,20566.83928,19060.58928,17554.33928,16048.08928,14541.83928,13035.58928,11529.33928,
+10023.08928,8516.839275,7010.589275,5504.339275,3998.089275,2491.839275,985.589275,-520.6607,-2026.9107,-3533.1607,-5039.4107,-6545.6607,-8051.9107,-9558.1607,-11064.4107,
+-12570.6607,-14076.9107,-15583.1607,-17089.4107,-18595.6607,-20101.9107,-21608.1607,-23114.4107,-24620.6607,-26126.9107,-27633.1607,-29139.4107,-29139.4107,-29139.4107,
+-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,
+-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,
+-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-27633.1607,-26126.9107,-24620.6607,-23114.4107,-21608.1607,-20101.9107,
+-18595.6607,-17089.4107,-15583.1607,-14076.9107,-12570.6607,-11064.4107,-9558.1607,-8051.9107,-6545.6607,-5039.4107,-3533.1607,-2026.9107,-520.6607,985.589275,2491.839275,
+3998.089275,5504.339275,7010.589275,8516.839275,10023.08928,11529.33928,13035.58928,14541.83928,16048.08928,17554.33928,19060.58928,20566.83928,22073.08928,23579.33928,
+25085.58928,26591.83928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,
+28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,
+28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,26591.83928,25085.58928,
+23579.33928,22073.08928,20566.83928,19060.58928,17554.33928,16048.08928,14541.83928,13035.58928,11529.33928,10023.08928,8516.839275,7010.589275,5504.339275,3998.089275,
+2491.839275,985.589275,-520.6607,-2026.9107,-3533.1607,-5039.4107,-6545.6607,-8051.9107,-9558.1607,-11064.4107,-12570.6607,-14076.9107,-15583.1607,-17089.4107,-18595.6607,
+-20101.9107,-21608.1607,-23114.4107,-24620.6607,-26126.9107,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,
+-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,
+-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,
+-26126.9107,-24620.6607,-23114.4107,-21608.1607,-20101.9107,-18595.6607,-17089.4107,-15583.1607,-14076.9107,-12570.6607,-11064.4107,-9558.1607,-8051.9107,-6545.6607,
+-5039.4107,-3533.1607,-2026.9107,-520.6607,985.589275,2491.839275,3998.089275,5504.339275,7010.589275,8516.839275,10023.08928,11529.33928,13035.58928,14541.83928,16048.08928,
+17554.33928,19060.58928,20566.83928,22073.08928,23579.33928,25085.58928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,
+26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,
+26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,
+25085.58928,23579.33928,22073.08928,20566.83928,19060.58928,17554.33928,16048.08928,14541.83928,13035.58928,11529.33928,10023.08928,8516.839275,7010.589275,5504.339275,
+3998.089275,2491.839275,985.589275,-520.6607,-2026.9107,-3533.1607,-5039.4107,-6545.6607,-8051.9107,-9558.1607 };
+
+#endif
@@ -14,19 +14,37 @@ This example will configure IN1 to update the trajectory (start the move) when
 IN1 undergoes a low-high transition. It will also configure OUT1 to be Active ON 
 when the trajectory generator is running (move in progress). 
 
-CML will load the initial 32 PVT points into the drive's internal memory. Then it 
-will wait for the state of IN1 to be high, meaning the move is in progress. Then 
-it will start a thread that monitors the PVT buffer and fills it with fresh PVT 
-data as the move progresses. While that internal CML thread is running, the main 
-thread will wait for OUT1 to go low, meaning that the trajectory genertor is no 
-longer running (the move is complete). 
+The PVT points are streamed through a PvtStreamTrj object (PvtStreamTrj.h). A 
+producer thread adds the points to the stream while the move runs, and the stream 
+calculates each point's velocity from a short window of the points that follow it. 
+CML will load the first PVT points into the drive's internal memory. Then it will 
+keep the PVT buffer filled with fresh PVT data in a non-blocking thread once IN1 
+starts the move. The whole trajectory never needs to be in memory at once, so the 
+same approach works for streams that are generated on the fly. While that internal 
+CML thread is running, the main thread will wait for OUT1 to go low, meaning that 
+the trajectory genertor is no longer running (the move is complete). 
+
+The stream is passed to the linkage through a PvtAdaptiveTrj object 
+(PvtAdaptiveTrj.h). Instead of a fixed number of points, it measures the
+refills while the move runs and sets how many points are kept queued in
+the drive so that a target margin of motion is always left, and it 
+prints what it decided after every move. What it learns is kept from 
+one of the five moves to the next.
+
+Before they are streamed, the points are passed through a PvtRunCompressor
+(PvtRunCompressor.h). Runs of identical points (dwells) and runs of evenly
+spaced points (constant velocity) are replaced by a few long segments with
+their velocities fixed, so fewer points cross the network and the dwells
+hold exactly still. The reduction is printed by the producer.
 
 The user should specify the positions (units are encoder counts) to traverse in 
-the PVT stream using the position array shown below. The user should also specify 
-the time it will take to travel to each position (units are milliseconds). The 
-PvtConstAccelTrj class will calculate the velocity data for the PVT stream so that
-acceleration will be continuous between waypoints, thereby reducing the risk of 
-a following error. 
+the PVT stream using the position array in StartPvtPositions.h. The user should 
+also specify the time it will take to travel to each position (units are 
+milliseconds). PvtBenchmark.cpp shows how short these times can be made for 
+the linkage move limits with the PvtRetimer class (PvtRetimer.h). The 
+PvtStreamTrj object calculates the velocity data of the points that the 
+PvtRunCompressor passes on to it so that acceleration will be continuous between 
+waypoints, thereby reducing the risk of a following error. 
 
 Make sure to travel to the first position of the PVT stream before beginning the 
 PVT move or a following error will result. This example sets the last position 
@@ -38,7 +56,14 @@ Make sure to toggle digital input 1 to start the move.
 */
 
 #include <iostream>
+#include <functional>
+#include <thread>
 #include "CML.h"
+#include "PvtStreamTrj.h"
+#include "PvtAdaptiveTrj.h"
+#include "PvtRunCompressor.h"
+#include "TpdoSnapshot.h"
+#include "StartPvtPositions.h"
 
 using std::cout;
 
@@ -70,81 +95,48 @@ static void showerr(const Error* err, const char* str);
 int32 canBPS = 1000000;             // CAN network bit rate
 int16 canNodeID = 1;                // CANopen node ID
 
-double positionsArr[407] = { -9558.1607,-9849.06,-11270.5,-14722.4,-19392.7,-24063,-27515,-28936.3,-29139.4107,-27633.1607,-26126.9107,-24620.6607,-23114.4107,-21608.1607,
--20101.9107,-18595.6607,-17089.4107,-15583.1607,-14076.9107,-12570.6607,-11064.4107,-9558.1607,-8051.9107,-6545.6607,-5039.4107,-3533.1607,-2026.9107,-520.6607,985.589275,
-2491.839275,3998.089275,5504.339275,7010.589275,8516.839275,10023.08928,11529.33928,13035.58928,14541.83928,16048.08928,17554.33928,19060.58928,20566.83928,22073.08928,
-23579.33928,25085.58928,26591.83928,28098.08928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,
-29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,
-29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,29604.33928,
-29604.33928,29604.33928,28098.08928,26591.83928,25085.58928,23579.33928,22073.08928,20566.83928,19060.58928,17554.33928,16048.08928,14541.83928,13035.58928,11529.33928,
-10023.08928,8516.839275,7010.589275,5504.339275,3998.089275,2491.839275,985.589275,-520.6607,-2026.9107,-3533.1607,-5039.4107,-6545.6607,-8051.9107,-9558.1607,-11064.4107,
--12570.6607,-14076.9107,-15583.1607,-17089.4107,-18595.6607,-20101.9107,-21608.1607,-23114.4107,-24620.6607,-26126.9107,-27633.1607,-29139.4107,-29139.4107,-29139.4107,
--29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,
--29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,
--29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-29139.4107,-27633.1607,-26126.9107,-24620.6607,-23114.4107,-21608.1607,-20101.9107,
--18595.6607,-17089.4107,-15583.1607,-14076.9107,-12570.6607,-11064.4107,-9558.1607,-8051.9107,-6545.6607,-5039.4107,-3533.1607,-2026.9107,-520.6607,985.589275,2491.839275,
-3998.089275,5504.339275,7010.589275,8516.839275,10023.08928,11529.33928,13035.58928,14541.83928,16048.08928,17554.33928,19060.58928,20566.83928,22073.08928,23579.33928,
-25085.58928,26591.83928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,
-28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,
-28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,28098.08928,26591.83928,25085.58928,
-23579.33928,22073.08928,20566.83928,19060.58928,17554.33928,16048.08928,14541.83928,13035.58928,11529.33928,10023.08928,8516.839275,7010.589275,5504.339275,3998.089275,
-2491.839275,985.589275,-520.6607,-2026.9107,-3533.1607,-5039.4107,-6545.6607,-8051.9107,-9558.1607,-11064.4107,-12570.6607,-14076.9107,-15583.1607,-17089.4107,-18595.6607,
--20101.9107,-21608.1607,-23114.4107,-24620.6607,-26126.9107,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,
--27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,
--27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,-27633.1607,
--26126.9107,-24620.6607,-23114.4107,-21608.1607,-20101.9107,-18595.6607,-17089.4107,-15583.1607,-14076.9107,-12570.6607,-11064.4107,-9558.1607,-8051.9107,-6545.6607,
--5039.4107,-3533.1607,-2026.9107,-520.6607,985.589275,2491.839275,3998.089275,5504.339275,7010.589275,8516.839275,10023.08928,11529.33928,13035.58928,14541.83928,16048.08928,
-17554.33928,19060.58928,20566.83928,22073.08928,23579.33928,25085.58928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,
-26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,
-26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,26591.83928,
-25085.58928,23579.33928,22073.08928,20566.83928,19060.58928,17554.33928,16048.08928,14541.83928,13035.58928,11529.33928,10023.08928,8516.839275,7010.589275,5504.339275,
-3998.089275,2491.839275,985.589275,-520.6607,-2026.9107,-3533.1607,-5039.4107,-6545.6607,-8051.9107,-9558.1607 };
-
-// Load the PVT data into the PvtConstAccelTrj object.
-// pvtConstTrjObj : a reference to an instance of the PvtConstAccelTrj class.
-// isStartOfMove  : is this the start of the PVT move? If so, just load the
-//                  first 32 PVT points into the pvtConstTrjObj. 
-void loadPvtPoints(PvtConstAccelTrj& pvtConstTrjObj, bool isStartOfMove) 
+// the positions to traverse are in StartPvtPositions.h.
+
+// Stream the PVT data into the PvtStreamTrj object. This is run in its own
+// thread so that points are produced while the move is in progress. 
+// addPvtPoint() blocks while the stream's buffer is full, so only a small 
+// window of the trajectory is held in memory at any time.
+// pvtStream : a reference to an instance of the PvtStreamTrj class.
+void streamPvtPoints(PvtStreamTrj& pvtStream) 
 {
-	try 
+	uint8 timeBetweenPoints = 50; // units are milliseconds
+
+	const Error* err = 0;
+
+	int numberOfPoints = sizeof(positionsArr) / sizeof(positionsArr[0]);
+
+	// interleave the points, one position per axis.
+	std::vector<double> points(numberOfPoints * AXIS_NUM);
+	for (int i = 0; i < numberOfPoints; i++) 
 	{
-		uint8 timeBetweenPoints = 50; // units are milliseconds
-
-		const Error* err = 0;
-		vector<double> tempVec = { 0.0, 0.0 };
-		vector<double>* tempVecPntr = &tempVec;
-
-		vector<double> xPosVec;
-		vector<double> yPosVec;
-
-		vector<uint8> timeVec;
-		timeVec.push_back(timeBetweenPoints); // 50ms
-		
-		int startingIndex = 32;
-		int endingIndex = 407;
-
-		// if this is the start of the move, load the first 32 points
-		if (isStartOfMove) 
-		{
-			startingIndex = 0; 
-			endingIndex = 32;
-		}
-
-		for (int i = startingIndex; i < endingIndex; i++) 
-		{
-			tempVec[0] = positionsArr[i];
-			tempVec[1] = positionsArr[i]; // for now axis B will just mirror axis A behavior.
-
-			err = pvtConstTrjObj.addPvtPoint(tempVecPntr, &timeVec[0]);
-			showerr(err, "adding points to the PVT object");
-		}
+		points[i * AXIS_NUM + 0] = positionsArr[i];
+		points[i * AXIS_NUM + 1] = positionsArr[i]; // for now axis B will just mirror axis A behavior.
 	}
-	// catch any exception here
-	catch (...) 
+
+	// replace the dwells and constant velocity runs with a few long segments.
+	PvtRunCompressor compressor;
+	err = compressor.Compress(points.data(), timeBetweenPoints, numberOfPoints, AXIS_NUM);
+	showerr(err, "compressing the PVT points");
+
+	printf("PVT points: %u in, %u out (%.2fx), %llu bytes saved\n", (unsigned)compressor.GetInputPoints(),
+		(unsigned)compressor.GetOutputPoints(), compressor.GetReduction(), (unsigned long long)compressor.GetBytesSaved());
+
+	for (size_t i = 0; i < compressor.GetPointCount(); i++) 
 	{
-		cout << "\nException occured in loadPvtPoints.\n";
-		throw;
+		// the last point's time is not used; the stream ends there.
+		uint8 time = compressor.GetTime(i) ? compressor.GetTime(i) : timeBetweenPoints;
+
+		err = pvtStream.addPvtPoint(compressor.GetPosition(i), time, compressor.GetPinnedVelocity(i));
+		showerr(err, "adding points to the PVT stream");
 	}
+
+	// the last point added is the end of the move.
+	pvtStream.EndStream();
 }
 
 // Define a class based on the TPDO base class. A Transmit PDO is 
@@ -168,7 +160,9 @@ public:
 
 	bool display = false;
 
-	uint16 lastDigitalOutputValue = 0;
+	// The digital outputs last received. The main thread polls this while
+	// the receive thread updates it.
+	TpdoSnapshot<uint16> lastDigitalOutputValue;
 
 private:
 
@@ -224,7 +218,7 @@ const Error* TpdoDigitalOutputs::Init(Amp& ampObj, int slotNumber)
  */
 void TpdoDigitalOutputs::Received(void)
 {
-	lastDigitalOutputValue = digitalOutputs.Read();
+	lastDigitalOutputValue.Publish(digitalOutputs.Read());
 }
 
 int main(void)
@@ -313,21 +307,17 @@ int main(void)
 	err = amp[0].Download(0x2000, 0, 9, out1ConfigTrjGenRunning);
 	showerr(err, "Setting OUT1 config as custom trajectory status, trajectory generator running, output active on");
 
-	// create an instance of the PvtConstAccelTrj class.
-	PvtConstAccelTrj pvtConstTrjObj;
+	// create an instance of the PvtStreamTrj class.
+	PvtStreamTrj pvtStream;
 
 	// initialize the object with the number of dimensions in the trajectory.
-	pvtConstTrjObj.Init(AXIS_NUM);
-	showerr(err, "initializing the PvtConstAccelTrj object");
+	err = pvtStream.Init(AXIS_NUM);
+	showerr(err, "initializing the PvtStreamTrj object");
 
-	// load the first 32 PVT points into the PVT object.
-	loadPvtPoints(pvtConstTrjObj, true);
-
-	// extract the starting point for the PVT stream.
+	// the starting point for the PVT stream.
 	Point<AXIS_NUM> startingPoint;
-	vector<list<double>>* posPntr = pvtConstTrjObj.getPositionsPntr();
-	startingPoint[0] = (*posPntr)[0].front();
-	startingPoint[1] = (*posPntr)[1].front();
+	startingPoint[0] = positionsArr[0];
+	startingPoint[1] = positionsArr[0];
 
 	// NOTE: change this value to 21 if driving a non-stepper motor. 
 	// Use 31 if driving a stepper motor.
@@ -373,7 +363,7 @@ int main(void)
 	CML::Thread::sleep(1000); // wait one second for the move to start
 
 	// wait for OUT1 to clear, meaning the move is finished.
-	while (digitalOutputsTpdo.lastDigitalOutputValue & 1) {}
+	while (digitalOutputsTpdo.lastDigitalOutputValue.Get() & 1) {}
 
 	// 0x0d is the "write parameter" op-code. 
 	// ASCII parameter 0x00c8 is "Traj Config" axis A. Set it to a value of 0x0003 for PVT mode. 
@@ -387,34 +377,34 @@ int main(void)
 	err = amp[0].Download(0x2000, 0, 5, setTrajConfigPvtAxisB);
 	showerr(err, "Setting the trajectory config to PVT mode on axis B");
 
-	// send the trajectory to the linkage.
-	err = link.SendTrajectory(pvtConstTrjObj, false);
-	showerr(err, "sending first 32 PVT points");
+	// sets how many points are kept queued in the drive from the measured
+	// refills, aiming to keep at least 30 ms of motion queued.
+	PvtAdaptiveTrj adaptiveStream(pvtStream);
+	adaptiveStream.SetTargetMargin(30.0);
 
 	// Make the PVT move five times in a row.
 	for (int i = 0; i < 5; i++) {
 
+		// start producing the PVT points for this move.
+		std::thread producer(streamPvtPoints, std::ref(pvtStream));
+
+		// send the PVT stream to the linkage. CML loads the first points into
+		// the drive now and handles the PVT buffer management in a non-blocking 
+		// thread once IN1 starts the move.
+		err = link.SendTrajectory(adaptiveStream, false);
+		showerr(err, "sending PVT stream");
+
 		// waiting for move to start
 		err = amp[0].WaitInputHigh(1);
 		showerr(err, "waiting for IN1 to go high");
-
-		// load the rest of the points into the PVT object
-		loadPvtPoints(pvtConstTrjObj, false);
-
-		// send the PVT object to the linkage for streaming. CML will 
-		// handle the PVT buffer management in a non-blocking thread.
-		err = link.SendTrajectory(pvtConstTrjObj, false);
-		showerr(err, "sending rest of PVT points");
+		adaptiveStream.MarkMotionStart();
 
 		// wait for the move to finish (OUT1 is clear)
-		while(digitalOutputsTpdo.lastDigitalOutputValue & 1){ }
+		while(digitalOutputsTpdo.lastDigitalOutputValue.Get() & 1){ }
 
-		// load the first 32 PVT points into the PVT object for the next iteration. 
-		loadPvtPoints(pvtConstTrjObj, true);
+		producer.join();
 
-		// load the first 32 PVT points into the drive
-		err = link.SendTrajectory(pvtConstTrjObj, false);
-		showerr(err, "sending first 32 PVT points");
+		adaptiveStream.Dump(stdout);
 	}
 
 	uint16 canOpenDesiredState = 30;
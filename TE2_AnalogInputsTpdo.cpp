@@ -14,6 +14,7 @@ to a TPDO for easy reading.
 #include <cstdlib>
 #include <iostream>
 #include "CML.h"
+#include "TelemetrySink.h"
 
 using std::cout;
 using std::endl;
@@ -35,6 +36,19 @@ CML_NAMESPACE_USE();
 /* local functions */
 static void showerr( const Error *err, const char *str );
 
+// The analog inputs of one TpdoAnalogInputs, as printed.
+struct AnalogInputsRecord
+{
+    int16 analogInputA;
+    int16 analogInputB;
+};
+
+// Print one record, on the telemetry thread.
+static void printAnalogInputs(FILE* fp, const AnalogInputsRecord& r)
+{
+    fprintf(fp, "AnalogInputA: %d AnalogInputB: %d\n", r.analogInputA, r.analogInputB);
+}
+
 // Define a class based on the TPDO base class. A Transmit PDO is 
 // one that's transmitted by the CANopen node and received by the 
 // master. This PDO will be used to send the analog input states 
@@ -44,8 +58,8 @@ class TpdoAnalogInputs : public TPDO
 
 public:
 
-    // Default constructor does nothing
-    TpdoAnalogInputs() {}
+    // Default constructor, the records are printed by printAnalogInputs()
+    TpdoAnalogInputs() : telemetry(printAnalogInputs) {}
 
     // Called once at startup to map the PDO and configure CML to 
     // listen for it.
@@ -56,6 +70,10 @@ public:
 
     bool display{ false };
 
+    // While display is set, the inputs received are pushed here and
+    // printed on the sink's own thread.
+    TelemetrySink<AnalogInputsRecord> telemetry;
+
 private:
 
     // These variables are used to map objects to the PDO.
@@ -106,14 +124,17 @@ const Error * TpdoAnalogInputs::Init( Amp &ampObj, int slotNumber)
  *
  * Keep in mind that this function is called from the same thread that receives all
  * CANopen messages.  Keep any processing here short and don't try to do any SDO access.
- * Often it's best to simply post a semaphore here and have another thread handle the data.
+ * The inputs are pushed to a TelemetrySink (TelemetrySink.h), which prints them on its
+ * own thread without holding this one up.
  *
  */
 void TpdoAnalogInputs::Received( void )
 {
    if (display) {
-       cout << "AnalogInputA: " << (int16)analogInputAxisA.Read() << " AnalogInputB: " << (int16)analogInputAxisB.Read() << endl;
-       CML::Thread::sleep(100);
+       AnalogInputsRecord r;
+       r.analogInputA = (int16)analogInputAxisA.Read();
+       r.analogInputB = (int16)analogInputAxisB.Read();
+       telemetry.Push(r);
    }
 }
 
@@ -181,6 +202,11 @@ int main( void )
    err = analogInputsTpdo.Init(ampArray[0], 2); // use slot 2 or 3.
    showerr(err, "Initting non-fixed tpdo");
 
+   // print the analog inputs ten times a second.
+   analogInputsTpdo.telemetry.SetMinPeriod(100);
+   err = analogInputsTpdo.telemetry.Start(stdout);
+   showerr(err, "Starting the telemetry thread");
+
    analogInputsTpdo.display = true;
 
    // starting node
@@ -192,7 +218,7 @@ int main( void )
 
    // turn off printing to console
    analogInputsTpdo.display = false;
-   CML::Thread::sleep(100);
+   analogInputsTpdo.telemetry.Stop();
 
    int16 analogInputA;
    int16 analogInputB; 
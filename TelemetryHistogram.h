@@ -0,0 +1,149 @@
+/*
+
+TelemetryHistogram.h
+
+A small fixed-bucket histogram for timing measurements (latencies,
+buffer margins, batch sizes). All memory is allocated when the bucket
+edges are set, so Record() is cheap enough to call from a time
+critical thread. It is not thread safe on its own; the classes that
+use it hold their own lock around it.
+
+	TelemetryHistogram hist;
+	hist.SetLogBuckets(1.0, 100000.0);   // 1 us to 100 ms
+	hist.Record(elapsedUs);
+	...
+	hist.Print(stdout, "refill interval", "us");
+
+*/
+
+#ifndef TELEMETRY_HISTOGRAM_H
+#define TELEMETRY_HISTOGRAM_H
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "CML.h"
+
+CML_NAMESPACE_START()
+
+class TelemetryHistogram
+{
+public:
+
+	TelemetryHistogram() { SetLogBuckets(1.0, 1000000.0); }
+
+	/**
+	 * Use buckets whose edges double from first to last. Values below the
+	 * first edge and above the last edge are counted in the first and
+	 * last bucket.
+	 */
+	void SetLogBuckets(double first, double last)
+	{
+		if (first <= 0.0) first = 1.0;
+
+		edges.clear();
+		for (double e = first; e < last * 1.0001; e *= 2.0)
+			edges.push_back(e);
+		counts.assign(edges.size() + 1, 0);
+		Clear();
+	}
+
+	/**
+	 * Use evenly spaced buckets, step wide, from first to last.
+	 */
+	void SetLinearBuckets(double first, double last, double step)
+	{
+		if (step <= 0.0) step = 1.0;
+
+		edges.clear();
+		for (double e = first; e < last + step * 0.5; e += step)
+			edges.push_back(e);
+		counts.assign(edges.size() + 1, 0);
+		Clear();
+	}
+
+	// Reset the counts, keeping the buckets.
+	void Clear(void)
+	{
+		for (size_t i = 0; i < counts.size(); i++) counts[i] = 0;
+		total = 0;
+		sum = 0.0;
+		minValue = DBL_MAX;
+		maxValue = -DBL_MAX;
+	}
+
+	void Record(double value)
+	{
+		// binary search for the first edge above the value.
+		size_t lo = 0, hi = edges.size();
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			if (value < edges[mid]) hi = mid;
+			else lo = mid + 1;
+		}
+		counts[lo]++;
+
+		total++;
+		sum += value;
+		if (value < minValue) minValue = value;
+		if (value > maxValue) maxValue = value;
+	}
+
+	uint64 GetCount(void) const { return total; }
+	double GetMin(void) const { return total ? minValue : 0.0; }
+	double GetMax(void) const { return total ? maxValue : 0.0; }
+	double GetMean(void) const { return total ? sum / total : 0.0; }
+
+	/**
+	 * Estimate a percentile (0 to 100) from the buckets. The result is the
+	 * upper edge of the bucket the percentile falls in, so it errs on the
+	 * high side.
+	 */
+	double GetPercentile(double pct) const
+	{
+		if (!total) return 0.0;
+
+		uint64 target = (uint64)ceil(total * pct / 100.0);
+		if (target < 1) target = 1;
+
+		uint64 seen = 0;
+		for (size_t i = 0; i < counts.size(); i++) {
+			seen += counts[i];
+			if (seen >= target)
+				return (i < edges.size()) ? ((edges[i] < maxValue) ? edges[i] : maxValue) : maxValue;
+		}
+		return maxValue;
+	}
+
+	// Print a summary line and one line per non-empty bucket.
+	void Print(FILE* fp, const char* title, const char* unit) const
+	{
+		fprintf(fp, "%s: %llu samples, min %.1f, mean %.1f, p99 %.1f, max %.1f %s\n", title,
+			(unsigned long long)total, GetMin(), GetMean(), GetPercentile(99.0), GetMax(), unit);
+
+		for (size_t i = 0; i < counts.size(); i++) {
+			if (!counts[i]) continue;
+
+			if (i == 0)
+				fprintf(fp, "  %12s < %-10.1f %10llu\n", "", edges[0], (unsigned long long)counts[i]);
+			else if (i == edges.size())
+				fprintf(fp, "  %12.1f +%-11s %10llu\n", edges[i - 1], "", (unsigned long long)counts[i]);
+			else
+				fprintf(fp, "  %12.1f - %-10.1f %10llu\n", edges[i - 1], edges[i], (unsigned long long)counts[i]);
+		}
+	}
+
+protected:
+
+	std::vector<double> edges;     // upper edge of each bucket but the last
+	std::vector<uint64> counts;    // edges.size() + 1 buckets
+	uint64 total;
+	double sum;
+	double minValue;
+	double maxValue;
+};
+
+CML_NAMESPACE_END()
+
+#endif
@@ -0,0 +1,246 @@
+/*
+
+TelemetrySink.h
+
+The TelemetrySink class template takes records from a PDO's Received()
+function and writes them out on a thread of its own, so the receive
+thread never waits on console or file I/O.
+
+Received() is called on CML's high priority receive thread, the one
+that handles every PDO and SDO on the network. A printf() there takes
+as long as the console does, and a sleep there holds up every other
+PDO for the whole sleep. A TelemetrySink<T> holds a fixed ring of T
+records. Push() copies a record into it and returns, without locks,
+allocation or system calls, and a normal priority writer thread
+started by Start() formats the records with the formatter passed to
+the constructor and writes them to a FILE.
+
+- If the ring is full, Push() drops the record and counts it. The
+  writer prints the number dropped since its last report, so the
+  output shows where records are missing.
+- SetMinPeriod() keeps one record in every period (for printing a
+  value a few times a second from a PDO received every cycle); the
+  others are skipped and counted separately.
+- There must be only one thread pushing, normally the receive thread.
+
+Usage:
+
+	struct Inputs { int16 a, b; };
+
+	static void printInputs(FILE* fp, const Inputs& r)
+	{
+		fprintf(fp, "A: %d B: %d\n", r.a, r.b);
+	}
+
+	TelemetrySink<Inputs> telemetry(printInputs);
+	telemetry.SetMinPeriod(100);
+	err = telemetry.Start(stdout);
+
+	// in Received()
+	Inputs r = { (int16)inputA.Read(), (int16)inputB.Read() };
+	telemetry.Push(r);
+
+	// when done
+	telemetry.Stop();
+
+*/
+
+#ifndef TELEMETRY_SINK_H
+#define TELEMETRY_SINK_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "CML.h"
+
+#if defined( WIN32 )
+#  include <windows.h>
+#endif
+
+CML_NAMESPACE_START()
+
+// The number of records a sink holds unless told otherwise.
+#define TELEMETRY_SINK_CAPACITY 1024
+
+class TelemetrySinkError : public Error
+{
+public:
+	static const TelemetrySinkError AlreadyRunning;
+
+protected:
+	TelemetrySinkError(uint16 id, const char* desc) : Error(id, desc) {}
+};
+
+inline const TelemetrySinkError TelemetrySinkError::AlreadyRunning(0x9400, "The telemetry sink is already running");
+
+template <class T>
+class TelemetrySink
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Telemetry records must be trivially copyable");
+
+public:
+
+	// Writes one record to fp. Called on the writer thread only.
+	typedef void (*Formatter)(FILE* fp, const T& record);
+
+	/**
+	 * @param fmt      The function that writes each record.
+	 * @param capacity The most records waiting to be written. Rounded up
+	 *                 to a power of two.
+	 */
+	TelemetrySink(Formatter fmt, size_t capacity = TELEMETRY_SINK_CAPACITY) : format(fmt), fp(stdout),
+		pollMs(10), minPeriod(0), head(0), tail(0), pushed(0), written(0), dropped(0), skipped(0),
+		stopRequest(false), running(false)
+	{
+		size_t n = 2;
+		while (n < capacity) n <<= 1;
+		records.resize(n);
+		mask = n - 1;
+	}
+
+	virtual ~TelemetrySink() { Stop(); }
+
+	/**
+	 * Start the writer thread.
+	 *
+	 * @param file   Where the records are written.
+	 * @param waitMs How long the writer sleeps once it has written every
+	 *               record waiting.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Start(FILE* file = stdout, int waitMs = 10)
+	{
+		if (running.load()) return &TelemetrySinkError::AlreadyRunning;
+		if (thread.joinable()) thread.join();
+
+		fp = file;
+		pollMs = (waitMs > 0) ? waitMs : 1;
+		stopRequest.store(false);
+		running.store(true);
+		thread = std::thread(&TelemetrySink::Run, this);
+		return 0;
+	}
+
+	// Write every record still waiting and stop the writer thread.
+	void Stop(void)
+	{
+		stopRequest.store(true);
+		if (thread.joinable()) thread.join();
+	}
+
+	bool IsRunning(void) const { return running.load(); }
+
+	// Keep at most one record per period (ms), or every record if zero.
+	// Call before records are pushed.
+	void SetMinPeriod(double ms)
+	{
+		minPeriod = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(ms));
+		lastKept = Clock::time_point();
+	}
+
+	/**
+	 * Queue a record to be written. Only one thread may call this.
+	 *
+	 * @return true if the record was queued, false if it was skipped by
+	 *         the minimum period or dropped because the ring was full.
+	 */
+	bool Push(const T& record)
+	{
+		if (minPeriod.count()) {
+			Clock::time_point now = Clock::now();
+			if (now - lastKept < minPeriod) {
+				skipped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			lastKept = now;
+		}
+
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) > mask) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		records[t & mask] = record;
+		tail.store(t + 1, std::memory_order_release);
+		pushed.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// The number of records queued, written, dropped and skipped so far.
+	uint64 GetPushed(void) const { return pushed.load(); }
+	uint64 GetWritten(void) const { return written.load(); }
+	uint64 GetDropped(void) const { return dropped.load(); }
+	uint64 GetSkipped(void) const { return skipped.load(); }
+
+protected:
+
+	typedef std::chrono::steady_clock Clock;
+
+	// Write every record waiting. Returns the number written.
+	size_t Drain(void)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t t = tail.load(std::memory_order_acquire);
+		for (size_t i = h; i != t; i++) {
+			format(fp, records[i & mask]);
+			head.store(i + 1, std::memory_order_release);
+		}
+		written.fetch_add(t - h, std::memory_order_relaxed);
+		return t - h;
+	}
+
+	void Run(void)
+	{
+#if defined( WIN32 )
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#endif
+		uint64 reportedDrops = 0;
+
+		for (;;) {
+			bool stopping = stopRequest.load();
+			size_t n = Drain();
+
+			uint64 d = dropped.load(std::memory_order_relaxed);
+			if (d != reportedDrops) {
+				fprintf(fp, "\n[telemetry: %llu records dropped]\n", (unsigned long long)(d - reportedDrops));
+				reportedDrops = d;
+				n++;
+			}
+			if (n) fflush(fp);
+
+			if (stopping) break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(pollMs));
+		}
+		running.store(false);
+	}
+
+	Formatter format;
+	FILE* fp;
+	int pollMs;
+
+	// used by the pushing thread only.
+	Clock::duration minPeriod;
+	Clock::time_point lastKept;
+
+	std::vector<T> records;
+	size_t mask;
+	std::atomic<size_t> head;      // next record to write
+	std::atomic<size_t> tail;      // next free slot
+
+	std::atomic<uint64> pushed;
+	std::atomic<uint64> written;
+	std::atomic<uint64> dropped;
+	std::atomic<uint64> skipped;
+
+	std::atomic<bool> stopRequest;
+	std::atomic<bool> running;
+	std::thread thread;
+};
+
+CML_NAMESPACE_END()
+
+#endif
@@ -0,0 +1,723 @@
+/*
+
+TpdoExecutor.h
+
+The DeferredTpdo class template and the TpdoExecutor class move the
+processing of received TPDOs off CML's receive thread.
+
+TPDO::Received() is called on the thread that receives every message on
+the network, so anything slow done there (recording, filtering, running
+a control law) holds up every other PDO and SDO behind it. A
+DeferredTpdo<T> splits Received() in two:
+
+	Capture(record)    on the receive thread: copy the mapped variables
+	                   into a T, and return false to ignore the PDO
+	Process(record)    the work done with it
+
+Capture() should only read the mapped variables. The record is queued
+in the PDO's own ring and Process() is run according to the executor
+attached with SetExecutor():
+
+- No executor (inline): Process() runs straight away on the receive
+  thread, as Received() would.
+- A TpdoExecutor with one worker thread (dedicated): Process() runs on
+  the worker, for this PDO and any others attached to it.
+- A TpdoExecutor with several worker threads (shared pool): each PDO
+  is given a home worker, and a worker with nothing to do steals PDOs
+  queued on the others, so one slow PDO does not hold up the rest.
+
+However it is run, Process() is never called for the same PDO from two
+threads at once, and the records of a PDO are processed in the order
+they were received. The receive thread only copies the record into the
+ring and, if the PDO is not already queued, puts it on its worker's
+lock-free queue, waking the worker only if it is asleep. If the ring is
+full the record is dropped and counted.
+
+Every PDO keeps its own metrics: the number received, processed and
+dropped, the latency from Capture() to the start of Process(), the time
+Process() takes, and the queue depth (records waiting when a worker
+picked the PDO up). They are kept by the thread processing the records,
+which never takes a lock for them: after each batch it copies them into
+one of three buffers and swaps it for the newest, and readers take the
+newest. GetStats(), GetHistogram() and Dump() can be called while it
+runs; they lock only each other out, and Dump() prints from its copy.
+
+Usage:
+
+	class MyTpdo : public DeferredTpdo<int32>
+	{
+		Pmap32 position;
+		...
+		virtual bool Capture(int32& pos) { pos = position.Read(); return true; }
+		virtual void Process(const int32& pos) { ... }
+	};
+
+	TpdoExecutor executor;
+	err = executor.Start(2);          // two shared workers
+	err = tpdo.SetExecutor(&executor);
+	...
+	tpdo.Dump(stdout, "position TPDO");
+
+Attach the executors before the node is started, and stop the network
+(or detach the PDOs) before stopping an executor. An executor takes up
+to 64 PDOs at a time; SetExecutor(NULL) detaches a PDO and gives its
+place back, once its records have been processed.
+
+A worker may be in Process() until the PDO is detached, so detach it,
+or stop its executor, before it is destroyed; a class with its own
+members to tear down should call SetExecutor(NULL) in its destructor.
+A PDO still attached when the DeferredTpdo destructor runs drops the
+records not yet processed, since the class implementing Process() is
+gone, and waits until no worker holds it before its ring is freed.
+Either way, destroy (or detach) the PDOs before their executor.
+
+*/
+
+#ifndef TPDO_EXECUTOR_H
+#define TPDO_EXECUTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "CML.h"
+#include "TelemetryHistogram.h"
+
+CML_NAMESPACE_START()
+
+// The most PDOs one executor handles, and the most worker threads.
+#define TPDO_EXECUTOR_MAX_PDOS 64
+#define TPDO_EXECUTOR_MAX_WORKERS 16
+
+// Records of one PDO processed before a worker moves on to the next PDO.
+#define TPDO_EXECUTOR_BATCH 16
+
+class TpdoExecutorError : public Error
+{
+public:
+	static const TpdoExecutorError AlreadyRunning;
+	static const TpdoExecutorError BadWorkerCount;
+	static const TpdoExecutorError TooManyPdos;
+
+protected:
+	TpdoExecutorError(uint16 id, const char* desc) : Error(id, desc) {}
+};
+
+inline const TpdoExecutorError TpdoExecutorError::AlreadyRunning(0x9500, "The TPDO executor is already running");
+inline const TpdoExecutorError TpdoExecutorError::BadWorkerCount(0x9501, "The number of worker threads is out of range");
+inline const TpdoExecutorError TpdoExecutorError::TooManyPdos(0x9502, "Too many PDOs are attached to the TPDO executor");
+
+// The timing histograms kept for each PDO.
+enum TpdoExecTiming
+{
+	TPDO_EXEC_LATENCY,     // us from Capture() to the start of Process()
+	TPDO_EXEC_PROCESS,     // us in Process()
+	TPDO_EXEC_DEPTH,       // records waiting when the PDO was picked up
+	TPDO_EXEC_TIMINGS
+};
+
+struct TpdoExecStats
+{
+	uint64 received;        // records captured
+	uint64 processed;
+	uint64 dropped;         // records lost to a full ring
+	uint64 maxDepth;        // most records waiting at once
+	double worstLatencyUs;
+	double worstProcessUs;
+	bool inlineMode;        // no executor attached
+};
+
+class TpdoExecutor;
+
+class DeferredTpdoBase : public TPDO
+{
+public:
+
+	DeferredTpdoBase() : executor(0), home(0), scheduled(false), busy(0), received(0), dropped(0), maxDepth(0),
+		frontCopy(0), backCopy(1), middleCopy(2)
+	{
+		ClearStats();
+	}
+
+	virtual ~DeferredTpdoBase() {}
+
+	/**
+	 * Run Process() on an executor's threads, or on the receive thread
+	 * if exec is NULL. Any executor attached before is detached, after
+	 * waiting for it to process the records received if it is running.
+	 *
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* SetExecutor(TpdoExecutor* exec);
+
+	// Wait until every record received has been processed. Returns false
+	// on a timeout.
+	bool WaitIdle(int32 timeoutMs)
+	{
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+		while (HasPending() || scheduled.load()) {
+			if (std::chrono::steady_clock::now() > end) return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+
+	TpdoExecStats GetStats(void)
+	{
+		std::lock_guard<std::mutex> lock(readMutex);
+		return AddCounts(Latest().stats);
+	}
+
+	// Copy one of the histograms. Safe to call while PDOs are received.
+	TelemetryHistogram GetHistogram(TpdoExecTiming timing)
+	{
+		std::lock_guard<std::mutex> lock(readMutex);
+		return Latest().hist[timing];
+	}
+
+	// Print the counts and the latency, processing time and queue depth.
+	void Dump(FILE* fp, const char* name)
+	{
+		TpdoExecStats st;
+		TelemetryHistogram lat, proc;
+		{
+			std::lock_guard<std::mutex> lock(readMutex);
+			const StatsCopy& c = Latest();
+			st = AddCounts(c.stats);
+			lat = c.hist[TPDO_EXEC_LATENCY];
+			proc = c.hist[TPDO_EXEC_PROCESS];
+		}
+
+		fprintf(fp, "%s (%s): %llu received, %llu processed, %llu dropped, max depth %llu\n", name,
+			st.inlineMode ? "inline" : "deferred", (unsigned long long)st.received, (unsigned long long)st.processed,
+			(unsigned long long)st.dropped, (unsigned long long)st.maxDepth);
+		fprintf(fp, "  latency us: p50 %.1f, p99 %.1f, max %.1f; process us: p50 %.1f, p99 %.1f, max %.1f\n",
+			lat.GetPercentile(50), lat.GetPercentile(99), lat.GetMax(),
+			proc.GetPercentile(50), proc.GetPercentile(99), proc.GetMax());
+	}
+
+	// Reset the metrics. Call only while no PDOs are being received.
+	void ClearStats(void)
+	{
+		std::lock_guard<std::mutex> lock(readMutex);
+		TpdoExecStats empty = { 0, 0, 0, 0, 0.0, 0.0, false };
+		work.stats = empty;
+		work.hist[TPDO_EXEC_LATENCY].SetLogBuckets(1.0, 1000000.0);
+		work.hist[TPDO_EXEC_PROCESS].SetLogBuckets(1.0, 1000000.0);
+		work.hist[TPDO_EXEC_DEPTH].SetLogBuckets(1.0, 65536.0);
+		for (int i = 0; i < 3; i++)
+			copies[i] = work;
+		received.store(0);
+		dropped.store(0);
+		maxDepth.store(0);
+	}
+
+protected:
+
+	friend class TpdoExecutor;
+
+	typedef std::chrono::steady_clock Clock;
+
+	// Process up to maxRecords of the records waiting. Returns true if
+	// there are more.
+	virtual bool RunPending(size_t maxRecords) = 0;
+
+	// True if there are records waiting.
+	virtual bool HasPending(void) const = 0;
+
+	// Queue the PDO on its executor if it is not queued already. Called
+	// on the receive thread once a record is in the ring.
+	void Schedule(void);
+
+	// Wait until no worker of the executor has the PDO queued or is
+	// running it, and, if the executor is running, until the records
+	// received have been processed.
+	void WaitUnscheduled(void);
+
+	// The metrics kept by the thread processing records.
+	struct StatsCopy
+	{
+		TpdoExecStats stats;
+		TelemetryHistogram hist[TPDO_EXEC_TIMINGS];
+	};
+
+	// Set in middleCopy when the middle buffer is newer than the readers'.
+	enum { FRESH_COPY = 4 };
+
+	// Called by the thread processing records, before it starts a batch.
+	void RecordDepth(size_t depth)
+	{
+		work.hist[TPDO_EXEC_DEPTH].Record((double)depth);
+	}
+
+	// Called by the thread processing records, after each record.
+	void RecordTimes(double latencyUs, double processUs)
+	{
+		work.stats.processed++;
+		work.hist[TPDO_EXEC_LATENCY].Record(latencyUs);
+		work.hist[TPDO_EXEC_PROCESS].Record(processUs);
+		if (latencyUs > work.stats.worstLatencyUs) work.stats.worstLatencyUs = latencyUs;
+		if (processUs > work.stats.worstProcessUs) work.stats.worstProcessUs = processUs;
+	}
+
+	// Called by the thread processing records, after a batch. Copies the
+	// metrics into its buffer and swaps that for the middle one. The
+	// buckets match, so nothing is allocated.
+	void PublishStats(void)
+	{
+		copies[backCopy] = work;
+		backCopy = middleCopy.exchange(backCopy | FRESH_COPY, std::memory_order_acq_rel) & ~FRESH_COPY;
+	}
+
+	// The newest metrics published. Call with readMutex held; the copy
+	// is good until it is released.
+	const StatsCopy& Latest(void)
+	{
+		if (middleCopy.load(std::memory_order_relaxed) & FRESH_COPY)
+			frontCopy = middleCopy.exchange(frontCopy, std::memory_order_acq_rel) & ~FRESH_COPY;
+		return copies[frontCopy];
+	}
+
+	// Fill in the counts kept by the receive thread.
+	TpdoExecStats AddCounts(TpdoExecStats st) const
+	{
+		st.received = received.load();
+		st.dropped = dropped.load();
+		st.maxDepth = maxDepth.load();
+		st.inlineMode = (executor == 0);
+		return st;
+	}
+
+	static double Micros(Clock::duration d) { return std::chrono::duration<double, std::micro>(d).count(); }
+
+	TpdoExecutor* executor;
+	uint32 home;                    // the worker this PDO is queued on
+	std::atomic<bool> scheduled;    // queued on, or being run by, a worker
+	std::atomic<int> busy;          // workers in RunPdo() with this PDO
+
+	// written by the receive thread.
+	std::atomic<uint64> received;
+	std::atomic<uint64> dropped;
+	std::atomic<uint64> maxDepth;
+
+	// the processing thread's metrics, and the three buffers it passes
+	// them to readers through. Readers hold readMutex, which the
+	// processing thread never takes.
+	StatsCopy work;
+	StatsCopy copies[3];
+	int frontCopy;                  // the readers' buffer
+	int backCopy;                   // the processing thread's buffer
+	std::atomic<int> middleCopy;    // the other buffer, plus FRESH_COPY
+	std::mutex readMutex;
+};
+
+template <class T>
+class DeferredTpdo : public DeferredTpdoBase
+{
+	static_assert(std::is_copy_assignable<T>::value, "DeferredTpdo records must be copyable");
+
+public:
+
+	/**
+	 * @param capacity The most records of this PDO waiting to be
+	 *                 processed. Rounded up to a power of two.
+	 */
+	DeferredTpdo(size_t capacity = 64) : head(0), tail(0), discard(false)
+	{
+		size_t n = 2;
+		while (n < capacity) n <<= 1;
+		ring.resize(n);
+		mask = n - 1;
+	}
+
+	// Leaves the executor before the ring goes. Process() belongs to the
+	// class already destroyed, so the records still waiting are dropped.
+	virtual ~DeferredTpdo()
+	{
+		discard.store(true);
+		SetExecutor(0);
+	}
+
+	// Called on the receive thread; queues the record for Process().
+	virtual void Received(void)
+	{
+		Slot s;
+		if (!Capture(s.record)) return;
+		s.time = Clock::now();
+		received.fetch_add(1, std::memory_order_relaxed);
+
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t depth = t - head.load(std::memory_order_acquire);
+		if (depth > mask) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		ring[t & mask] = s;
+		tail.store(t + 1);
+
+		if (depth + 1 > maxDepth.load(std::memory_order_relaxed))
+			maxDepth.store(depth + 1, std::memory_order_relaxed);
+
+		if (!executor)
+			RunPending(mask + 1);
+		else
+			Schedule();
+	}
+
+protected:
+
+	// Copy the mapped variables into record. Return false to ignore this
+	// PDO. Runs on the receive thread; keep it short.
+	virtual bool Capture(T& record) = 0;
+
+	// Handle one record. Runs on the executor's thread, or on the receive
+	// thread if there is no executor.
+	virtual void Process(const T& record) = 0;
+
+	virtual bool RunPending(size_t maxRecords)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t t = tail.load(std::memory_order_acquire);
+		if (h == t) return false;
+
+		RecordDepth(t - h);
+
+		size_t end = (t - h > maxRecords) ? h + maxRecords : t;
+		for (; h != end; h++) {
+			if (discard.load()) {
+				dropped.fetch_add(t - h, std::memory_order_relaxed);
+				head.store(t, std::memory_order_release);
+				return false;
+			}
+
+			const Slot& s = ring[h & mask];
+			Clock::time_point start = Clock::now();
+			Process(s.record);
+			Clock::time_point done = Clock::now();
+			double latencyUs = Micros(start - s.time);
+
+			// the slot is the receive thread's again once head moves on.
+			head.store(h + 1, std::memory_order_release);
+			RecordTimes(latencyUs, Micros(done - start));
+		}
+		PublishStats();
+		return end != t || HasPending();
+	}
+
+	virtual bool HasPending(void) const { return head.load() != tail.load(); }
+
+	struct Slot
+	{
+		T record;
+		Clock::time_point time;     // when it was captured
+	};
+
+	std::vector<Slot> ring;
+	size_t mask;
+	std::atomic<size_t> head;       // next record to process
+	std::atomic<size_t> tail;       // next free slot
+	std::atomic<bool> discard;      // drop the records, the PDO is going
+};
+
+class TpdoExecutor
+{
+public:
+
+	TpdoExecutor() : workerCt(0), pdoCt(0), nextHome(0), stopRequest(false), running(false) {}
+
+	virtual ~TpdoExecutor() { Stop(); }
+
+	/**
+	 * Start the worker threads. One worker gives each attached PDO a
+	 * dedicated thread (shared only with the other PDOs attached to this
+	 * executor); more make a shared pool.
+	 *
+	 * @param workerNum The number of worker threads, 1 to 16.
+	 * @return NULL on success, or an error object on failure.
+	 */
+	const Error* Start(int workerNum = 1)
+	{
+		if (running.load()) return &TpdoExecutorError::AlreadyRunning;
+		if (workerNum < 1 || workerNum > TPDO_EXECUTOR_MAX_WORKERS) return &TpdoExecutorError::BadWorkerCount;
+
+		workerCt = workerNum;
+		stopRequest.store(false);
+		running.store(true);
+		for (int i = 0; i < workerCt; i++) {
+			workers[i].steals.store(0);
+			workers[i].sleeping.store(false);
+			workers[i].thread = std::thread(&TpdoExecutor::Run, this, i);
+		}
+		return 0;
+	}
+
+	// Stop the worker threads. Records still queued are not processed.
+	void Stop(void)
+	{
+		stopRequest.store(true);
+		for (int i = 0; i < workerCt; i++)
+			Wake(workers[i]);
+		for (int i = 0; i < workerCt; i++) {
+			if (workers[i].thread.joinable()) workers[i].thread.join();
+		}
+
+		// empty the queues, so the PDOs are queued again after a restart.
+		for (int i = 0; i < workerCt; i++) {
+			DeferredTpdoBase* pdo;
+			while (workers[i].queue.Pop(pdo))
+				pdo->scheduled.store(false);
+		}
+		running.store(false);
+	}
+
+	bool IsRunning(void) const { return running.load(); }
+
+	int GetWorkerCount(void) const { return workerCt; }
+
+	// The number of times a worker took a PDO queued on another worker.
+	uint64 GetSteals(void) const
+	{
+		uint64 n = 0;
+		for (int i = 0; i < workerCt; i++)
+			n += workers[i].steals.load();
+		return n;
+	}
+
+protected:
+
+	friend class DeferredTpdoBase;
+
+	// A bounded lock-free queue of PDOs. Any thread may push or pop. A
+	// PDO is on at most one queue at a time, so with no more than
+	// TPDO_EXECUTOR_MAX_PDOS attached it never fills.
+	class PdoQueue
+	{
+	public:
+
+		PdoQueue() : enqueuePos(0), dequeuePos(0)
+		{
+			for (size_t i = 0; i < SIZE; i++)
+				cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+
+		bool Push(DeferredTpdoBase* pdo)
+		{
+			Cell* c;
+			size_t pos = enqueuePos.load(std::memory_order_relaxed);
+			for (;;) {
+				c = &cells[pos & (SIZE - 1)];
+				intptr_t dif = (intptr_t)c->seq.load(std::memory_order_acquire) - (intptr_t)pos;
+				if (dif == 0) {
+					if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+				}
+				else if (dif < 0)
+					return false;
+				else
+					pos = enqueuePos.load(std::memory_order_relaxed);
+			}
+			c->pdo = pdo;
+			c->seq.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool Pop(DeferredTpdoBase*& pdo)
+		{
+			Cell* c;
+			size_t pos = dequeuePos.load(std::memory_order_relaxed);
+			for (;;) {
+				c = &cells[pos & (SIZE - 1)];
+				intptr_t dif = (intptr_t)c->seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+				if (dif == 0) {
+					if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+				}
+				else if (dif < 0)
+					return false;
+				else
+					pos = dequeuePos.load(std::memory_order_relaxed);
+			}
+			pdo = c->pdo;
+			c->seq.store(pos + SIZE, std::memory_order_release);
+			return true;
+		}
+
+		bool IsEmpty(void) const { return dequeuePos.load() >= enqueuePos.load(); }
+
+	protected:
+
+		enum { SIZE = TPDO_EXECUTOR_MAX_PDOS };
+
+		struct Cell
+		{
+			std::atomic<size_t> seq;
+			DeferredTpdoBase* pdo;
+		};
+
+		Cell cells[SIZE];
+		std::atomic<size_t> enqueuePos;
+		std::atomic<size_t> dequeuePos;
+	};
+
+	struct Worker
+	{
+		PdoQueue queue;
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::atomic<bool> sleeping;
+		std::atomic<uint64> steals;
+	};
+
+	// Give a PDO its home worker. Homes are handed out in turn, so the
+	// PDOs are spread over the workers however many have been detached.
+	const Error* Attach(DeferredTpdoBase& pdo)
+	{
+		if (pdoCt.fetch_add(1) >= TPDO_EXECUTOR_MAX_PDOS) {
+			pdoCt.fetch_sub(1);
+			return &TpdoExecutorError::TooManyPdos;
+		}
+		pdo.home = nextHome.fetch_add(1);
+		return 0;
+	}
+
+	// Give back the place of a PDO attached with Attach().
+	void Detach(DeferredTpdoBase& pdo)
+	{
+		(void)pdo;
+		pdoCt.fetch_sub(1);
+	}
+
+	// Queue a PDO that has records waiting. Called on the receive thread.
+	void Schedule(DeferredTpdoBase& pdo)
+	{
+		// not started, so nothing will run it; let it be queued later.
+		if (!workerCt) {
+			pdo.scheduled.store(false);
+			return;
+		}
+
+		Worker& w = workers[pdo.home % workerCt];
+		w.queue.Push(&pdo);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		// wake the home worker if it is asleep, or else any sleeping
+		// worker, which will steal the PDO.
+		if (w.sleeping.load()) {
+			Wake(w);
+			return;
+		}
+		for (int i = 0; i < workerCt; i++) {
+			if (workers[i].sleeping.load()) {
+				Wake(workers[i]);
+				return;
+			}
+		}
+	}
+
+	void Wake(Worker& w)
+	{
+		{
+			std::lock_guard<std::mutex> lock(w.mutex);
+		}
+		w.wake.notify_one();
+	}
+
+	bool AnyQueued(void) const
+	{
+		for (int i = 0; i < workerCt; i++) {
+			if (!workers[i].queue.IsEmpty()) return true;
+		}
+		return false;
+	}
+
+	void Run(int me)
+	{
+		Worker& w = workers[me];
+
+		while (!stopRequest.load()) {
+			DeferredTpdoBase* pdo = 0;
+			if (!w.queue.Pop(pdo)) {
+				// nothing of our own, so try the other workers' queues.
+				for (int i = 1; i < workerCt && !pdo; i++) {
+					if (workers[(me + i) % workerCt].queue.Pop(pdo)) w.steals.fetch_add(1);
+				}
+			}
+
+			if (pdo) {
+				RunPdo(*pdo, w);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(w.mutex);
+			w.sleeping.store(true);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (!AnyQueued() && !stopRequest.load())
+				w.wake.wait_for(lock, std::chrono::milliseconds(10));
+			w.sleeping.store(false);
+		}
+	}
+
+	// Process a batch of a PDO's records, and queue it again if there
+	// are more.
+	void RunPdo(DeferredTpdoBase& pdo, Worker& w)
+	{
+		pdo.busy.fetch_add(1);
+		if (pdo.RunPending(TPDO_EXECUTOR_BATCH)) {
+			w.queue.Push(&pdo);
+		}
+		else {
+			// a record may have arrived after the last check, while the
+			// PDO still looked queued to the receive thread.
+			pdo.scheduled.store(false);
+			if (pdo.HasPending() && !pdo.scheduled.exchange(true))
+				w.queue.Push(&pdo);
+		}
+
+		// the last the worker touches the PDO.
+		pdo.busy.fetch_sub(1);
+	}
+
+	int workerCt;
+	std::atomic<int> pdoCt;         // PDOs attached
+	std::atomic<uint32> nextHome;
+	std::atomic<bool> stopRequest;
+	std::atomic<bool> running;
+	Worker workers[TPDO_EXECUTOR_MAX_WORKERS];
+};
+
+inline const Error* DeferredTpdoBase::SetExecutor(TpdoExecutor* exec)
+{
+	if (exec == executor) return 0;
+	if (exec) {
+		const Error* err = exec->Attach(*this);
+		if (err) return err;
+	}
+	if (executor) {
+		WaitUnscheduled();
+		executor->Detach(*this);
+	}
+	executor = exec;
+	return 0;
+}
+
+inline void DeferredTpdoBase::WaitUnscheduled(void)
+{
+	// a stopped executor has joined its workers and emptied its queues.
+	while (executor->IsRunning() && (busy.load() || scheduled.load() || HasPending()))
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+inline void DeferredTpdoBase::Schedule(void)
+{
+	if (!scheduled.exchange(true))
+		executor->Schedule(*this);
+}
+
+CML_NAMESPACE_END()
+
+#endif
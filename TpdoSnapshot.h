@@ -0,0 +1,158 @@
+/*
+
+TpdoSnapshot.h
+
+The TpdoSnapshot class template passes the data of a TPDO from the
+thread that receives it to any number of threads that read it, without
+locks and without torn values.
+
+TPDO::Received() runs on CML's network receive thread. A program that
+reads the PDO's mapped variables (or copies of them) from its own
+thread may get some fields from one cycle and the rest from the next,
+or half of a value being written, and nothing stops the compiler from
+reading a plain variable once and never again in a polling loop.
+
+A TpdoSnapshot<T> holds one T, a struct of the fields of the PDO. The
+receive thread fills a T from the mapped variables and calls
+Publish(). Readers call Read() or Get() and always get a T that was
+published as a whole. It is a sequence lock: Publish() makes the
+sequence number odd, writes the data and makes it even again, and a
+reader that sees the number change, or sees it odd, reads again.
+
+- Publish() never waits, so the receive thread is never held up by a
+  reader.
+- A reader never waits for a lock. It only reads again if a publish
+  happened while it was reading, which with one publish per cycle
+  is rare. If the publishing thread is preempted in the middle of a
+  publish, a reader that keeps finding it unfinished yields its CPU
+  rather than spin out its time slice.
+- There must be only one thread publishing, normally the receive
+  thread.
+
+T must be trivially copyable (plain fields, no pointers to owned
+memory). It is stored as 64-bit atomic words, so a T of a few fields
+costs a few loads to read.
+
+Usage:
+
+	struct NodeStat { uint16 status; int32 position; };
+
+	class MyTpdo : public TPDO
+	{
+	public:
+		TpdoSnapshot<NodeStat> snapshot;
+
+		virtual void Received(void)
+		{
+			NodeStat s;
+			s.status = statusWord.Read();
+			s.position = actualPos.Read();
+			snapshot.Publish(s);
+		}
+		...
+	};
+
+	// any other thread
+	NodeStat s = tpdo.snapshot.Get();
+
+*/
+
+#ifndef TPDO_SNAPSHOT_H
+#define TPDO_SNAPSHOT_H
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+#include "CML.h"
+
+CML_NAMESPACE_START()
+
+template <class T>
+class TpdoSnapshot
+{
+	static_assert(std::is_trivially_copyable<T>::value, "TpdoSnapshot data must be trivially copyable");
+
+public:
+
+	TpdoSnapshot() : sequence(0)
+	{
+		for (int i = 0; i < WORDS; i++)
+			words[i].store(0, std::memory_order_relaxed);
+	}
+
+	TpdoSnapshot(const T& initial) : sequence(0) { Store(initial); }
+
+	// Publish a new value. Only one thread may call this.
+	void Publish(const T& value)
+	{
+		uint32 seq = sequence.load(std::memory_order_relaxed);
+		sequence.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		Store(value);
+
+		sequence.store(seq + 2, std::memory_order_release);
+	}
+
+	/**
+	 * Read the last value published.
+	 *
+	 * @param value Filled with the value.
+	 * @return The number of times a value has been published when it
+	 *         was read, which can be compared with an earlier return to
+	 *         see whether there is new data.
+	 */
+	uint32 Read(T& value) const
+	{
+		uint64 copy[WORDS];
+		uint32 before, after;
+		int tries = 0;
+
+		do {
+			if (++tries > SPIN_TRIES) std::this_thread::yield();
+
+			before = sequence.load(std::memory_order_acquire);
+			for (int i = 0; i < WORDS; i++)
+				copy[i] = words[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			after = sequence.load(std::memory_order_relaxed);
+		} while ((before & 1) || before != after);
+
+		memcpy(&value, copy, sizeof(T));
+		return before / 2;
+	}
+
+	// The last value published.
+	T Get(void) const
+	{
+		T value;
+		Read(value);
+		return value;
+	}
+
+	// The number of times a value has been published.
+	uint32 GetPublishCount(void) const { return sequence.load(std::memory_order_acquire) / 2; }
+
+protected:
+
+	enum { WORDS = (sizeof(T) + sizeof(uint64) - 1) / sizeof(uint64) };
+
+	// reads tried before a reader starts yielding.
+	enum { SPIN_TRIES = 64 };
+
+	void Store(const T& value)
+	{
+		uint64 copy[WORDS] = { 0 };
+		memcpy(copy, &value, sizeof(T));
+		for (int i = 0; i < WORDS; i++)
+			words[i].store(copy[i], std::memory_order_relaxed);
+	}
+
+	std::atomic<uint32> sequence;     // odd while a publish is in progress
+	std::atomic<uint64> words[WORDS];
+};
+
+CML_NAMESPACE_END()
+
+#endif